@@ -1,59 +1,344 @@
 #include <stdio.h>
-#include <string.h>         // strncpy()
+#include <stdlib.h>         // strtoul()
+#include <string.h>         // strcmp()
+#include <fcntl.h>          // open()
+#include <unistd.h>         // close(), isatty()
 #include "rpnstack.h"
+#include "rpnpstack.h"
 #include "rpnfunctions.h"
+#include "rpnprog.h"
+#include "rpnopt.h"
+#include "rpnjit.h"
+#include "rpnword.h"
+#include "rpnpar.h"
+#include "rpnstream.h"
+#include "rpnout.h"
+#include "rpnserve.h"
+#include "rpnsave.h"
 
 // rpn.c
 // a reverse polish notation calculator
-// gcc rpnstack.c rpnfunctions.c rpn.c -lm -o rpn
+// make rpn, or all on one line:
+// gcc rpnstack.c rpnpstack.c rpnfunctions.c rpnprog.c rpnnum.c rpnstream.c
+//     rpnout.c rpnvec.c rpnbig.c rpnopt.c rpnjit.c rpnword.c rpnpar.c
+//     rpnctx.c rpnserve.c rpnsave.c rpn.c -lm -lpthread -o rpn
+//
+// options come before the batch mode arguments, most take a number:
+// ./rpn --reserve 100000 ... backs the three stacks with one arena,
+// 100000 elements each, so they don't malloc until they outgrow it
+// ./rpn --hist-limit 100000 ... keeps 100000 elements of each history stack
+// in memory, older ones go to a temp file and come back when undo gets there
+// ./rpn --undo-depth 1000 ... forgets commands older than the last 1000
+// ./rpn --snapshots 5000 ... keeps 5000 versions of the interactive stack
+// for undo and redo in one step, default 1024 in interactive mode and 0 in
+// batch mode. 0: undo replays the history
+// ./rpn --roundtrip ... prints numbers with as many digits as it takes to
+// read them back exactly, instead of 10
+// ./rpn --fp-errors ... batch mode checks for math errors once a line and
+// prints them to stderr, "line 3: Divide by zero". without it, not at all
+// ./rpn --fp-precise ... also names the cmd, "line 3: Divide by zero, i
+// invert". a line with an error runs again, from before it, a cmd at a time
+// ./rpn --optimize ... folds constants and cancelling pairs in batch mode
+// lines and does "a * b +" in one step, the numbers stay the same. only
+// with --independent or -e, where no later line undoes into the optimized
+// one. ./rpn --fast-math ... also reassociates and uses fma(), the numbers
+// may change. see rpnopt.h
+// ./rpn --jit ... runs batch mode lines that come up again as x87 code.
+// no snapshots, undo replays the history. see rpnjit.h
+// ./rpn --rc file ... runs file first instead of ~/.rpnrc, the words it
+// defines are there from the start. --rc /dev/null for none
+// ./rpn --independent ... runs each line on empty stacks, the lines on a
+// thread per core, --threads 4 on 4. the output is the same as one at a
+// time. see rpnpar.h
+// ./rpn -e "2 * +" -F, data.csv ... runs the program on each row of the
+// files, after the row's fields, independent like that. -F is the field
+// separator, blanks if there's none. no file, stdin. a file that can't be
+// read is skipped, the exit status is 1 then. --rate also prints rows/s to
+// stderr
+// ./rpn --serve /tmp/rpn.sock ... serves sessions on the unix socket, a
+// line in, the stack out as batch mode prints it. --threads sizes the
+// pool. see rpnserve.h, rpn_load measures it
+// ./rpn --load s.rpn ... starts with the session saved in s.rpn, a line
+// "save s.rpn" saves one. ./rpn --autosave s.rpn ... also, if it's there,
+// and writes what changed to it after each line. see rpnsave.h
+//
+// batch mode arguments are programs, except
+// ./rpn -f progs.txt   runs each line of the file as a program
+// ./rpn -              does the same with stdin. - among other
+//                      arguments is still subtract
 
 int main(int argc, char* argv[]) {
+    size_t reserve = 0u, hist_limit = 0u, undo_depth = 0u, snapshots = 1024u;
+    int snapshots_set = 0;
+    size_t threads = 0u; // one per core
+    int independent = 0, rate = 0;
+    int failed = 0; // the exit status, a file of rows couldn't be read
+    const char *eprog = NULL, *serve = NULL, *load = NULL, *autosave = NULL;
+    char sep = '\0';
+    int batch_fp_check = FP_OFF;
+    const char *rc = NULL;
+    int argi = 1;
+    while (argi < argc) {
+        // the ones without a number
+        if (!strcmp(argv[argi], "--roundtrip")) {
+            out_set_roundtrip(1);
+            argi++;
+            continue;
+        } else if (!strcmp(argv[argi], "--fp-errors")) {
+            batch_fp_check = FP_LINE;
+            argi++;
+            continue;
+        } else if (!strcmp(argv[argi], "--fp-precise")) {
+            batch_fp_check = FP_PRECISE;
+            argi++;
+            continue;
+        } else if (!strcmp(argv[argi], "--optimize")) {
+            opt_level = OPT_EXACT;
+            argi++;
+            continue;
+        } else if (!strcmp(argv[argi], "--fast-math")) {
+            opt_level = OPT_FAST;
+            argi++;
+            continue;
+        } else if (!strcmp(argv[argi], "--jit")) {
+            jit_enabled = 1;
+            argi++;
+            continue;
+        } else if (!strcmp(argv[argi], "--independent")) {
+            independent = 1;
+            argi++;
+            continue;
+        } else if (!strcmp(argv[argi], "--rate")) {
+            rate = 1;
+            argi++;
+            continue;
+        } else if (!strncmp(argv[argi], "-F", 2) && argv[argi][2]) { // -F,
+            sep = !strcmp(argv[argi] + 2, "\\t") ? '\t' : argv[argi][2];
+            argi++;
+            continue;
+        }
+        if (argi + 1 == argc) {
+            break;
+        }
+        if (!strcmp(argv[argi], "--rc")) { // a file, not a number
+            rc = argv[argi + 1];
+            argi += 2;
+            continue;
+        } else if (!strcmp(argv[argi], "-e")) {
+            eprog = argv[argi + 1];
+            argi += 2;
+            continue;
+        } else if (!strcmp(argv[argi], "--serve")) {
+            serve = argv[argi + 1];
+            argi += 2;
+            continue;
+        } else if (!strcmp(argv[argi], "--load")) {
+            load = argv[argi + 1];
+            argi += 2;
+            continue;
+        } else if (!strcmp(argv[argi], "--autosave")) {
+            autosave = argv[argi + 1];
+            argi += 2;
+            continue;
+        } else if (!strcmp(argv[argi], "-F")) {
+            sep = !strcmp(argv[argi + 1], "\\t") ? '\t' : argv[argi + 1][0];
+            argi += 2;
+            continue;
+        }
+        size_t n = strtoul(argv[argi + 1], NULL, 0);
+        if (!strcmp(argv[argi], "--reserve")) {
+            reserve = n;
+        } else if (!strcmp(argv[argi], "--hist-limit")) {
+            hist_limit = n;
+        } else if (!strcmp(argv[argi], "--undo-depth")) {
+            undo_depth = n;
+        } else if (!strcmp(argv[argi], "--snapshots")) {
+            snapshots = n;
+            snapshots_set = 1;
+        } else if (!strcmp(argv[argi], "--threads")) {
+            threads = n;
+        } else {
+            break;
+        }
+        argi += 2;
+    }
+
     stack_t *rpn_stacks[3];
-    rpn_stacks[I_STK ] = stack_create(sizeof(RPN_T));   // 0 interactive stack
-    rpn_stacks[H_NUMS] = stack_create(sizeof(RPN_T));   // 1 history nums
-    rpn_stacks[H_CMDS] = stack_create(sizeof(token_t)); // 2 history cmds
+    stack_arena_t *arena = NULL;
+    if (reserve) {
+        arena = stack_arena_create(reserve * (2u * sizeof(RPN_T)
+                                              + sizeof(token_t))
+                                   + 3u * 16u); // alignment
+        rpn_stacks[I_STK ] = stack_create_in(arena, sizeof(RPN_T), reserve);
+        rpn_stacks[H_NUMS] = stack_create_in(arena, sizeof(RPN_T), reserve);
+        rpn_stacks[H_CMDS] = stack_create_in(arena, sizeof(token_t), reserve);
+    } else {
+        rpn_stacks[I_STK ] = stack_create(sizeof(RPN_T));   // 0 interactive
+        rpn_stacks[H_NUMS] = stack_create(sizeof(RPN_T));   // 1 history nums
+        rpn_stacks[H_CMDS] = stack_create(sizeof(token_t)); // 2 history cmds
+    }
+    if (hist_limit) { // spill half of it at a time
+        stack_limit(hist_limit, hist_limit / 2u, 1, rpn_stacks[H_NUMS]);
+        stack_limit(hist_limit, hist_limit / 2u, 1, rpn_stacks[H_CMDS]);
+    } else if (undo_depth) { // a binary op takes two H_NUMS
+        stack_limit(2u * undo_depth, 1u, 0, rpn_stacks[H_NUMS]);
+        stack_limit(undo_depth, 1u, 0, rpn_stacks[H_CMDS]);
+    }
+    // batch mode undoes by replaying, a version a cmd costs more than
+    // the undo lines there save
+    if (!snapshots_set && (argi < argc || eprog)) {
+        snapshots = 0u;
+    }
+    if (snapshots && !jit_enabled) { // a jitted line doesn't commit
+        pstack_enable(snapshots, rpn_stacks[I_STK]);
+    }
 
-    char *inputbuf = malloc(BUFSIZ); // [8192] here
+    char *inputbuf = NULL; // getline() grows it
+    size_t inputsize = 0u;
 
     // for printmsg_fresh, not for math_error()
     token_t last_msg = JUNK;
     int hist_flag = 0; // HTOG t
 
-    if (argc == 1) {
+    char rcpath[4096];
+    if (rc == NULL && getenv("HOME")) {
+        snprintf(rcpath, sizeof(rcpath), "%s/.rpnrc", getenv("HOME"));
+        rc = rcpath;
+    }
+    if (rc) {
+        word_rc(rc, &hist_flag, &last_msg, rpn_stacks);
+    }
+
+    if (!independent && !eprog) { // undo would see the rewritten lines
+        opt_level = OPT_OFF;
+    }
+
+    if (serve) { // the sessions have their own everything
+        fp_check = batch_fp_check;
+        return serve_run(serve, threads);
+    }
+
+    // after ~/.rpnrc, a session has its own words. not for the lines that
+    // run on empty stacks
+    save_state_t session = {0};
+    if (load && !independent && !eprog
+        && !save_load(&session, load, &hist_flag, rpn_stacks)) {
+        perror(load);
+        return 1;
+    }
+    if (autosave && !independent && !eprog
+        && !save_autosave(&session, autosave, &hist_flag, rpn_stacks)) {
+        perror(autosave);
+        return 1;
+    }
+
+    if (argi == argc && eprog == NULL) {
         // interactive mode
         printmsg(HELP); // not printmsg_fresh(), let user repeat first help cmd
+        out_set_render(isatty(1)); // redraw only what changed
         int quit = 0;
         while (!quit) {
             // separator, optional history stacks, interactive stack, prompt
             display(&hist_flag, rpn_stacks);
-            fgets(inputbuf, BUFSIZ, stdin); // get a line of input
+            ssize_t len = getline(&inputbuf, &inputsize, stdin);
+            if (len > 0 && inputbuf[len - 1] == '\n') {
+                out_echoed(len - 1);
+            } else if (len < 0 && inputbuf) {
+                inputbuf[0] = '\0'; // EOF, handle_input() checks it
+            }
             // prompt, read input line, operations, print messages
-            quit = handle_input(&hist_flag, &last_msg, inputbuf, rpn_stacks);
+            if (inputbuf == NULL || !save_line(&session, inputbuf, &hist_flag,
+                                               &last_msg, rpn_stacks)) {
+                quit = handle_input(&hist_flag, &last_msg, inputbuf,
+                                    rpn_stacks);
+            }
+            if (!save_sync(&session, hist_flag, rpn_stacks)) {
+                printmsg_fresh(SESF, &last_msg);
+            }
         }
     } else {
         // batch mode
-        // strncpy() instead of fgets() fills the inputbuf
+        // each argument is compiled once, repeated ones come from the cache
         // no display(). don't print anything but the stack contents
         p_printmsg_fresh = donot_printmsg_fresh;
         p_printmsg = donot_printmsg;
+        fp_check = batch_fp_check; // the msgs aren't printed anyway
 
-        int i;
-        for (i = 1; i < argc; i++) {
-            strncpy(inputbuf, argv[i], BUFSIZ - 1);
-            inputbuf[BUFSIZ - 1] = '\0';
-            if (handle_input(&hist_flag, &last_msg, inputbuf, rpn_stacks)) {
-                printmsg(QUIT);
-                break;
+        int i, quit = 0;
+        for (i = argi; i < argc && eprog; i++) { // files of rows
+            if (!strcmp(argv[i], "-")) {
+                par_read(0);
+            } else if (!par_map(argv[i])) { // said why, the rest still run
+                failed = 1;
+            }
+        }
+        if (eprog && argi == argc) {
+            par_read(0);
+        }
+        // --independent reads them all first
+        for (i = argi; i < argc && independent && !eprog; i++) {
+            if (!strcmp(argv[i], "-") && argi + 1 == argc) {
+                par_read(0);
+            } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+                int fd = open(argv[++i], O_RDONLY);
+                if (fd < 0) {
+                    perror(argv[i]);
+                    break;
+                }
+                par_read(fd);
+                close(fd);
+            } else {
+                par_line(argv[i], i - argi + 1);
+            }
+        }
+        if (independent || eprog) {
+            par_opts_t opts = {hist_limit, undo_depth, snapshots,
+                               eprog, sep, rate};
+            quit = par_run(threads, &opts);
+        }
+        for (i = argi; i < argc && !quit && !independent && !eprog; i++) {
+            if (!strcmp(argv[i], "-") && argi + 1 == argc) {
+                quit = stream_run(0, &session, &hist_flag, &last_msg,
+                                  rpn_stacks);
+            } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+                int fd = open(argv[++i], O_RDONLY);
+                if (fd < 0) {
+                    perror(argv[i]);
+                    break;
+                }
+                quit = stream_run(fd, &session, &hist_flag, &last_msg,
+                                  rpn_stacks);
+                close(fd);
+            } else {
+                if (!save_line(&session, argv[i], &hist_flag, &last_msg,
+                               rpn_stacks)) {
+                    rpn_prog_t *prog = prog_cached(argv[i]);
+                    quit = prog_run_line(prog, i - argi + 1, &hist_flag,
+                                         &last_msg, rpn_stacks);
+                }
+                if (!quit) { // save and load lines get theirs too
+                    dump_stack(rpn_stacks[I_STK]);
+                }
+            }
+            if (!save_sync(&session, hist_flag, rpn_stacks)) {
+                perror(autosave);
             }
-            dump_stack(rpn_stacks[I_STK]);
         }
+        if (quit) {
+            printmsg(QUIT);
+        }
+        prog_cache_clear();
     }
 
     free(inputbuf);
     stack_destroy(rpn_stacks[I_STK ]);
     stack_destroy(rpn_stacks[H_NUMS]);
     stack_destroy(rpn_stacks[H_CMDS]);
+    save_close(&session); // they may have been in its map
+    if (arena) {
+        stack_arena_destroy(arena);
+    }
 
-    return 0;
+    return failed;
 }
 
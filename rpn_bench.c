@@ -0,0 +1,1227 @@
+#include <stdio.h>
+#include <stdlib.h>     // malloc(), atol()
+#include <stdint.h>     // SIZE_MAX
+#include <string.h>     // strcmp(), strchr()
+#include <time.h>       // clock_gettime()
+#include <fcntl.h>      // open()
+#include <unistd.h>     // dup2()
+#include <math.h>       // signbit()
+#include <pthread.h>
+#include "rpnstack.h"
+#include "rpnpstack.h"
+#define RPN_TEST        // for the internal prototypes
+#include "rpnfunctions.h"
+#include "rpnprog.h"
+#include "rpnopt.h"
+#include "rpnjit.h"
+#include "rpnword.h"
+#include "rpnnum.h"
+#include "rpnout.h"
+#include "rpnvec.h"
+#include "rpnbig.h"
+#include "rpnpar.h"
+#include "rpnctx.h"
+
+// rpn_bench.c
+// microbenchmarks for the rpn calculator
+// ./rpn_bench              runs all of them
+// ./rpn_bench typed roll   runs the ones with those names
+// ./rpn_bench -o new.tsv -c old.tsv ...
+//                          also writes the results to new.tsv, a line each,
+//                          and prints how much slower or faster each one
+//                          is than in old.tsv. make bench does that
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// the bench running, -o's file and -c's results
+static const char *bench_name;
+static FILE *results;
+static struct old_result {
+    char name[64];
+    double ns;
+} *old_results;
+static size_t nold;
+
+// -c file, as written by -o. 0 if it can't be read
+static int read_old(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    char line[256], bench[32], name[64];
+    double ns;
+    size_t cap = 0u;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%31[^\t]\t%63[^\t]\t%*s\t%lf", bench, name, &ns) != 3
+            || *line == '#') {
+            continue;
+        }
+        if (nold == cap) {
+            cap = cap ? 2u * cap : 64u;
+            old_results = realloc(old_results, cap * sizeof(*old_results));
+            if (old_results == NULL) {
+                fclose(fp);
+                return 0;
+            }
+        }
+        snprintf(old_results[nold].name, sizeof(old_results[nold].name),
+                 "%s", name);
+        old_results[nold++].ns = ns;
+    }
+    fclose(fp);
+    return 1;
+}
+
+// every report() ends here. allocs is SIZE_MAX if they weren't counted
+static void result(const char *name, size_t ops, double secs, size_t nallocs) {
+    double ns = secs * 1e9 / ops;
+    printf("%-32s %12zu ops %10.2f ns/op %12.0f ops/s", name, ops, ns,
+           ops / secs);
+    if (nallocs != SIZE_MAX) {
+        printf(" %10zu allocs", nallocs);
+    }
+    size_t z;
+    for (z = 0u; z < nold; z++) {
+        if (!strcmp(old_results[z].name, name)) {
+            printf(" %+7.1f%%", (ns / old_results[z].ns - 1.0) * 100.0);
+            break;
+        }
+    }
+    printf("\n");
+    if (results) { // tab separated: bench name ops ns/op ops/s allocs
+        fprintf(results, "%s\t%s\t%zu\t%.3f\t%.0f\t", bench_name, name, ops,
+                ns, ops / secs);
+        if (nallocs != SIZE_MAX) {
+            fprintf(results, "%zu", nallocs);
+        }
+        fprintf(results, "\n");
+    }
+}
+
+static void report(const char *name, size_t ops, double secs) {
+    result(name, ops, secs, SIZE_MAX);
+}
+
+static size_t allocs(void) {
+    stack_stats_t st = stack_stats();
+    return st.mallocs + st.reallocs + st.frees;
+}
+
+static void report_allocs(const char *name, size_t ops, double secs,
+                          size_t nallocs)
+{
+    result(name, ops, secs, nallocs);
+}
+
+// keeps results alive so the loops aren't optimized away
+static volatile RPN_T sink;
+
+// base depth keeps the loops clear of stack_shrink_halfful()
+static void make_stacks(stack_t *stks[]) {
+    stks[I_STK ] = stack_create(sizeof(RPN_T));
+    stks[H_NUMS] = stack_create(sizeof(RPN_T));
+    stks[H_CMDS] = stack_create(sizeof(token_t));
+    size_t z;
+    for (z = 0u; z < 64u; z++) {
+        num_push(RPN_ONE, stks[I_STK ]);
+        num_push(RPN_ONE, stks[H_NUMS]);
+    }
+}
+
+static void free_stacks(stack_t *stks[]) {
+    stack_destroy(stks[I_STK ]);
+    stack_destroy(stks[H_NUMS]);
+    stack_destroy(stks[H_CMDS]);
+}
+
+// ___ typed: generic void * stack against the inlined typed stack _____________
+
+// what transfer() and binary() did before STACK_TYPED
+static RPN_T generic_transfer(stack_t *src, stack_t *dest) {
+    RPN_T item;
+    stack_pop(&item, src);
+    stack_push(&item, dest);
+    return item;
+}
+
+static void generic_binary(token_t cmd, stack_t *stks[]) {
+    RPN_T topnum = generic_transfer(stks[I_STK ], stks[H_NUMS]);
+    RPN_T nextnum = generic_transfer(stks[I_STK ], stks[H_NUMS]);
+    RPN_T (*fun)(RPN_T x, RPN_T y) = funrows[cmd].fun;
+    RPN_T result = fun(nextnum, topnum);
+    stack_push(&result, stks[I_STK ]);
+}
+
+static void bench_typed(size_t n) {
+    stack_t *stks[3];
+    make_stacks(stks);
+    RPN_T one = RPN_ONE;
+    size_t i;
+    double t;
+
+    t = now();
+    for (i = 0u; i < n; i++) {
+        sink = generic_transfer(stks[I_STK], stks[H_NUMS]);
+        sink = generic_transfer(stks[H_NUMS], stks[I_STK]);
+    }
+    report("transfer generic", 2u * n, now() - t);
+    t = now();
+    for (i = 0u; i < n; i++) {
+        sink = transfer(stks[I_STK], stks[H_NUMS]);
+        sink = transfer(stks[H_NUMS], stks[I_STK]);
+    }
+    report("transfer typed", 2u * n, now() - t);
+
+    // push a number, add it. H_NUMS grows by two per op
+    t = now();
+    for (i = 0u; i < n; i++) {
+        stack_push(&one, stks[I_STK]);
+        generic_binary(ADD, stks);
+    }
+    report("binary generic", n, now() - t);
+    free_stacks(stks);
+
+    make_stacks(stks);
+    t = now();
+    for (i = 0u; i < n; i++) {
+        num_push(RPN_ONE, stks[I_STK]);
+        binary(ADD, stks);
+    }
+    report("binary typed", n, now() - t);
+    sink = num_top(stks[I_STK]);
+    free_stacks(stks);
+}
+
+// ___ reserve: pushing and popping across the shrink line ____________________
+
+// fill to depth, then pop and push 1500 back and forth over 41% of it
+static void pingpong(const char *name, size_t n, size_t depth, stack_t *stk) {
+    size_t i, z;
+    size_t a = allocs();
+    double t = now();
+    for (z = 0u; z < depth; z++) {
+        num_push(RPN_ONE, stk);
+    }
+    for (i = 0u; i < n; i += 3000u) {
+        for (z = 0u; z < 1500u; z++) {
+            sink = num_pop(stk);
+        }
+        for (z = 0u; z < 1500u; z++) {
+            num_push(RPN_ONE, stk);
+        }
+    }
+    report_allocs(name, n, now() - t, allocs() - a);
+}
+
+static void bench_reserve(size_t n) {
+    size_t depth = 3000u;
+    stack_t *stk = stack_create(sizeof(RPN_T));
+    pingpong("pingpong default", n, depth, stk);
+    stack_destroy(stk);
+
+    stk = stack_create(sizeof(RPN_T));
+    stack_reserve(depth, stk);
+    pingpong("pingpong reserved", n, depth, stk);
+    stack_destroy(stk);
+
+    stack_arena_t *arena = stack_arena_create(depth * sizeof(RPN_T));
+    stk = stack_create_in(arena, sizeof(RPN_T), depth);
+    pingpong("pingpong arena", n, depth, stk);
+    stack_destroy(stk);
+    stack_arena_destroy(arena);
+}
+
+// ___ roll: ring buffer against memmove _____________________________________
+
+// what stack_roll() did before the ring. malloc, memmove the whole stack
+static void memmove_roll(int direction, stack_t *stk) {
+    void *tmp = malloc(stk->elemsz);
+    size_t blocksize = (stk->index - 1u) * stk->elemsz;
+    if (direction == 1) {
+        memcpy(tmp, stk->data + blocksize, stk->elemsz);
+        memmove(stk->data + stk->elemsz, stk->data, blocksize);
+        memcpy(stk->data, tmp, stk->elemsz);
+    } else {
+        memcpy(tmp, stk->data, stk->elemsz);
+        memmove(stk->data, stk->data + stk->elemsz, blocksize);
+        memcpy(stk->data + blocksize, tmp, stk->elemsz);
+    }
+    free(tmp);
+}
+
+static void bench_roll(size_t n) {
+    size_t depth = 1000000u;
+    size_t i;
+    double t;
+    stack_t *stk = stack_create(sizeof(RPN_T));
+    for (i = 0u; i < depth; i++) {
+        num_push((RPN_T)i, stk);
+    }
+    t = now();
+    for (i = 0u; i < n / 1000u; i++) { // it's slow
+        memmove_roll(i & 1u ? -1 : 1, stk);
+    }
+    report("roll 1M memmove", n / 1000u, now() - t);
+    t = now();
+    for (i = 0u; i < n; i++) {
+        stack_roll(1, stk);
+    }
+    report("roll 1M ring down", n, now() - t);
+    t = now();
+    for (i = 0u; i < n; i++) {
+        stack_roll(-1, stk);
+    }
+    report("roll 1M ring up", n, now() - t);
+    // "c r +" Fibonacci step on a deep stack
+    t = now();
+    for (i = 0u; i < n; i++) {
+        copy(stk);
+        rold(stk);
+        num_push(num_pop(stk) + num_pop(stk), stk);
+    }
+    report("c r + on 1M", n, now() - t);
+    sink = num_top(stk);
+    stack_destroy(stk);
+}
+
+// ___ history: unlimited, spilled to a temp file, dropped ____________________
+
+static void history(const char *name, size_t n, size_t limit, int spill) {
+    stack_t *stks[3];
+    make_stacks(stks);
+    if (limit) {
+        stack_limit(2u * limit, spill ? limit : 1u, spill, stks[H_NUMS]);
+        stack_limit(limit, spill ? limit / 2u : 1u, spill, stks[H_CMDS]);
+    }
+    int hist_flag = 0;
+    token_t last_msg = JUNK;
+    size_t i;
+    double t = now();
+    for (i = 0u; i < n; i++) {
+        vet_do(&hist_flag, &last_msg, RPN_ONE, NUM, stks);
+        vet_do(&hist_flag, &last_msg, RPN_ZERO, ADD, stks);
+    }
+    for (i = 0u; i < n; i++) { // undo half of it
+        undo(1u, &last_msg, stks);
+    }
+    report(name, 3u * n, now() - t);
+    printf("%32s %zu H_NUMS %zu H_CMDS in memory, %zu H_NUMS spilled, "
+           "%zu dropped\n", "",
+           stks[H_NUMS]->index, stks[H_CMDS]->index,
+           stks[H_NUMS]->spilled, stks[H_NUMS]->dropped);
+    free_stacks(stks);
+}
+
+static void bench_history(size_t n) {
+    p_printmsg = donot_printmsg;
+    p_printmsg_fresh = donot_printmsg_fresh;
+    history("history unlimited", n, 0u, 0);
+    history("history spilled", n, 100000u, 1);
+    history("history dropped", n, 100000u, 0);
+}
+
+// ___ undo: snapshots against replaying the history __________________________
+
+// "c r +" steps on a deep stack, then undo all of them in one go and redo
+static void undo_jump(const char *name, size_t n, int snapshots) {
+    stack_t *stks[3];
+    make_stacks(stks);
+    int hist_flag = 0;
+    token_t last_msg = JUNK;
+    size_t i;
+    for (i = 0u; i < 1000000u; i++) {
+        num_push((RPN_T)i, stks[I_STK]);
+    }
+    if (snapshots) {
+        pstack_enable(n * 3u + 1u, stks[I_STK]);
+    }
+    double t = now();
+    for (i = 0u; i < n; i++) {
+        vet_do(&hist_flag, &last_msg, RPN_ZERO, COPY, stks);
+        vet_do(&hist_flag, &last_msg, RPN_ZERO, ROLD, stks);
+        vet_do(&hist_flag, &last_msg, RPN_ZERO, ADD, stks);
+    }
+    report(snapshots ? "c r + with snapshots" : "c r + without", 3u * n,
+           now() - t);
+    t = now();
+    undo(3u * n, &last_msg, stks);
+    report(name, 3u * n, now() - t);
+    if (snapshots) {
+        t = now();
+        redo(3u * n, &last_msg, stks);
+        report("redo snapshots", 3u * n, now() - t);
+    }
+    free_stacks(stks);
+}
+
+static void bench_undo(size_t n) {
+    p_printmsg = donot_printmsg;
+    p_printmsg_fresh = donot_printmsg_fresh;
+    undo_jump("undo replay", n, 0);
+    undo_jump("undo snapshots", n, 1);
+}
+
+// ___ lex: strtok, strtold and a funrows scan against the chartab lexer _____
+
+// what tokenize() did before lex()
+static token_t strtold_tokenize(char *inputbuf, RPN_T *inputnum) {
+    *inputnum = RPN_STRTO(inputbuf, NULL);
+    char tok0 = *inputbuf;
+    if (*inputnum || (tok0 == '0')) {
+        return NUM;
+    }
+    int i = 1;
+    while (i < JUNK) {
+        if (tok0 == funrows[i].tok) {
+            return i;
+        }
+        i++;
+    }
+    return JUNK;
+}
+
+static void bench_lex(size_t n) {
+    static const char *mixed[] = {
+        "1.8", "*", "32", "+", "r", "c", "s", "-40", "0x.b", "~", "i", "_",
+        "12345.678", "^", "v", "d", "e", "l", "1e10", "/",
+    };
+    size_t nmixed = sizeof(mixed) / sizeof(mixed[0]);
+    size_t len = 0u, z;
+    char *line = malloc(n * 12u + 1u);
+    char *copy = malloc(n * 12u + 1u);
+    for (z = 0u; z < n; z++) {
+        len += sprintf(line + len, "%s ", mixed[z % nmixed]);
+    }
+    RPN_T num;
+    size_t ntoks = 0u;
+    double t = now();
+    memcpy(copy, line, len + 1u); // strtok writes into it
+    char *chp, *str;
+    for (chp = copy; (str = strtok(chp, " \t")); chp = NULL) {
+        ntoks += strtold_tokenize(str, &num) < JUNK;
+    }
+    report("strtok strtold tokenize", ntoks, now() - t);
+    ntoks = 0u;
+    t = now();
+    const char *tok, *end;
+    for (tok = lex(line, &end); tok; tok = lex(end, &end)) {
+        ntoks += tokenize(tok, &num) < JUNK;
+    }
+    report("lex tokenize", ntoks, now() - t);
+    sink = num;
+    free(line);
+    free(copy);
+}
+
+// ___ prog: handle_input() against compiled, cached lines ____________________
+
+static void bench_prog(size_t n) {
+    const char *fahrenheit = "-40 0 37.8 100 1.8 * 32 + r 1.8 * 32 + r "
+                             "1.8 * 32 + r 1.8 * 32 + r d d d d";
+    stack_t *stks[3];
+    int hist_flag = 0;
+    token_t last_msg = JUNK;
+    size_t i;
+    p_printmsg = donot_printmsg;
+    p_printmsg_fresh = donot_printmsg_fresh;
+
+    make_stacks(stks);
+    double t = now();
+    for (i = 0u; i < n; i++) {
+        handle_input(&hist_flag, &last_msg, fahrenheit, stks);
+    }
+    report("fahrenheit handle_input", 24u * n, now() - t);
+    free_stacks(stks);
+
+    make_stacks(stks);
+    t = now();
+    for (i = 0u; i < n; i++) {
+        prog_run(prog_cached(fahrenheit), &hist_flag, &last_msg, stks);
+    }
+    report("fahrenheit prog_cached", 24u * n, now() - t);
+    free_stacks(stks);
+
+    // batch mode, the fp flags once a line or not at all
+    int modes[] = {FP_LINE, FP_OFF};
+    const char *names[] = {"fahrenheit fp once a line", "fahrenheit fp off"};
+    size_t m;
+    for (m = 0u; m < 2u; m++) {
+        fp_check = modes[m];
+        make_stacks(stks);
+        t = now();
+        for (i = 0u; i < n; i++) {
+            prog_run_line(prog_cached(fahrenheit), i + 1u,
+                          &hist_flag, &last_msg, stks);
+        }
+        report(names[m], 24u * n, now() - t);
+        free_stacks(stks);
+    }
+
+    // rpnopt.c, a line is 4 numbers, 4 MULA r, 4 d. ops are still the
+    // 24 tokens. the 4 results against the ones without it
+    int levels[] = {OPT_EXACT, OPT_FAST};
+    const char *opt_names[] = {"fahrenheit --optimize",
+                               "fahrenheit --fast-math"};
+    fp_check = FP_OFF;
+    for (m = 0u; m < 2u; m++) {
+        opt_level = OPT_OFF;
+        rpn_prog_t *plain = prog_compile(fahrenheit);
+        opt_level = levels[m];
+        rpn_prog_t *prog = prog_compile(fahrenheit);
+        make_stacks(stks);
+        t = now();
+        for (i = 0u; i < n; i++) {
+            prog_run_line(prog, i + 1u, &hist_flag, &last_msg, stks);
+        }
+        report(opt_names[m], 24u * n, now() - t);
+        size_t differ = 0u, z;
+        plain->ninsns -= 4u; // not the d d d d
+        prog->ninsns -= 4u;
+        prog_run(plain, &hist_flag, &last_msg, stks);
+        prog_run(prog, &hist_flag, &last_msg, stks);
+        for (z = 0u; z < 4u; z++) {
+            differ += num_peek(z, stks[I_STK]) != num_peek(z + 4u, stks[I_STK]);
+        }
+        printf("%32s %zu of 4 differ, %zu insns of 24\n", "", differ,
+               prog->ninsns + 4u);
+        free_stacks(stks);
+        prog_destroy(plain);
+        prog_destroy(prog);
+    }
+    opt_level = OPT_OFF;
+    fp_check = FP_CMD;
+    prog_cache_clear();
+}
+
+// ___ num: num_parse() against strtold(), or RPN_STRTO ______________________
+
+// numbers like people type them, and some that need the slow path
+static void bench_num(size_t n) {
+    size_t len = 0u, z;
+    char *text = malloc(n * 32u);
+    char **nums = malloc(n * sizeof(*nums));
+    srand(1u);
+    for (z = 0u; z < n; z++) {
+        nums[z] = text + len;
+        switch (z % 8u) {
+        case 0: len += sprintf(text + len, "%d", rand() % 1000); break;
+        case 1: len += sprintf(text + len, "-%d.%02d", rand() % 100,
+                               rand() % 100); break;
+        case 2: len += sprintf(text + len, "%d.%d", rand(), rand()); break;
+        case 3: len += sprintf(text + len, "%de%d", rand() % 1000,
+                               rand() % 40 - 20); break;
+        case 4: len += sprintf(text + len, "0x%x.%xp%d", rand(), rand() % 16,
+                               rand() % 20); break;
+        case 5: len += RPN_SNPRINTF(text + len, 32, 20, (RPN_T)rand() / 7);
+                break;
+        case 6: len += sprintf(text + len, "1.8"); break;
+        default: len += sprintf(text + len, "%de300", rand()); break;
+        }
+        len++;
+    }
+    size_t mismatches = 0u;
+    for (z = 0u; z < n; z++) {
+        RPN_T fast = num_parse(nums[z], NULL);
+        RPN_T slow = RPN_STRTO(nums[z], NULL);
+        mismatches += fast != slow || signbit(fast) != signbit(slow);
+    }
+    RPN_T sum = RPN_ZERO;
+    double t = now();
+    for (z = 0u; z < n; z++) {
+        sum += RPN_STRTO(nums[z], NULL);
+    }
+    report("libc strto*", n, now() - t);
+    t = now();
+    for (z = 0u; z < n; z++) {
+        sum += num_parse(nums[z], NULL);
+    }
+    report("num_parse", n, now() - t);
+    printf("%32s %zu differ from strtold\n", "", mismatches);
+    sink = sum;
+    free(nums);
+    free(text);
+}
+
+// ___ dump: printf() per number against the output buffer __________________
+
+// what dump_stack() did before rpnout.c
+static void printf_dump(stack_t *stk) {
+    size_t lim = stack_size(stk);
+    size_t z;
+    for (z = 0u; z < lim; z++) {
+#ifdef RPN_FLOAT128
+        char buf[NUM_BUFSIZ];
+        quadmath_snprintf(buf, sizeof(buf), RPN_FMT, num_peek(z, stk));
+        printf("%s", buf);
+#else
+        printf(RPN_FMT, num_peek(z, stk));
+#endif
+        printf(" ");
+    }
+    puts("");
+}
+
+// stdout goes to /dev/null meanwhile
+static void bench_dump(size_t n) {
+    stack_t *stk = stack_create(sizeof(RPN_T));
+    size_t z;
+    srand(1u);
+    for (z = 0u; z < n; z++) { // a mix of short and long numbers
+        num_push(z % 2u ? (RPN_T)rand() / 64 : (RPN_T)rand() / 7, stk);
+    }
+    fflush(stdout);
+    int saved = dup(1);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, 1);
+    double t = now();
+    printf_dump(stk);
+    fflush(stdout);
+    double t_printf = now() - t;
+    t = now();
+    dump_stack(stk);
+    double t_out = now() - t;
+    out_set_roundtrip(1);
+    t = now();
+    dump_stack(stk);
+    double t_roundtrip = now() - t;
+    out_set_roundtrip(0);
+    dup2(saved, 1);
+    close(devnull);
+    close(saved);
+    report("dump printf", n, t_printf);
+    report("dump out_num", n, t_out);
+    report("dump out_num roundtrip", n, t_roundtrip);
+    stack_destroy(stk);
+}
+
+// ___ backend: throughput and accuracy of this build's RPN_T ________________
+
+// sum 1 / (k (k + 1)) for k = 1..n is n / (n + 1), "k c 1 + * i +" a term.
+// correct digits are -log10 of the relative error, 0 error shows as 99
+static double correct_digits(RPN_T got, RPN_T want) {
+    RPN_T err = RPN_FABS((got - want) / want);
+    return err == RPN_ZERO ? 99.0 : -log10((double)err);
+}
+
+static void bench_backend(size_t n) {
+    stack_t *stks[3];
+    int hist_flag = 0;
+    token_t last_msg = JUNK;
+    size_t k;
+    p_printmsg = donot_printmsg;
+    p_printmsg_fresh = donot_printmsg_fresh;
+    printf("%s, %d bit mantissa\n", RPN_NAME, RPN_MANT_DIG);
+
+    make_stacks(stks);
+    rpn_prog_t *term = prog_compile("c 1 + * i +");
+    num_push(RPN_ZERO, stks[I_STK]);
+    double t = now();
+    for (k = 1u; k <= n; k++) {
+        num_push((RPN_T)k, stks[I_STK]);
+        prog_run(term, &hist_flag, &last_msg, stks);
+    }
+    report("telescoping sum", 6u * n, now() - t);
+    printf("%32s %.1f correct digits\n", "",
+           correct_digits(num_top(stks[I_STK]), (RPN_T)n / (RPN_T)(n + 1u)));
+    prog_destroy(term);
+    free_stacks(stks);
+
+    // l e l e ... on 1e10 comes back to 1e10, but for the rounding that
+    // e multiplies by l(1e10) = 23
+    make_stacks(stks);
+    rpn_prog_t *explog = prog_compile("l e l e l e l e l e");
+    num_push((RPN_T)1e10, stks[I_STK]);
+    t = now();
+    for (k = 0u; k < n / 10u; k++) {
+        prog_run(explog, &hist_flag, &last_msg, stks);
+    }
+    report("l e", n, now() - t);
+    printf("%32s %.1f correct digits\n", "",
+           correct_digits(num_top(stks[I_STK]), (RPN_T)1e10));
+    prog_destroy(explog);
+    free_stacks(stks);
+
+    // 2 v squared, back to 2
+    make_stacks(stks);
+    rpn_prog_t *root2 = prog_compile("2 2 v c *");
+    t = now();
+    for (k = 0u; k < n / 10u; k++) {
+        prog_run(root2, &hist_flag, &last_msg, stks);
+        num_pop(stks[I_STK]);
+    }
+    report("2 2 v c *", n / 2u, now() - t);
+    prog_run(root2, &hist_flag, &last_msg, stks);
+    printf("%32s %.1f correct digits\n", "",
+           correct_digits(num_top(stks[I_STK]), (RPN_T)2));
+    prog_destroy(root2);
+    free_stacks(stks);
+}
+
+// ___ vec: a line per number against the line once on a vector ______________
+
+// n values to fahrenheit, 10 times. the history of each pass is dropped,
+// so the vectors can be collected
+static void bench_vec(size_t n) {
+    stack_t *stks[3];
+    int hist_flag = 0;
+    token_t last_msg = JUNK;
+    size_t rep, z;
+    p_printmsg = donot_printmsg;
+    p_printmsg_fresh = donot_printmsg_fresh;
+    rpn_prog_t *fahrenheit = prog_compile("1.8 * 32 +");
+
+    make_stacks(stks);
+    double t = now();
+    for (rep = 0u; rep < 10u; rep++) {
+        for (z = 0u; z < n; z++) {
+            num_push((RPN_T)z, stks[I_STK]);
+            prog_run(fahrenheit, &hist_flag, &last_msg, stks);
+            sink = num_pop(stks[I_STK]);
+        }
+        while (stack_size(stks[H_NUMS]) > 64u) {
+            num_pop(stks[H_NUMS]);
+        }
+    }
+    report("fahrenheit per number", 10u * n, now() - t);
+    free_stacks(stks);
+
+    make_stacks(stks);
+    rpn_vec_t *vec;
+    RPN_T nums = vec_new(n, &vec);
+    for (z = 0u; z < n; z++) {
+        vec->data[z] = (RPN_T)z;
+    }
+    t = now();
+    for (rep = 0u; rep < 10u; rep++) {
+        num_push(nums, stks[I_STK]);
+        prog_run(fahrenheit, &hist_flag, &last_msg, stks);
+        sink = vec_get(num_pop(stks[I_STK]))->data[n - 1u];
+        while (stack_size(stks[H_NUMS]) > 64u) {
+            num_pop(stks[H_NUMS]);
+        }
+        num_push(nums, stks[H_NUMS]); // keeps it from vec_collect()
+    }
+    report("fahrenheit on a vector", 10u * n, now() - t);
+    free_stacks(stks);
+    prog_destroy(fahrenheit);
+}
+
+// ___ big: the p50 numbers at 100, 1000, 10000 digits ______________________
+
+// how many digits of the big x are 0 after the point, x being an error
+static long zero_digits(RPN_T x) {
+    char *buf = malloc(big_format_size(x));
+    big_format(buf, x);
+    char *e = strchr(buf, 'e');
+    long zeros = !strcmp(buf, "0") ? (long)big_digits() : e ? -atol(e + 1) : 0;
+    free(buf);
+    return zeros;
+}
+
+// reps of each op shrink with the digits. 2 v c * - is how far 2 v squared
+// is from 2
+static void bench_big(size_t n) {
+    static const size_t digits[] = {100u, 1000u, 10000u};
+    static const struct {
+        const char *name;
+        token_t cmd;
+        size_t per; // reps are n / (per digits)
+    } ops[] = {
+        {"*", MUL, 1u}, {"/", DIVI, 4u}, {"2 v", ROOT, 10u},
+        {"e", EXPE, 100u}, {"l", LOGN, 100u},
+    };
+    stack_t *stks[3];
+    size_t d, o, z;
+    for (d = 0u; d < sizeof(digits) / sizeof(digits[0]); d++) {
+        big_set_digits(digits[d]);
+        make_stacks(stks);
+        RPN_T third = big_binary(DIVI, RPN_ONE, (RPN_T)3);
+        RPN_T root2 = big_binary(ROOT, (RPN_T)2, (RPN_T)2);
+        num_push(third, stks[I_STK]); // roots for vec_collect()
+        num_push(root2, stks[I_STK]);
+        for (o = 0u; o < sizeof(ops) / sizeof(ops[0]); o++) {
+            size_t reps = n / (ops[o].per * digits[d]);
+            reps = reps ? reps : 1u;
+            double t = now();
+            for (z = 0u; z < reps; z++) {
+                if (ops[o].cmd == ROOT) {
+                    sink = big_binary(ROOT, (RPN_T)2, (RPN_T)2);
+                } else if (ops[o].cmd == EXPE || ops[o].cmd == LOGN) {
+                    sink = big_unary(ops[o].cmd, root2);
+                } else {
+                    sink = big_binary(ops[o].cmd, third, root2);
+                }
+                vec_collect(stks);
+            }
+            char name[32];
+            snprintf(name, sizeof(name), "%zu digits %s", digits[d],
+                     ops[o].name);
+            report(name, reps, now() - t);
+        }
+        RPN_T err = big_binary(SUB, big_binary(MUL, root2, root2), (RPN_T)2);
+        printf("%32s %ld correct digits\n", "", zero_digits(err));
+        free_stacks(stks);
+    }
+    big_set_digits(0u);
+}
+
+// ___ jit: a line a row, rpnprog.c against rpnjit.c _________________________
+
+// 3 x^2 + 2 x + 1 of a number, as a csv row of a batch file would be.
+// the stack is the same after each row. the jitted line is x87 code on
+// the long double build, the others run it in rpnprog.c both times
+static void bench_jit(size_t n) {
+    const char *row = "0.75 c c * 3 * s 2 * + 1 + d";
+    const char *names[] = {"row rpnprog.c", "row --jit"};
+    stack_t *stks[3];
+    int hist_flag = 0;
+    token_t last_msg = JUNK;
+    size_t i;
+    int j;
+    p_printmsg = donot_printmsg;
+    p_printmsg_fresh = donot_printmsg_fresh;
+    fp_check = FP_OFF;
+    for (j = 0; j < 2; j++) {
+        jit_enabled = j;
+        rpn_prog_t *prog = prog_compile(row);
+        make_stacks(stks);
+        double t = now();
+        for (i = 0u; i < n; i++) {
+            prog_run_line(prog, i + 1u, &hist_flag, &last_msg, stks);
+        }
+        double secs = now() - t;
+        report(names[j], n, secs);
+        printf("%32s %.0f rows/s\n", "", n / secs);
+        free_stacks(stks);
+        prog_destroy(prog);
+    }
+    jit_enabled = 0;
+    fp_check = FP_CMD;
+}
+
+// ___ word: a user word against its body typed out _________________________
+
+// the word's body runs as compiled insns from handle_tokens(), and is
+// inlined into a compiled line. ops are the line's 6 tokens typed out
+static void bench_word(size_t n) {
+    const char *typed[] = {"100 1.8 * 32 + d", "100 f d"};
+    const char *names[] = {"body handle_tokens", "word handle_tokens",
+                           "body prog_cached", "word prog_cached"};
+    stack_t *stks[3];
+    int hist_flag = 0;
+    token_t last_msg = JUNK;
+    size_t i;
+    int j;
+    p_printmsg = donot_printmsg;
+    p_printmsg_fresh = donot_printmsg_fresh;
+    fp_check = FP_OFF;
+    make_stacks(stks);
+    handle_tokens(&hist_flag, &last_msg, ": f 1.8 * 32 + ;", stks);
+    free_stacks(stks);
+    for (j = 0; j < 4; j++) {
+        const char *line = typed[j % 2];
+        make_stacks(stks);
+        double t = now();
+        for (i = 0u; i < n; i++) {
+            if (j < 2) {
+                handle_tokens(&hist_flag, &last_msg, line, stks);
+            } else {
+                prog_run(prog_cached(line), &hist_flag, &last_msg, stks);
+            }
+        }
+        report(names[j], 6u * n, now() - t);
+        free_stacks(stks);
+    }
+    word_undo();
+    prog_cache_clear();
+    fp_check = FP_CMD;
+}
+
+// ___ independent: lines on 1 to 8 threads _______________________________
+
+// --independent over n csv rows, the numbers differ from row to row so
+// each is compiled once. stdout goes to /dev/null meanwhile.
+// on a machine with fewer cores the extra threads only take turns
+static void bench_independent(size_t n) {
+    par_opts_t opts = {0};
+    char *text = malloc(n * 32u);
+    size_t i, threads;
+    if (text == NULL) {
+        perror("Failed to allocate rows");
+        exit(EXIT_FAILURE);
+    }
+    fp_check = FP_OFF;
+    for (threads = 1u; threads <= 8u; threads *= 2u) {
+        for (i = 0u; i < n; i++) {
+            char *row = text + 32u * i;
+            snprintf(row, 32u, "%zu c * 3 * 2 +", i % 1000u);
+            par_line(row, i + 1u);
+        }
+        fflush(stdout);
+        int saved = dup(1);
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, 1);
+        double t = now();
+        par_run(threads, &opts);
+        double secs = now() - t;
+        dup2(saved, 1);
+        close(devnull);
+        close(saved);
+        char name[32];
+        snprintf(name, sizeof(name), "rows %zu threads", threads);
+        report(name, n, secs);
+        printf("%32s %.0f rows/s\n", "", n / secs);
+    }
+    free(text);
+    fp_check = FP_CMD;
+}
+
+// ___ ctx: many calculators on threads ________________________________________
+
+// each thread runs 64 contexts in turn, each with its own word f, "k +" for
+// the kth. a line that came out as another context's would count as bad
+#define BENCH_CTXS 64u
+
+typedef struct {
+    size_t n;
+    size_t bad;
+} ctx_job_t;
+
+static void *ctx_thread(void *arg) {
+    ctx_job_t *job = arg;
+    rpn_ctx_t *ctxs[BENCH_CTXS];
+    char def[32];
+    size_t i, k;
+    for (k = 0u; k < BENCH_CTXS; k++) {
+        ctxs[k] = ctx_create();
+        snprintf(def, sizeof(def), ": f %zu + ; 0", k);
+        ctx_eval(ctxs[k], def);
+    }
+    for (i = 0u; i < job->n; i++) {
+        rpn_ctx_t *ctx = ctxs[i % BENCH_CTXS];
+        ctx_eval(ctx, "d 100 f");
+        RPN_T num = RPN_ZERO;
+        ctx_peek(ctx, 0u, &num);
+        job->bad += num != 100 + (RPN_T)(i % BENCH_CTXS);
+        if (i % 1024u == 0u) {
+            ctx_clear(ctx);
+        }
+    }
+    for (k = 0u; k < BENCH_CTXS; k++) {
+        ctx_destroy(ctxs[k]);
+    }
+    return NULL;
+}
+
+static void bench_ctx(size_t n) {
+    size_t threads, t;
+    for (threads = 1u; threads <= 4u; threads *= 4u) {
+        pthread_t tids[4];
+        ctx_job_t jobs[4];
+        size_t bad = 0u;
+        double t0 = now();
+        for (t = 0u; t < threads; t++) {
+            jobs[t].n = n / threads;
+            jobs[t].bad = 0u;
+            pthread_create(&tids[t], NULL, ctx_thread, &jobs[t]);
+        }
+        for (t = 0u; t < threads; t++) {
+            pthread_join(tids[t], NULL);
+            bad += jobs[t].bad;
+        }
+        double secs = now() - t0;
+        char name[40];
+        snprintf(name, sizeof(name), "ctx_eval %zu x %u ctxs", threads,
+                 BENCH_CTXS);
+        report(name, n, secs);
+        printf("%32s %.0f lines/s, %zu bad\n", "", n / secs, bad);
+    }
+}
+
+// ___ lib: librpn calls against fork and exec of ./rpn _____________________
+
+// one calculation the way a service does it now: ./rpn "..." in a child,
+// its stdout read and parsed. popen() forks a sh for it too, spawn.h would
+// bring signal.h's stack_t. NAN if ./rpn isn't there
+static RPN_T popen_rpn(const char *line) {
+    char cmd[256], buf[256];
+    if (access("./rpn", X_OK) < 0) {
+        return NAN;
+    }
+    snprintf(cmd, sizeof(cmd), "./rpn '%s'", line);
+    FILE *child = popen(cmd, "r");
+    if (child == NULL) {
+        return NAN;
+    }
+    RPN_T num = NAN;
+    if (fgets(buf, sizeof(buf), child)) {
+        num = num_parse(buf, NULL);
+    }
+    pclose(child);
+    return num;
+}
+
+// the same calculation with ctx_run() and ctx_pop(), the number comes back
+// as an RPN_T. ctx_forget() now and then, the history would grow
+static void bench_lib(size_t n) {
+    const char *line = "1.5 2 * 3 +";
+    size_t len = strlen(line), i, nchild = n / 2000u ? n / 2000u : 1u;
+    rpn_ctx_t *ctx = ctx_create();
+    RPN_T num = RPN_ZERO;
+    double t = now();
+    for (i = 0u; i < n; i++) {
+        ctx_run(ctx, line, len);
+        ctx_pop(ctx, &num);
+        if (i % 1024u == 0u) {
+            ctx_forget(ctx);
+        }
+    }
+    double secs = now() - t;
+    sink = num;
+    ctx_destroy(ctx);
+    report("ctx_run ctx_pop", n, secs);
+    printf("%32s %.0f calls/s\n", "", n / secs);
+    t = now();
+    for (i = 0u; i < nchild; i++) {
+        num = popen_rpn(line);
+    }
+    double child_secs = now() - t;
+    if (num != num) {
+        printf("%-32s no ./rpn here\n", "popen ./rpn");
+        return;
+    }
+    report("popen ./rpn", nchild, child_secs);
+    printf("%32s %.0f calls/s, %.0f x slower\n", "", nchild / child_secs,
+           (child_secs / nchild) / (secs / n));
+}
+
+// ___ stack: push, pop, peek and roll at depths ______________________________
+
+// n of each on a stack depth deep. a push pop is 2 ops, peek reads where
+// a random walk lands, so the deep ones miss the cache
+static void bench_stack(size_t n) {
+    static const size_t depths[] = {16u, 1024u, 65536u, 1048576u};
+    char name[64];
+    size_t d, i;
+    for (d = 0u; d < sizeof(depths) / sizeof(depths[0]); d++) {
+        size_t depth = depths[d], k = 0u;
+        stack_t *stk = stack_create(sizeof(RPN_T));
+        for (i = 0u; i < depth; i++) {
+            num_push((RPN_T)i, stk);
+        }
+        size_t a = allocs();
+        double t = now();
+        for (i = 0u; i < n; i++) {
+            num_push(RPN_ONE, stk);
+            sink = num_pop(stk);
+        }
+        snprintf(name, sizeof(name), "push pop at %zu", depth);
+        report_allocs(name, 2u * n, now() - t, allocs() - a);
+        t = now();
+        for (i = 0u; i < n; i++) { // depth is a power of 2
+            k = (k * 1664525u + 1013904223u) & (depth - 1u);
+            sink = num_peek(k, stk);
+        }
+        snprintf(name, sizeof(name), "peek at %zu", depth);
+        report(name, n, now() - t);
+        t = now();
+        for (i = 0u; i < n; i++) {
+            stack_roll(i < n / 2u ? 1 : -1, stk);
+        }
+        snprintf(name, sizeof(name), "roll at %zu", depth);
+        report(name, n, now() - t);
+        stack_destroy(stk);
+    }
+}
+
+// ___ core: tokenize(), vet_do() and undo() a call at a time ________________
+
+// the tokens of the lex bench, already cut out of the line. vet_do() keeps
+// the history as a line would, undo() takes it back a step at a time
+static void bench_core(size_t n) {
+    static const char *toks[] = {
+        "1.8", "*", "32", "+", "r", "c", "s", "-40", "0x.b", "~", "i", "_",
+        "12345.678", "^", "v", "d", "e", "l", "1e10", "/",
+    };
+    size_t ntoks = sizeof(toks) / sizeof(toks[0]);
+    size_t i, nvalid = 0u;
+    RPN_T num = RPN_ZERO;
+    double t = now();
+    for (i = 0u; i < 10u * n; i++) {
+        nvalid += tokenize(toks[i % ntoks], &num) < JUNK;
+    }
+    report("tokenize", 10u * n, now() - t);
+    sink = num + (RPN_T)nvalid;
+
+    stack_t *stks[3];
+    int hist_flag = 0;
+    token_t last_msg = JUNK;
+    p_printmsg = donot_printmsg;
+    p_printmsg_fresh = donot_printmsg_fresh;
+    make_stacks(stks);
+    size_t a = allocs();
+    t = now();
+    for (i = 0u; i < n; i++) {
+        vet_do(&hist_flag, &last_msg, (RPN_T)i, NUM, stks);
+        vet_do(&hist_flag, &last_msg, RPN_ZERO, ADD, stks);
+    }
+    report_allocs("vet_do", 2u * n, now() - t, allocs() - a);
+    a = allocs();
+    t = now();
+    for (i = 0u; i < 2u * n; i++) {
+        undo(1u, &last_msg, stks);
+    }
+    report_allocs("undo a step", 2u * n, now() - t, allocs() - a);
+    sink = num_top(stks[I_STK]);
+    free_stacks(stks);
+}
+
+// ___ workload: the README's examples, the way batch mode runs them _________
+
+// each line compiled once and run with its history, the stack printed
+// after it to /dev/null. fibonacci is "1 1" and then "c r +" lines, it
+// starts over before the numbers overflow. fahrenheit is the 4 numbers
+// converted and dropped again, 24 ops a line. handle_input() is the path
+// of an interactive line, without the display
+static void workload(const char *name, size_t nlines, int interactive,
+                     const char *line, size_t line_ops,
+                     const char *every, size_t every_ops, size_t period)
+{
+    stack_t *stks[3];
+    int hist_flag = 0;
+    token_t last_msg = JUNK;
+    size_t i, ops = 0u;
+    stks[I_STK ] = stack_create(sizeof(RPN_T)); // empty, as ./rpn starts
+    stks[H_NUMS] = stack_create(sizeof(RPN_T));
+    stks[H_CMDS] = stack_create(sizeof(token_t));
+    fflush(stdout);
+    int saved = dup(1);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, 1);
+    size_t a = allocs();
+    double t = now();
+    for (i = 0u; i < nlines; i++) {
+        const char *text = every && i % period == 0u ? every : line;
+        if (interactive) {
+            handle_input(&hist_flag, &last_msg, text, stks);
+        } else {
+            prog_run_line(prog_cached(text), i + 1u, &hist_flag, &last_msg,
+                          stks);
+        }
+        dump_stack(stks[I_STK]);
+        ops += text == line ? line_ops : every_ops;
+    }
+    fflush(stdout);
+    double secs = now() - t;
+    size_t nallocs = allocs() - a;
+    dup2(saved, 1);
+    close(devnull);
+    close(saved);
+    report_allocs(name, ops, secs, nallocs);
+    free_stacks(stks);
+}
+
+static void bench_workload(size_t n) {
+    const char *fahrenheit = "-40 0 37.8 100 1.8 * 32 + r 1.8 * 32 + r "
+                             "1.8 * 32 + r 1.8 * 32 + r d d d d";
+    p_printmsg = donot_printmsg;
+    p_printmsg_fresh = donot_printmsg_fresh;
+    fp_check = FP_OFF;
+    workload("fibonacci batch", n, 0, "c r +", 3u, "d d 1 1", 4u, 100u);
+    workload("fahrenheit batch", n / 8u, 0, fahrenheit, 24u, NULL, 0u, 1u);
+    fp_check = FP_CMD;
+    workload("fibonacci interactive", n, 1, "c r +", 3u, "d d 1 1", 4u, 100u);
+    workload("fahrenheit interactive", n / 8u, 1, fahrenheit, 24u, NULL, 0u,
+             1u);
+    prog_cache_clear();
+}
+
+// ___ main ____________________________________________________________________
+
+static struct bench {
+    const char *name;
+    void (*run)(size_t n);
+    size_t n;
+} benches[] = {
+    {"typed", bench_typed, 10000000u},
+    {"reserve", bench_reserve, 10000000u},
+    {"roll", bench_roll, 10000000u},
+    {"history", bench_history, 2000000u},
+    {"undo", bench_undo, 100000u},
+    {"lex", bench_lex, 10000000u},
+    {"prog", bench_prog, 200000u},
+    {"num", bench_num, 4000000u},
+    {"dump", bench_dump, 10000000u},
+    {"backend", bench_backend, 2000000u},
+    {"vec", bench_vec, 1000000u},
+    {"big", bench_big, 2000000u},
+    {"jit", bench_jit, 10000000u},
+    {"word", bench_word, 2000000u},
+    {"independent", bench_independent, 1000000u},
+    {"ctx", bench_ctx, 2000000u},
+    {"lib", bench_lib, 2000000u},
+    {"stack", bench_stack, 10000000u},
+    {"core", bench_core, 1000000u},
+    {"workload", bench_workload, 1000000u},
+};
+
+int main(int argc, char *argv[]) {
+    size_t nbenches = sizeof(benches) / sizeof(benches[0]);
+    size_t b;
+    int i, nnames = 0;
+    for (i = 1; i < argc; i++) { // -o and -c out of the names
+        if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "-c"))
+            && i + 1 < argc) {
+            if (argv[i][1] == 'o') {
+                results = fopen(argv[i + 1], "w");
+                if (results == NULL) {
+                    perror(argv[i + 1]);
+                    return 1;
+                }
+                fprintf(results, "# bench\tname\tops\tns/op\tops/s\tallocs"
+                        "\t%s\n", RPN_NAME);
+            } else if (!read_old(argv[i + 1])) {
+                perror(argv[i + 1]);
+                return 1;
+            }
+            argv[i] = argv[i + 1] = NULL;
+            i++;
+        } else {
+            nnames++;
+        }
+    }
+    // a name that isn't a bench fails the run, make bench keeps the last
+    // results then instead of an empty one
+    for (i = 1; i < argc; i++) {
+        for (b = 0u; argv[i] && b < nbenches
+                     && strcmp(argv[i], benches[b].name); b++) {
+        }
+        if (argv[i] && b == nbenches) {
+            fprintf(stderr, "%s: no such bench\n", argv[i]);
+            return 1;
+        }
+    }
+    for (b = 0u; b < nbenches; b++) {
+        int selected = (nnames == 0);
+        for (i = 1; i < argc; i++) {
+            selected |= argv[i] && !strcmp(argv[i], benches[b].name);
+        }
+        if (selected) {
+            bench_name = benches[b].name;
+            benches[b].run(benches[b].n);
+            if (results) {
+                fflush(results);
+            }
+        }
+    }
+    if (results && fclose(results)) {
+        perror("rpn_bench");
+        return 1;
+    }
+    free(old_results);
+    return 0;
+}
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>     // strtoul(), calloc(), qsort(), mkstemp()
+#include <string.h>     // strlen(), memchr()
+#include <errno.h>
+#include <fcntl.h>      // fcntl()
+#include <unistd.h>     // read(), write(), close(), unlink()
+#include <time.h>       // clock_gettime()
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>     // sockaddr_un
+#include <sys/resource.h> // setrlimit()
+
+// rpn_load.c
+// a load generator for ./rpn --serve
+// ./rpn_load /tmp/rpn.sock 2000 100
+// opens 2000 sessions at once, each sends 100 lines one after another,
+// a line when the answer to the last one is in. prints the requests a
+// second and the percentiles of the time from a line to its answer.
+// one thread, so that's the server's time and the socket's, not the
+// client's. the answers are checked. before the load one session sends
+// <file with a file of ours, the server must not read it
+
+typedef struct {
+    int fd;
+    size_t done;            // answered lines
+    double sent;            // when the one waiting went out
+    char in[256];
+    size_t inlen;
+} load_session_t;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// the k-th line of session i, and what the stack is after it
+static int request(char *buf, size_t size, size_t i, size_t k, long *expect) {
+    long n = (long)(i % 1000u), m = (long)(k % 7u);
+    *expect = n * 3 + m;
+    return snprintf(buf, size, "d %ld 3 * %ld +\n", n, m);
+}
+
+static int send_request(load_session_t *s, size_t i) {
+    char buf[64];
+    long expect;
+    int len = request(buf, sizeof(buf), i, s->done, &expect);
+    s->sent = now();
+    return send(s->fd, buf, len, MSG_NOSIGNAL) == len;
+}
+
+// 1 if "1 <file" gets more than the 1 back, or no answer
+static int reads_files(const struct sockaddr_un *addr) {
+    char path[] = "/tmp/rpn_load.XXXXXX";
+    int tmp = mkstemp(path);
+    if (tmp < 0 || write(tmp, "3.14 2.71 42\n", 13u) != 13) {
+        perror("rpn_load");
+        return 1;
+    }
+    close(tmp);
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf), "1 <%s\n", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    size_t got = 0u;
+    if (fd >= 0 && connect(fd, (const struct sockaddr *)addr,
+                           sizeof(*addr)) == 0
+        && send(fd, buf, len, MSG_NOSIGNAL) == len)
+    {
+        ssize_t n;
+        while (got + 1u < sizeof(buf) && memchr(buf, '\n', got) == NULL
+               && (n = read(fd, buf + got, sizeof(buf) - 1u - got)) > 0) {
+            got += (size_t)n;
+        }
+    }
+    buf[got] = '\0';
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlink(path);
+    char *nl = strchr(buf, '\n');
+    if (nl == NULL || strncmp(buf, "1 \n", 3u) != 0) {
+        fprintf(stderr, "rpn_load: \"1 <%s\" got \"%.*s\", the server "
+                "reads files\n", path, nl ? (int)(nl - buf) : (int)got, buf);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s socket [sessions [requests]]\n", argv[0]);
+        return 1;
+    }
+    size_t nsessions = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000u;
+    size_t nrequests = argc > 3 ? strtoul(argv[3], NULL, 0) : 100u;
+    if (nsessions == 0u || nrequests == 0u) {
+        return 0;
+    }
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", argv[1]);
+    if (reads_files(&addr)) {
+        return 1;
+    }
+
+    load_session_t *sessions = calloc(nsessions, sizeof(*sessions));
+    double *lat = malloc(nsessions * nrequests * sizeof(double));
+    int epfd = epoll_create1(0);
+    if (sessions == NULL || lat == NULL || epfd < 0) {
+        perror("rpn_load");
+        return 1;
+    }
+    size_t i, nlat = 0u, bad = 0u, open = 0u;
+    for (i = 0u; i < nsessions; i++) { // blocking connects, then nonblocking
+        load_session_t *s = &sessions[i];
+        s->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s->fd < 0
+            || connect(s->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            perror(argv[1]);
+            return 1;
+        }
+        fcntl(s->fd, F_SETFL, fcntl(s->fd, F_GETFL) | O_NONBLOCK);
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev);
+    }
+    double start = now();
+    for (i = 0u; i < nsessions; i++) {
+        if (!send_request(&sessions[i], i)) {
+            perror("send");
+            return 1;
+        }
+        open++;
+    }
+    struct epoll_event evs[256];
+    while (open) {
+        int n = epoll_wait(epfd, evs, 256, 10000);
+        if (n == 0) {
+            fprintf(stderr, "rpn_load: no answer in 10 s, %zu sessions "
+                    "waiting\n", open);
+            return 1;
+        }
+        int e;
+        for (e = 0; e < n; e++) {
+            size_t si = evs[e].data.u64;
+            load_session_t *s = &sessions[si];
+            ssize_t len = read(s->fd, s->in + s->inlen,
+                               sizeof(s->in) - 1u - s->inlen);
+            if (len < 0 && (errno == EAGAIN || errno == EINTR)) {
+                continue;
+            }
+            if (len <= 0) {
+                fprintf(stderr, "rpn_load: session %zu closed\n", si);
+                return 1;
+            }
+            s->inlen += (size_t)len;
+            char *nl = memchr(s->in, '\n', s->inlen);
+            if (nl == NULL) {
+                continue;
+            }
+            lat[nlat++] = now() - s->sent;
+            char buf[64];
+            long expect;
+            request(buf, sizeof(buf), si, s->done, &expect);
+            *nl = '\0';
+            if (strtol(s->in, NULL, 10) != expect) {
+                bad++;
+            }
+            s->inlen = 0u; // one answer to a line
+            if (++s->done == nrequests) {
+                close(s->fd); // epoll drops it
+                open--;
+            } else if (!send_request(s, si)) {
+                perror("send");
+                return 1;
+            }
+        }
+    }
+    double secs = now() - start;
+    qsort(lat, nlat, sizeof(double), cmp_double);
+    printf("%zu sessions, %zu requests, %.2f s, %.0f requests/s\n",
+           nsessions, nlat, secs, nlat / secs);
+    static const double ps[] = {50.0, 90.0, 99.0, 99.9};
+    size_t p;
+    for (p = 0u; p < sizeof(ps) / sizeof(ps[0]); p++) {
+        size_t k = (size_t)(ps[p] / 100.0 * (nlat - 1u) + 0.5);
+        printf("p%-5g %10.1f us\n", ps[p], lat[k] * 1e6);
+    }
+    printf("max    %10.1f us\n", lat[nlat - 1u] * 1e6);
+    if (bad) {
+        printf("%zu wrong answers\n", bad);
+    }
+    free(lat);
+    free(sessions);
+    return bad != 0u;
+}
@@ -0,0 +1,1013 @@
+#include <stdlib.h>     // malloc(), free()
+#include <string.h>     // memcpy(), memset(), memmove()
+#include <stdint.h>     // uint32_t, uint64_t
+#include <math.h>       // log(), exp(), NAN, INFINITY
+#include <fenv.h>       // feraiseexcept(), fegetexceptflag()
+#include "rpnstack.h"   // stack_error()
+#include "rpnfunctions.h"
+#include "rpnnum.h"     // num_format_shortest(), num_parse()
+#include "rpnvec.h"     // box_new()
+#include "rpnbig.h"
+
+// rpnbig.c
+// arbitrary precision decimal numbers
+
+/* ___ comments ________________________________________________________________
+
+a number is limbs of 9 decimal digits, little endian, times 10^9^exp.
+decimal limbs, so 0.1 is exact and printing is just the digits.
+the precision is in limbs, one more than the digits need: a guard limb.
+every result is rounded to it, half up.
+
+* is schoolbook up to KARATSUBA_MIN limbs, karatsuba above it.
+/ multiplies by the reciprocal, newton's x + x (1 - b x), doubling the
+precision each step, starting from a double. v with a whole number n is
+newton's y = ((n - 1) y + x / y^(n - 1)) / n, ^ with a whole number is
+squaring. the others are e^(y l(x)).
+e halves x until it's tiny, sums the taylor series and squares it back.
+l is halley's y + 2 (x - e^y) / (x + e^y), tripling the digits a step.
+
+a plain RPN_T becomes a big through its shortest digits, "0.1" and not
+0.1000000000000000000013552527156068805425. inf and nan stay RPN_T,
+an operator with one of them works on RPN_T.
+a result with no number, 0 i, is an RPN_T inf or nan and raises the flag
+math_error() looks for. the double math on the way raises nothing
+*/
+
+#define BIG_BASE 1000000000u
+#define BIG_DIG 9
+#define BIG_MAX_DIGITS 1000000u
+#define KARATSUBA_MIN 32u   // limbs
+#define LN_BASE 20.723265836946411 // l(10^9)
+
+typedef struct {
+    int neg;
+    long exp;       // the value is d times BIG_BASE^exp
+    size_t n;       // 0 is zero
+    uint32_t *d;    // d[0] and d[n - 1] aren't 0
+} bn_t;
+
+// what a handle holds
+typedef struct {
+    size_t digits;  // the precision it was made with
+    int neg;
+    long exp;
+    size_t n;
+    uint32_t d[];
+} big_t;
+
+static RPN_LOCAL size_t digits = 0u;
+
+// ___ helper functions ________________________________________________________
+
+static void *big_alloc(size_t bytes) {
+    void *p = malloc(bytes ? bytes : 1u);
+    if (p == NULL) {
+        stack_error("Failed to make a big number");
+    }
+    return p;
+}
+
+static size_t limbs_for(size_t ndigits) {
+    return (ndigits + BIG_DIG - 1u) / BIG_DIG + 1u;
+}
+
+static void bn_free(bn_t *x) {
+    free(x->d);
+    x->d = NULL;
+    x->n = 0u;
+}
+
+// x gets d, n limbs of it. after the caller is done reading the old x
+static void bn_take(bn_t *x, uint32_t *d, size_t n, long exp, int neg) {
+    free(x->d);
+    x->d = d;
+    x->n = n;
+    x->exp = exp;
+    x->neg = neg;
+}
+
+static void bn_copy(bn_t *r, const bn_t *a) {
+    if (r == a) { return; }
+    uint32_t *d = big_alloc(a->n * sizeof(*d));
+    if (a->n) { // zero has no limbs, maybe no d
+        memcpy(d, a->d, a->n * sizeof(*d));
+    }
+    bn_take(r, d, a->n, a->exp, a->neg);
+}
+
+// no zero limbs at the ends, at most prec limbs, rounded half up
+static void bn_round(bn_t *x, size_t prec) {
+    size_t lo = 0u, n = x->n;
+    while (n && x->d[n - 1u] == 0u) {
+        n--;
+    }
+    if (n > prec) {
+        lo = n - prec;
+        if (x->d[lo - 1u] >= BIG_BASE / 2u) {
+            size_t i = lo;
+            while (i < n && ++x->d[i] == BIG_BASE) {
+                x->d[i++] = 0u;
+            }
+            if (i == n) { // 999... carried out of the top
+                uint32_t *d = realloc(x->d, (n + 1u) * sizeof(*d));
+                if (d == NULL) {
+                    stack_error("Failed to make a big number");
+                }
+                x->d = d;
+                x->d[n++] = 1u;
+            }
+        }
+    }
+    while (lo < n && x->d[lo] == 0u) {
+        lo++;
+    }
+    if (lo == n) {
+        x->n = 0u;
+        x->exp = 0;
+        x->neg = 0;
+        return;
+    }
+    memmove(x->d, x->d + lo, (n - lo) * sizeof(*x->d));
+    x->n = n - lo;
+    x->exp += (long)lo;
+}
+
+static void bn_set_u64(bn_t *r, uint64_t v) {
+    uint32_t *d = big_alloc(3u * sizeof(*d));
+    size_t n = 0u;
+    while (v) {
+        d[n++] = v % BIG_BASE;
+        v /= BIG_BASE;
+    }
+    bn_take(r, d, n, 0, 0);
+    bn_round(r, 3u);
+}
+
+static void bn_from_double(bn_t *r, double x) {
+    int neg = x < 0.0;
+    long k = 0;
+    if (neg) {
+        x = -x;
+    }
+    if (x == 0.0) {
+        bn_take(r, NULL, 0u, 0, 0);
+        return;
+    }
+    while (x >= BIG_BASE) {
+        x /= BIG_BASE;
+        k++;
+    }
+    while (x < 1.0) {
+        x *= BIG_BASE;
+        k--;
+    }
+    bn_set_u64(r, (uint64_t)(x * 1e9)); // 10 to 18 digits
+    r->exp += k - 1;
+    r->neg = neg;
+}
+
+// |a| is about m BIG_BASE^e, m from 1 up to BIG_BASE
+static void bn_approx(const bn_t *a, double *m, long *e) {
+    size_t n = a->n;
+    *m = a->d[n - 1u];
+    if (n > 1u) {
+        *m += a->d[n - 2u] / 1e9;
+    }
+    if (n > 2u) {
+        *m += a->d[n - 3u] / 1e18;
+    }
+    *e = a->exp + (long)n - 1;
+}
+
+// ___ limbs ___________________________________________________________________
+
+// r[0 .. an + bn) = a b
+static void mul_school(uint32_t *r, const uint32_t *a, size_t an,
+                       const uint32_t *b, size_t bn)
+{
+    size_t i, j;
+    memset(r, 0, (an + bn) * sizeof(*r));
+    for (i = 0u; i < an; i++) {
+        uint64_t carry = 0u, ai = a[i];
+        for (j = 0u; j < bn; j++) {
+            uint64_t t = ai * b[j] + r[i + j] + carry;
+            r[i + j] = t % BIG_BASE;
+            carry = t / BIG_BASE;
+        }
+        r[i + bn] = carry;
+    }
+}
+
+// r += a, the carry goes on up to rn
+static void add_into(uint32_t *r, size_t rn, const uint32_t *a, size_t an) {
+    uint32_t carry = 0u;
+    size_t i;
+    for (i = 0u; i < an; i++) {
+        uint32_t t = r[i] + a[i] + carry;
+        carry = t >= BIG_BASE;
+        r[i] = carry ? t - BIG_BASE : t;
+    }
+    for (; carry && i < rn; i++) {
+        carry = ++r[i] == BIG_BASE;
+        if (carry) {
+            r[i] = 0u;
+        }
+    }
+}
+
+// r -= a, r >= a
+static void sub_into(uint32_t *r, size_t rn, const uint32_t *a, size_t an) {
+    uint32_t borrow = 0u;
+    size_t i;
+    for (i = 0u; i < an; i++) {
+        uint32_t s = a[i] + borrow;
+        borrow = r[i] < s;
+        r[i] = borrow ? r[i] + BIG_BASE - s : r[i] - s;
+    }
+    for (; borrow && i < rn; i++) {
+        borrow = r[i] == 0u;
+        r[i] = borrow ? BIG_BASE - 1u : r[i] - 1u;
+    }
+}
+
+static int cmp_limbs(const uint32_t *a, const uint32_t *b, size_t n) {
+    while (n--) {
+        if (a[n] != b[n]) {
+            return a[n] < b[n] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// r[0 .. an + bn) = a b. karatsuba: (a1 B^m + a0)(b1 B^m + b0) is
+// a1 b1 B^2m + ((a0 + a1)(b0 + b1) - a0 b0 - a1 b1) B^m + a0 b0
+static void mul_limbs(uint32_t *r, const uint32_t *a, size_t an,
+                      const uint32_t *b, size_t bn)
+{
+    if (an < bn) {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        size_t tn = an;
+        an = bn;
+        bn = tn;
+    }
+    if (bn < KARATSUBA_MIN) {
+        mul_school(r, a, an, b, bn);
+        return;
+    }
+    if (an >= 2u * bn) { // lopsided, bn limbs of a at a time
+        uint32_t *t = big_alloc(2u * bn * sizeof(*t));
+        size_t off;
+        memset(r, 0, (an + bn) * sizeof(*r));
+        for (off = 0u; off < an; off += bn) {
+            size_t len = an - off < bn ? an - off : bn;
+            mul_limbs(t, a + off, len, b, bn);
+            add_into(r + off, an + bn - off, t, len + bn);
+        }
+        free(t);
+        return;
+    }
+    size_t m = an / 2u; // bn > m
+    size_t a1n = an - m, b1n = bn - m, sn = a1n + 1u;
+    uint32_t *sa = calloc(sn, sizeof(*sa));
+    uint32_t *sb = calloc(sn, sizeof(*sb));
+    uint32_t *z1 = malloc(2u * sn * sizeof(*z1));
+    if (sa == NULL || sb == NULL || z1 == NULL) {
+        stack_error("Failed to make a big number");
+    }
+    memcpy(sa, a + m, a1n * sizeof(*sa));
+    add_into(sa, sn, a, m);
+    memcpy(sb, b + m, b1n * sizeof(*sb));
+    add_into(sb, sn, b, m);
+    mul_limbs(z1, sa, sn, sb, sn);
+    mul_limbs(r, a, m, b, m);                           // a0 b0
+    mul_limbs(r + 2u * m, a + m, a1n, b + m, b1n);      // a1 b1
+    sub_into(z1, 2u * sn, r, 2u * m);
+    sub_into(z1, 2u * sn, r + 2u * m, a1n + b1n);
+    size_t zn = 2u * sn;
+    while (zn && z1[zn - 1u] == 0u) {
+        zn--;
+    }
+    add_into(r + m, an + bn - m, z1, zn);
+    free(sa);
+    free(sb);
+    free(z1);
+}
+
+// ___ arithmetic ______________________________________________________________
+
+// r = a + b, or a - b
+static void bn_add(bn_t *r, const bn_t *a, const bn_t *b, int sub,
+                   size_t prec)
+{
+    int bneg = b->neg ^ sub;
+    if (b->n == 0u) {
+        bn_copy(r, a);
+        bn_round(r, prec);
+        return;
+    }
+    if (a->n == 0u) {
+        bn_copy(r, b);
+        r->neg = bneg;
+        bn_round(r, prec);
+        return;
+    }
+    long atop = a->exp + (long)a->n, btop = b->exp + (long)b->n;
+    long top = atop > btop ? atop : btop;
+    long lo = a->exp < b->exp ? a->exp : b->exp;
+    if (lo < top - (long)prec - 2) { // lower limbs don't make it
+        lo = top - (long)prec - 2;
+    }
+    size_t len = (size_t)(top - lo) + 1u, i;
+    uint32_t *x = calloc(len, sizeof(*x));
+    uint32_t *y = calloc(len, sizeof(*y));
+    if (x == NULL || y == NULL) {
+        stack_error("Failed to make a big number");
+    }
+    for (i = 0u; i < a->n; i++) {
+        if (a->exp + (long)i >= lo) {
+            x[a->exp + (long)i - lo] = a->d[i];
+        }
+    }
+    for (i = 0u; i < b->n; i++) {
+        if (b->exp + (long)i >= lo) {
+            y[b->exp + (long)i - lo] = b->d[i];
+        }
+    }
+    int neg = a->neg;
+    if (a->neg == bneg) {
+        add_into(x, len, y, len);
+    } else if (cmp_limbs(x, y, len) >= 0) {
+        sub_into(x, len, y, len);
+    } else {
+        sub_into(y, len, x, len);
+        uint32_t *t = x;
+        x = y;
+        y = t;
+        neg = bneg;
+    }
+    free(y);
+    bn_take(r, x, len, lo, neg);
+    bn_round(r, prec);
+}
+
+// r = a b. only the top prec + 1 limbs of each count
+static void bn_mul(bn_t *r, const bn_t *a, const bn_t *b, size_t prec) {
+    if (a->n == 0u || b->n == 0u) {
+        bn_take(r, NULL, 0u, 0, 0);
+        return;
+    }
+    const uint32_t *ad = a->d, *bd = b->d;
+    size_t an = a->n, bn = b->n;
+    long exp = a->exp + b->exp;
+    if (an > prec + 1u) {
+        ad += an - prec - 1u;
+        exp += (long)(an - prec - 1u);
+        an = prec + 1u;
+    }
+    if (bn > prec + 1u) {
+        bd += bn - prec - 1u;
+        exp += (long)(bn - prec - 1u);
+        bn = prec + 1u;
+    }
+    uint32_t *d = big_alloc((an + bn) * sizeof(*d));
+    mul_limbs(d, ad, an, bd, bn);
+    bn_take(r, d, an + bn, exp, a->neg ^ b->neg);
+    bn_round(r, prec);
+}
+
+// r = a / m, m < BIG_BASE
+static void bn_div_small(bn_t *r, const bn_t *a, uint32_t m, size_t prec) {
+    if (a->n == 0u) {
+        bn_take(r, NULL, 0u, 0, 0);
+        return;
+    }
+    size_t n = prec + 1u, k;
+    uint32_t *q = big_alloc(n * sizeof(*q));
+    uint64_t rem = 0u;
+    for (k = 0u; k < n; k++) {
+        uint64_t cur = rem * BIG_BASE + (k < a->n ? a->d[a->n - 1u - k] : 0u);
+        q[n - 1u - k] = (uint32_t)(cur / m);
+        rem = cur % m;
+    }
+    bn_take(r, q, n, a->exp + (long)a->n - (long)n, a->neg);
+    bn_round(r, prec);
+}
+
+// r = 1 / b, b isn't 0. good is how many limbs are right so far
+static void bn_recip(bn_t *r, const bn_t *b, size_t prec) {
+    bn_t y = {0}, t = {0}, one = {0};
+    double m;
+    long e;
+    bn_approx(b, &m, &e);
+    bn_from_double(&y, 1.0 / m);
+    y.exp -= e;
+    y.neg = b->neg;
+    bn_set_u64(&one, 1u);
+    size_t good = 1u;
+    int last = 0;
+    while (!last) {
+        last = (good == prec + 1u);
+        good = 2u * good < prec + 1u ? 2u * good : prec + 1u;
+        bn_mul(&t, b, &y, good + 2u);
+        bn_add(&t, &one, &t, 1, good + 2u);
+        bn_mul(&t, &y, &t, good + 2u);
+        bn_add(&y, &y, &t, 0, good + 2u);
+    }
+    bn_round(&y, prec);
+    bn_take(r, y.d, y.n, y.exp, y.neg);
+    bn_free(&t);
+    bn_free(&one);
+}
+
+static void bn_div(bn_t *r, const bn_t *a, const bn_t *b, size_t prec) {
+    bn_t t = {0};
+    bn_recip(&t, b, prec + 1u);
+    bn_mul(r, a, &t, prec);
+    bn_free(&t);
+}
+
+// r = a^n
+static void bn_ipow(bn_t *r, const bn_t *a, uint64_t n, size_t prec) {
+    bn_t base = {0}, acc = {0};
+    size_t p = prec + 2u;
+    bn_copy(&base, a);
+    bn_set_u64(&acc, 1u);
+    while (n) {
+        if (n & 1u) {
+            bn_mul(&acc, &acc, &base, p);
+        }
+        n >>= 1;
+        if (n) {
+            bn_mul(&base, &base, &base, p);
+        }
+    }
+    bn_round(&acc, prec);
+    bn_take(r, acc.d, acc.n, acc.exp, acc.neg);
+    bn_free(&base);
+}
+
+// r = x^(1/n), x > 0, 1 < n < BIG_BASE
+static void bn_root(bn_t *r, const bn_t *x, uint32_t n, size_t prec) {
+    bn_t y = {0}, t = {0}, u = {0}, nm1 = {0};
+    double m;
+    long e;
+    bn_approx(x, &m, &e);
+    double l = (log(m) + e * LN_BASE) / n;
+    long ey = (long)floor(l / LN_BASE);
+    bn_from_double(&y, exp(l - ey * LN_BASE));
+    y.exp += ey;
+    bn_set_u64(&nm1, n - 1u);
+    size_t good = 1u;
+    int last = 0;
+    while (!last) {
+        last = (good == prec + 1u);
+        good = 2u * good < prec + 1u ? 2u * good : prec + 1u;
+        size_t p = good + 2u;
+        bn_ipow(&t, &y, n - 1u, p);
+        bn_div(&t, x, &t, p);
+        bn_mul(&u, &y, &nm1, p);
+        bn_add(&u, &u, &t, 0, p);
+        bn_div_small(&y, &u, n, p);
+    }
+    bn_round(&y, prec);
+    bn_take(r, y.d, y.n, y.exp, y.neg);
+    bn_free(&t);
+    bn_free(&u);
+    bn_free(&nm1);
+}
+
+// r = e^x. 1 if it would overflow, -1 underflow
+static int bn_exp(bn_t *r, const bn_t *x, size_t prec) {
+    if (x->n == 0u) {
+        bn_set_u64(r, 1u);
+        return 0;
+    }
+    double m;
+    long e;
+    bn_approx(x, &m, &e);
+    if (e >= 2) { // |x| >= 10^18, the exponent wouldn't fit
+        return x->neg ? -1 : 1;
+    }
+    double ax = e == 1 ? m * 1e9 : e == 0 ? m : 0.0;
+    int s = (int)sqrt(prec * 30.0) + (ax >= 1.0 ? ilogb(ax) + 1 : 0);
+    size_t p = prec + 2u + (size_t)s / 29u, i;
+    bn_t rr = {0}, term = {0}, sum = {0};
+    bn_copy(&rr, x);
+    int k;
+    for (k = s; k > 0; k -= 29) { // x / 2^s, 2^29 < BIG_BASE
+        bn_div_small(&rr, &rr, 1u << (k < 29 ? k : 29), p);
+    }
+    bn_set_u64(&sum, 1u);
+    bn_set_u64(&term, 1u);
+    for (i = 1u; ; i++) {
+        bn_mul(&term, &term, &rr, p);
+        bn_div_small(&term, &term, (uint32_t)i, p);
+        if (term.n == 0u || term.exp + (long)term.n < 1 - (long)p) {
+            break;
+        }
+        bn_add(&sum, &sum, &term, 0, p);
+    }
+    while (s-- > 0) {
+        bn_mul(&sum, &sum, &sum, p);
+    }
+    bn_round(&sum, prec);
+    bn_take(r, sum.d, sum.n, sum.exp, sum.neg);
+    bn_free(&rr);
+    bn_free(&term);
+    return 0;
+}
+
+// r = l(x), x > 0
+static void bn_log(bn_t *r, const bn_t *x, size_t prec) {
+    bn_t y = {0}, ey = {0}, num = {0}, den = {0};
+    double m;
+    long e;
+    bn_approx(x, &m, &e);
+    bn_from_double(&y, log(m) + e * LN_BASE);
+    size_t good = 1u;
+    int last = 0;
+    while (!last) {
+        last = (good == prec + 1u);
+        good = 3u * good < prec + 1u ? 3u * good : prec + 1u;
+        size_t p = good + 2u;
+        bn_exp(&ey, &y, p);
+        bn_add(&num, x, &ey, 1, p);
+        bn_add(&den, x, &ey, 0, p);
+        bn_div(&num, &num, &den, p);
+        bn_add(&num, &num, &num, 0, p);
+        bn_add(&y, &y, &num, 0, p);
+    }
+    bn_round(&y, prec);
+    bn_take(r, y.d, y.n, y.exp, y.neg);
+    bn_free(&ey);
+    bn_free(&num);
+    bn_free(&den);
+}
+
+// a whole number that fits, into *np
+static int bn_whole(const bn_t *a, uint64_t *np) {
+    if (a->n == 0u) {
+        *np = 0u;
+        return 1;
+    }
+    if (a->exp < 0 || a->exp + (long)a->n > 2) { // 10^18 and up
+        return 0;
+    }
+    uint64_t v = 0u;
+    size_t i;
+    for (i = a->n; i-- > 0u; ) {
+        v = v * BIG_BASE + a->d[i];
+    }
+    for (i = 0u; i < (size_t)a->exp; i++) {
+        v *= BIG_BASE;
+    }
+    *np = v;
+    return 1;
+}
+
+// r = a^b. JUNK, or the msg of a result that's no number
+static token_t bn_pow(bn_t *r, const bn_t *a, const bn_t *b, size_t prec,
+                      int *negp)
+{
+    uint64_t n;
+    double m;
+    long e;
+    if (b->n == 0u) {
+        bn_set_u64(r, 1u);
+        return JUNK;
+    }
+    if (a->n == 0u) {
+        bn_take(r, NULL, 0u, 0, 0);
+        return b->neg ? DBYZ : JUNK;
+    }
+    bn_approx(a, &m, &e);
+    double la = log(m) + e * LN_BASE; // l(|a|)
+    if (bn_whole(b, &n)) {
+        *negp = a->neg && (n & 1u);
+        if (fabs(la) * n > 1e17) {
+            return (la > 0.0) != b->neg ? OFLW : UFLW;
+        }
+        bn_ipow(r, a, n, prec + 1u);
+        if (b->neg) {
+            bn_recip(r, r, prec);
+        }
+        bn_round(r, prec);
+        return JUNK;
+    }
+    if (a->neg) {
+        return INAN;
+    }
+    bn_t t = {0};
+    bn_log(&t, a, prec + 2u);
+    bn_mul(&t, &t, b, prec + 2u);
+    int over = bn_exp(r, &t, prec);
+    bn_free(&t);
+    return over > 0 ? OFLW : over < 0 ? UFLW : JUNK;
+}
+
+// r = a^(1/b)
+static token_t bn_rootx(bn_t *r, const bn_t *a, const bn_t *b, size_t prec,
+                        int *negp)
+{
+    uint64_t n;
+    if (b->n == 0u) {
+        return INAN;
+    }
+    if (bn_whole(b, &n) && n < BIG_BASE) {
+        if (a->n == 0u) {
+            bn_take(r, NULL, 0u, 0, 0);
+            return b->neg ? DBYZ : JUNK;
+        }
+        if (a->neg && !(n & 1u)) {
+            return INAN;
+        }
+        int neg = a->neg;
+        bn_copy(r, a);
+        r->neg = 0;
+        if (n > 1u) {
+            bn_root(r, r, (uint32_t)n, prec + 1u);
+        }
+        r->neg = neg;
+        if (b->neg) {
+            bn_recip(r, r, prec);
+        }
+        bn_round(r, prec);
+        return JUNK;
+    }
+    bn_t inv = {0};
+    bn_recip(&inv, b, prec + 1u);
+    token_t err = bn_pow(r, a, &inv, prec, negp);
+    bn_free(&inv);
+    return err;
+}
+
+// ___ to and from text, handles _______________________________________________
+
+// [+-]digits[.digits][e[+-]digits] up to a blank, into r
+static int parse_str(bn_t *r, const char *str, size_t prec) {
+    const char *s = str, *ip, *fp = NULL;
+    size_t ilen = 0u, flen = 0u;
+    int neg = 0;
+    long expo = 0;
+    if (*s == '+' || *s == '-') {
+        neg = (*s++ == '-');
+    }
+    for (ip = s; *s >= '0' && *s <= '9'; s++) {
+        ilen++;
+    }
+    if (*s == '.') {
+        for (fp = ++s; *s >= '0' && *s <= '9'; s++) {
+            flen++;
+        }
+    }
+    if (ilen + flen == 0u) {
+        return 0;
+    }
+    if (*s == 'e' || *s == 'E') {
+        int eneg = 0;
+        s++;
+        if (*s == '+' || *s == '-') {
+            eneg = (*s++ == '-');
+        }
+        if (*s < '0' || *s > '9') {
+            return 0;
+        }
+        for (; *s >= '0' && *s <= '9'; s++) {
+            if (expo < 1000000000000000L) {
+                expo = 10 * expo + (*s - '0');
+            }
+        }
+        expo = eneg ? -expo : expo;
+    }
+    if (*s && *s != ' ' && *s != '\t' && *s != '\n' && *s != '\r') {
+        return 0; // 0x1f, 1.5abc
+    }
+    // the digits without the point, zeros at the end so the last one is
+    // on a limb boundary
+    long e10 = expo - (long)flen;
+    size_t pad = (size_t)(((e10 % BIG_DIG) + BIG_DIG) % BIG_DIG);
+    e10 -= (long)pad;
+    size_t ndig = ilen + flen + pad, i;
+    char *dig = big_alloc(ndig);
+    memcpy(dig, ip, ilen);
+    if (flen) {
+        memcpy(dig + ilen, fp, flen);
+    }
+    memset(dig + ilen + flen, '0', pad);
+    size_t n = (ndig + BIG_DIG - 1u) / BIG_DIG;
+    uint32_t *d = big_alloc(n * sizeof(*d));
+    for (i = 0u; i < n; i++) { // limb i ends BIG_DIG i digits from the end
+        size_t end = ndig - BIG_DIG * i;
+        size_t start = end > BIG_DIG ? end - BIG_DIG : 0u;
+        uint32_t v = 0u;
+        for (; start < end; start++) {
+            v = 10u * v + (uint32_t)(dig[start] - '0');
+        }
+        d[i] = v;
+    }
+    free(dig);
+    bn_take(r, d, n, e10 / BIG_DIG, neg);
+    bn_round(r, prec);
+    return 1;
+}
+
+static RPN_T box(const bn_t *x) {
+    big_t *big;
+    RPN_T num = box_new(sizeof(*big) + x->n * sizeof(*x->d), BOX_BIG,
+                        (void **)&big);
+    big->digits = digits;
+    big->neg = x->neg;
+    big->exp = x->exp;
+    big->n = x->n;
+    if (x->n) {
+        memcpy(big->d, x->d, x->n * sizeof(*x->d));
+    }
+    return num;
+}
+
+// num as a bn_t. 0 for inf, nan and vectors
+static int unbox(bn_t *r, RPN_T num) {
+    big_t *big = box_get(num, BOX_BIG);
+    if (big) {
+        uint32_t *d = big_alloc(big->n * sizeof(*d));
+        memcpy(d, big->d, big->n * sizeof(*d));
+        bn_take(r, d, big->n, big->exp, big->neg);
+        return 1;
+    }
+    if (num != num || num == (RPN_T)INFINITY || num == -(RPN_T)INFINITY) {
+        return 0;
+    }
+    char buf[NUM_BUFSIZ];
+    buf[num_format_shortest(buf, num)] = '\0';
+    return parse_str(r, buf, limbs_for(digits));
+}
+
+// the RPN_T for a result that's no number, with its fp flag
+static RPN_T no_number(token_t err, int neg) {
+    RPN_T num = NAN;
+    if (err == DBYZ) {
+        feraiseexcept(FE_DIVBYZERO);
+        num = (RPN_T)INFINITY;
+    } else if (err == OFLW) {
+        feraiseexcept(FE_OVERFLOW);
+        num = (RPN_T)INFINITY;
+    } else if (err == UFLW) {
+        feraiseexcept(FE_UNDERFLOW);
+        num = RPN_ZERO;
+    } else {
+        feraiseexcept(FE_INVALID);
+    }
+    return neg ? -num : num;
+}
+
+// ___ public functions ________________________________________________________
+
+size_t big_digits(void) {
+    return digits;
+}
+
+void big_set_digits(size_t ndigits) {
+    digits = ndigits < BIG_MAX_DIGITS ? ndigits : BIG_MAX_DIGITS;
+}
+
+int big_parse(const char *str, RPN_T *nump) {
+    bn_t r = {0};
+    if (!parse_str(&r, str, limbs_for(digits))) {
+        return 0;
+    }
+    *nump = box(&r);
+    bn_free(&r);
+    return 1;
+}
+
+RPN_T big_to_native(RPN_T num) {
+    big_t *big = box_get(num, BOX_BIG);
+    if (big == NULL) {
+        return num;
+    }
+    if (big->n == 0u) {
+        return RPN_ZERO;
+    }
+    // the top limbs are more digits than any RPN_T has
+    char buf[96];
+    size_t len = 0u, i, n = big->n < 5u ? big->n : 5u;
+    if (big->neg) {
+        buf[len++] = '-';
+    }
+    for (i = 0u; i < n; i++) {
+        uint32_t v = big->d[big->n - 1u - i];
+        int k;
+        for (k = BIG_DIG - 1; k >= 0; k--) {
+            buf[len + k] = '0' + v % 10u;
+            v /= 10u;
+        }
+        len += BIG_DIG;
+    }
+    long e10 = (big->exp + (long)(big->n - n)) * BIG_DIG;
+    buf[len++] = 'e';
+    if (e10 < 0) {
+        buf[len++] = '-';
+        e10 = -e10;
+    }
+    char digs[24];
+    int k = 0;
+    do {
+        digs[k++] = '0' + e10 % 10;
+        e10 /= 10;
+    } while (e10);
+    while (k) {
+        buf[len++] = digs[--k];
+    }
+    buf[len] = '\0';
+    return num_parse(buf, NULL);
+}
+
+RPN_T big_binary(token_t cmd, RPN_T x, RPN_T y) {
+    bn_t a = {0}, b = {0}, r = {0};
+    if (!unbox(&a, x) || !unbox(&b, y)) { // inf or nan
+        bn_free(&a);
+        bn_free(&b);
+        binary_fun_t binaryp = funrows[cmd].fun;
+        return binaryp(big_native(x), big_native(y));
+    }
+    fexcept_t flags;
+    fegetexceptflag(&flags, FE_ALL_EXCEPT);
+    size_t prec = limbs_for(digits);
+    token_t err = JUNK;
+    int neg = 0;
+    switch (cmd) {
+    case MUL: bn_mul(&r, &a, &b, prec); break;
+    case ADD: bn_add(&r, &a, &b, 0, prec); break;
+    case SUB: bn_add(&r, &a, &b, 1, prec); break;
+    case DIVI:
+        if (b.n == 0u) {
+            err = a.n ? DBYZ : INAN;
+            neg = a.neg;
+        } else {
+            bn_div(&r, &a, &b, prec);
+        }
+        break;
+    case POWE: err = bn_pow(&r, &a, &b, prec, &neg); break;
+    case ROOT: err = bn_rootx(&r, &a, &b, prec, &neg); break;
+    default:   err = INAN;
+    }
+    fesetexceptflag(&flags, FE_ALL_EXCEPT);
+    RPN_T result = err == JUNK ? box(&r) : no_number(err, neg);
+    bn_free(&a);
+    bn_free(&b);
+    bn_free(&r);
+    return result;
+}
+
+RPN_T big_unary(token_t cmd, RPN_T x) {
+    bn_t a = {0}, r = {0};
+    if (!unbox(&a, x)) {
+        bn_free(&a);
+        if (cmd == NEG) {
+            return -x;
+        } else if (cmd == INVE) {
+            return RPN_ONE / x;
+        }
+        unary_fun_t unaryp = funrows[cmd].fun;
+        return unaryp(x);
+    }
+    fexcept_t flags;
+    fegetexceptflag(&flags, FE_ALL_EXCEPT);
+    size_t prec = limbs_for(digits);
+    token_t err = JUNK;
+    int neg = 0, over;
+    switch (cmd) {
+    case NEG:
+        bn_copy(&r, &a);
+        r.neg = r.n ? !r.neg : 0;
+        bn_round(&r, prec);
+        break;
+    case INVE:
+        if (a.n == 0u) {
+            err = DBYZ;
+        } else {
+            bn_recip(&r, &a, prec);
+        }
+        break;
+    case EXPE:
+        over = bn_exp(&r, &a, prec);
+        err = over > 0 ? OFLW : over < 0 ? UFLW : JUNK;
+        break;
+    case LOGN:
+        if (a.n == 0u) {
+            err = DBYZ;
+            neg = 1;
+        } else if (a.neg) {
+            err = INAN;
+        } else {
+            bn_log(&r, &a, prec);
+        }
+        break;
+    default: err = INAN;
+    }
+    fesetexceptflag(&flags, FE_ALL_EXCEPT);
+    RPN_T result = err == JUNK ? box(&r) : no_number(err, neg);
+    bn_free(&a);
+    bn_free(&r);
+    return result;
+}
+
+size_t big_format_size(RPN_T num) {
+    big_t *big = box_get(num, BOX_BIG);
+    return big->digits + 48u;
+}
+
+// rounded to digits, then like "%.*g"
+size_t big_format(char *buf, RPN_T num) {
+    big_t *big = box_get(num, BOX_BIG);
+    size_t nd = big->digits ? big->digits : 1u, len = 0u, i, out = 0u;
+    if (big->n == 0u) {
+        buf[0] = '0';
+        buf[1] = '\0';
+        return 1u;
+    }
+    char *ds = big_alloc(big->n * BIG_DIG + 1u);
+    for (i = 0u; i < big->n; i++) {
+        uint32_t v = big->d[big->n - 1u - i];
+        int k;
+        for (k = BIG_DIG - 1; k >= 0; k--) {
+            ds[len + k] = '0' + v % 10u;
+            v /= 10u;
+        }
+        len += BIG_DIG;
+    }
+    size_t lead = 0u;
+    while (ds[lead] == '0') {
+        lead++;
+    }
+    // the value is 0.ds times 10^dexp
+    long dexp = (long)(len - lead) + big->exp * BIG_DIG;
+    char *d = ds + lead;
+    len -= lead;
+    if (len > nd) {
+        if (d[nd] >= '5') {
+            i = nd;
+            while (i > 0u && d[i - 1u] == '9') {
+                d[--i] = '0';
+            }
+            if (i == 0u) { // 999 became 1000
+                d[0] = '1';
+                dexp++;
+            } else {
+                d[i - 1u]++;
+            }
+        }
+        len = nd;
+    }
+    while (len > 1u && d[len - 1u] == '0') {
+        len--;
+    }
+    if (big->neg) {
+        buf[out++] = '-';
+    }
+    long x = dexp - 1; // the exponent of the first digit
+    if (x < -4 || x >= (long)nd) {
+        buf[out++] = d[0];
+        if (len > 1u) {
+            buf[out++] = '.';
+            memcpy(buf + out, d + 1, len - 1u);
+            out += len - 1u;
+        }
+        buf[out++] = 'e';
+        buf[out++] = x < 0 ? '-' : '+';
+        unsigned long ax = x < 0 ? -(unsigned long)x : (unsigned long)x;
+        char digs[24];
+        int k = 0;
+        do {
+            digs[k++] = '0' + ax % 10u;
+            ax /= 10u;
+        } while (ax);
+        if (k < 2) {
+            digs[k++] = '0';
+        }
+        while (k) {
+            buf[out++] = digs[--k];
+        }
+    } else if (x >= 0) {
+        for (i = 0u; i < len || (long)i <= x; i++) {
+            if ((long)i == x + 1) {
+                buf[out++] = '.';
+            }
+            buf[out++] = i < len ? d[i] : '0';
+        }
+    } else {
+        buf[out++] = '0';
+        buf[out++] = '.';
+        for (i = 1u; (long)i < -x; i++) {
+            buf[out++] = '0';
+        }
+        memcpy(buf + out, d, len);
+        out += len;
+    }
+    buf[out] = '\0';
+    free(ds);
+    return out;
+}
@@ -0,0 +1,40 @@
+#ifndef RPNBIG_H
+#define RPNBIG_H
+#include <stddef.h> // size_t
+#include "rpnfunctions.h"
+#include "rpnvec.h" // box_get()
+
+// rpnbig.h
+// arbitrary precision decimal numbers. p50 sets 50 digits: from then on
+// numbers are read as bigs and the operators work on bigs, a plain RPN_T
+// is read back from its shortest digits first. p or p0 goes back to RPN_T.
+// a big is a handle like a vector (rpnvec.h), the history and undo carry it
+
+// the precision in decimal digits, 0 when off
+size_t big_digits(void);
+void big_set_digits(size_t digits);
+
+static inline int big_is(RPN_T num) {
+    return num != num && box_get(num, BOX_BIG) != NULL; // a nan, like vec_is
+}
+
+// a decimal number as a big. 0 if str isn't one, like a hex or inf
+int big_parse(const char *str, RPN_T *nump);
+
+// num rounded to an RPN_T, num itself if it isn't a big
+RPN_T big_to_native(RPN_T num);
+static inline RPN_T big_native(RPN_T num) {
+    return num == num ? num : big_to_native(num);
+}
+
+// cmd is one of the binary or unary tokens, or NEG, INVE. a result that
+// isn't a number is an RPN_T inf or nan, with the fp flag raised
+RPN_T big_binary(token_t cmd, RPN_T x, RPN_T y);
+RPN_T big_unary(token_t cmd, RPN_T x);
+
+// the digits of the precision num was made with, "%g" style. buf has
+// big_format_size() bytes
+size_t big_format_size(RPN_T num);
+size_t big_format(char *buf, RPN_T num);
+
+#endif // RPNBIG_H
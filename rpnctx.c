@@ -0,0 +1,414 @@
+#include <stdlib.h>     // calloc(), free()
+#include <string.h>     // strlen(), memchr(), memcpy()
+#include <setjmp.h>
+#include "rpnstack.h"
+#include "rpnpstack.h"
+#include "rpnfunctions.h"
+#include "rpnprog.h"
+#include "rpnvec.h"
+#include "rpnbig.h"     // big_digits()
+#include "rpnword.h"
+#include "rpnout.h"
+#include "rpnsave.h"
+#include "rpnctx.h"
+
+// rpnctx.c
+// calculators as objects
+
+/* ___ comments ________________________________________________________________
+
+the modules keep their state in thread locals, the hot paths read them
+directly. a context holds a second set, and ctx_eval() swaps it in, runs
+the line and swaps it out again. the swap is a few words a module, the
+tables stay where they are. so a thread can run any number of contexts,
+one after another, and its own lines in between.
+
+stack_error() exits, for the program. while a context runs it longjmp()s
+back to ctx_eval() instead. what was being allocated is lost, and the
+stacks may be half way through a cmd, so the context is only good for
+ctx_destroy() after that
+*/
+
+#define CTX_CACHED 256u     // longer lines aren't cached, like rpnstream.c
+#define CTX_SNAPSHOTS 1024u // as interactive ./rpn
+
+struct rpn_ctx {
+    stack_t *stks[3];
+    int hist_flag;
+    token_t last_msg;       // for printmsg_fresh()
+    token_t msg;            // for ctx_msg()
+    const char *failure;    // stack_error()'s message
+    int failed;
+    size_t lineno;          // lines run, for the --fp-errors reports
+    char *line;             // the one running, with its '\0'
+    size_t linecap;
+    RPN_T *view;            // ctx_stack()'s copy, when the ring wraps
+    size_t viewcap;
+    size_t digits;          // p50
+    out_sink_t out;
+    out_sink_t err;
+    vec_state_t vec;
+    prog_state_t prog;
+    word_state_t words;
+    save_state_t save;      // "load file" maps its stacks
+    // the thread's, while the context runs
+    void (*printmsg_was)(token_t msgcode);
+    void (*fresh_was)(token_t msgcode, token_t *last_msgp);
+};
+
+static RPN_LOCAL rpn_ctx_t *current = NULL; // running on this thread
+
+// ___ helper functions ________________________________________________________
+
+// only the errors, and no printing
+static void ctx_printmsg(token_t msgcode) {
+    if (msgcode >= DBYZ && funrows[msgcode].has_msg) {
+        current->msg = msgcode;
+    }
+}
+
+static void ctx_printmsg_fresh(token_t msgcode, token_t *last_msgp) {
+    (void)last_msgp;
+    ctx_printmsg(msgcode);
+}
+
+// swaps the context's state with the thread's, both ways
+static void swap_state(rpn_ctx_t *ctx) {
+    vec_swap(&ctx->vec);
+    prog_swap(&ctx->prog);
+    word_swap(&ctx->words);
+    size_t digits = big_digits();
+    big_set_digits(ctx->digits);
+    ctx->digits = digits;
+}
+
+static void enter(rpn_ctx_t *ctx) {
+    swap_state(ctx);
+    ctx->printmsg_was = p_printmsg;
+    ctx->fresh_was = p_printmsg_fresh;
+    p_printmsg = ctx_printmsg;
+    p_printmsg_fresh = ctx_printmsg_fresh;
+    out_set_sinks(&ctx->out, &ctx->err);
+    current = ctx;
+}
+
+static void leave(rpn_ctx_t *ctx) {
+    out_flush();
+    out_set_sinks(NULL, NULL);
+    p_printmsg = ctx->printmsg_was;
+    p_printmsg_fresh = ctx->fresh_was;
+    swap_state(ctx);
+    current = NULL;
+}
+
+// what the public functions hand guard()'s fun
+typedef struct {
+    const char *buf;
+    size_t len;             // or the index, for ctx_peek()
+    int dump;
+    RPN_T num;
+    const RPN_T *nums;      // ctx_stack()'s
+} ctx_call_t;
+
+// fun with the context's state in, stack_error() caught. a CTX_ status
+static int guard(rpn_ctx_t *ctx, int (*fun)(rpn_ctx_t *, ctx_call_t *),
+                 ctx_call_t *call)
+{
+    if (ctx->failed) {
+        return CTX_FAILED;
+    }
+    jmp_buf env;
+    enter(ctx);
+    if (setjmp(env)) {
+        stack_catch(NULL, NULL);
+        out_set_sinks(NULL, NULL); // leave() could fail again on its flush
+        p_printmsg = ctx->printmsg_was;
+        p_printmsg_fresh = ctx->fresh_was;
+        swap_state(ctx);
+        current = NULL;
+        ctx->failed = 1;
+        return CTX_FAILED;
+    }
+    stack_catch(&env, &ctx->failure);
+    ctx->msg = JUNK;
+    int quit = fun(ctx, call);
+    leave(ctx);
+    stack_catch(NULL, NULL);
+    if (quit) {
+        return CTX_QUIT;
+    }
+    return ctx->msg == JUNK ? CTX_OK : CTX_MSG;
+}
+
+// a line a line, each one copied to end in '\0'. 1 on q
+static int run_lines(rpn_ctx_t *ctx, ctx_call_t *call) {
+    const char *buf = call->buf, *end = buf + call->len;
+    int quit = 0;
+    do {
+        const char *nl = memchr(buf, '\n', end - buf);
+        size_t len = (nl ? nl : end) - buf;
+        if (len + 1u > ctx->linecap) {
+            char *line = realloc(ctx->line, len + 1u);
+            if (line == NULL) {
+                stack_error("Failed to copy line");
+            }
+            ctx->line = line;
+            ctx->linecap = len + 1u;
+        }
+        memcpy(ctx->line, buf, len);
+        ctx->line[len] = '\0';
+        ctx->lineno++;
+        if (save_line(&ctx->save, ctx->line, &ctx->hist_flag, &ctx->last_msg,
+                      ctx->stks)) {
+            quit = 0;
+        } else if (len <= CTX_CACHED) {
+            quit = prog_run_line(prog_cached(ctx->line), ctx->lineno,
+                                 &ctx->hist_flag, &ctx->last_msg, ctx->stks);
+        } else {
+            rpn_prog_t *prog = prog_compile(ctx->line);
+            quit = prog_run_line(prog, ctx->lineno,
+                                 &ctx->hist_flag, &ctx->last_msg, ctx->stks);
+            prog_destroy(prog);
+        }
+        if (call->dump && !quit) {
+            dump_stack(ctx->stks[I_STK]);
+        }
+        buf += len + 1u;
+    } while (buf < end && !quit);
+    return quit;
+}
+
+static int push_num(rpn_ctx_t *ctx, ctx_call_t *call) {
+    do_cmd(&ctx->hist_flag, &ctx->last_msg, call->num, NUM, ctx->stks);
+    return 0;
+}
+
+// as d, into the history
+static int pop_num(rpn_ctx_t *ctx, ctx_call_t *call) {
+    if (stack_empty(ctx->stks[I_STK])) {
+        ctx_printmsg(SMAL);
+        return 0;
+    }
+    do_cmd(&ctx->hist_flag, &ctx->last_msg, RPN_ZERO, DISC, ctx->stks);
+    call->num = big_native(num_top(ctx->stks[H_NUMS]));
+    return 0;
+}
+
+// a big is in the context's boxes, guard() swapped them in
+static int peek_num(rpn_ctx_t *ctx, ctx_call_t *call) {
+    if (call->len >= stack_size(ctx->stks[I_STK])) {
+        ctx_printmsg(SMAL);
+        return 0;
+    }
+    call->num = big_native(num_peek(call->len, ctx->stks[I_STK]));
+    return 0;
+}
+
+static int view_stack(rpn_ctx_t *ctx, ctx_call_t *call) {
+    stack_t *stk = ctx->stks[I_STK];
+    call->len = stack_size(stk);
+    if (stk->head + stk->index <= stk->nelems) { // one piece, no copy
+        call->nums = (const RPN_T *)stk->data + stk->head;
+        return 0;
+    }
+    if (call->len > ctx->viewcap) {
+        RPN_T *view = realloc(ctx->view, call->len * sizeof(RPN_T));
+        if (view == NULL) {
+            stack_error("Failed to copy stack");
+        }
+        ctx->view = view;
+        ctx->viewcap = call->len;
+    }
+    stack_unwrap(ctx->view, stk);
+    call->nums = ctx->view;
+    return 0;
+}
+
+static int forget(rpn_ctx_t *ctx, ctx_call_t *call) {
+    (void)call;
+    while (!stack_empty(ctx->stks[H_CMDS])) {
+        cmd_pop(ctx->stks[H_CMDS]);
+    }
+    while (!stack_empty(ctx->stks[H_NUMS])) {
+        num_pop(ctx->stks[H_NUMS]);
+    }
+    pstack_forget(ctx->stks[I_STK]);
+    return 0;
+}
+
+// the buffers go after guard(), leave() flushes into ctx->out
+static int shrink(rpn_ctx_t *ctx, ctx_call_t *call) {
+    int z;
+    (void)call;
+    for (z = I_STK; z <= H_CMDS; z++) {
+        stack_shrink_to_fit(ctx->stks[z]);
+    }
+    prog_cache_clear();
+    return 0;
+}
+
+// guard() for the calls that make no msg of their own, ctx_msg() is still
+// the last line's
+static int guard_quiet(rpn_ctx_t *ctx, int (*fun)(rpn_ctx_t *, ctx_call_t *),
+                       ctx_call_t *call)
+{
+    token_t msg = ctx->msg;
+    int status = guard(ctx, fun, call);
+    if (status != CTX_FAILED) {
+        ctx->msg = msg;
+        status = CTX_OK;
+    }
+    return status;
+}
+
+// the stacks are made with stack_error(), ctx isn't changed after setjmp()
+static int make_stacks(rpn_ctx_t *ctx) {
+    jmp_buf env;
+    if (setjmp(env)) {
+        stack_catch(NULL, NULL);
+        return 0;
+    }
+    stack_catch(&env, &ctx->failure);
+    ctx->stks[I_STK ] = stack_create(sizeof(RPN_T));
+    ctx->stks[H_NUMS] = stack_create(sizeof(RPN_T));
+    ctx->stks[H_CMDS] = stack_create(sizeof(token_t));
+    pstack_enable(CTX_SNAPSHOTS, ctx->stks[I_STK]);
+    stack_catch(NULL, NULL);
+    return 1;
+}
+
+// ___ public functions ________________________________________________________
+
+rpn_ctx_t *ctx_create(void) {
+    rpn_ctx_t *ctx = calloc(1u, sizeof(*ctx));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    if (!make_stacks(ctx)) {
+        ctx_destroy(ctx);
+        return NULL;
+    }
+    ctx->last_msg = JUNK;
+    ctx->msg = JUNK;
+    return ctx;
+}
+
+void ctx_destroy(rpn_ctx_t *ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    swap_state(ctx);
+    prog_cache_clear();
+    word_clear();
+    vec_clear();
+    swap_state(ctx);
+    int z;
+    for (z = I_STK; z <= H_CMDS; z++) {
+        if (ctx->stks[z]) {
+            stack_destroy(ctx->stks[z]);
+        }
+    }
+    save_close(&ctx->save);
+    free(ctx->out.data);
+    free(ctx->err.data);
+    free(ctx->line);
+    free(ctx->view);
+    free(ctx);
+}
+
+int ctx_eval(rpn_ctx_t *ctx, const char *line) {
+    ctx_call_t call = {line, strlen(line), 1, 0.0, NULL};
+    return guard(ctx, run_lines, &call);
+}
+
+void ctx_no_files(rpn_ctx_t *ctx) {
+    ctx->save.no_files = 1;
+    ctx->vec.no_files = 1;
+}
+
+int ctx_run(rpn_ctx_t *ctx, const char *buf, size_t len) {
+    ctx_call_t call = {buf, len, 0, 0.0, NULL};
+    return guard(ctx, run_lines, &call);
+}
+
+int ctx_push(rpn_ctx_t *ctx, RPN_T num) {
+    ctx_call_t call = {NULL, 0u, 0, num, NULL};
+    return guard(ctx, push_num, &call);
+}
+
+int ctx_pop(rpn_ctx_t *ctx, RPN_T *nump) {
+    ctx_call_t call = {NULL, 0u, 0, 0.0, NULL};
+    int status = guard(ctx, pop_num, &call);
+    if (status == CTX_OK) {
+        *nump = call.num;
+    }
+    return status;
+}
+
+token_t ctx_msg(const rpn_ctx_t *ctx) {
+    return ctx->msg;
+}
+
+const char *ctx_failure(const rpn_ctx_t *ctx) {
+    return ctx->failed ? ctx->failure : NULL;
+}
+
+const char *ctx_output(const rpn_ctx_t *ctx, size_t *lenp) {
+    *lenp = ctx->out.len;
+    return ctx->out.len ? ctx->out.data : "";
+}
+
+const char *ctx_errors(const rpn_ctx_t *ctx, size_t *lenp) {
+    *lenp = ctx->err.len;
+    return ctx->err.len ? ctx->err.data : "";
+}
+
+void ctx_clear(rpn_ctx_t *ctx) {
+    ctx->out.len = 0u;
+    ctx->err.len = 0u;
+}
+
+size_t ctx_depth(const rpn_ctx_t *ctx) {
+    return stack_size(ctx->stks[I_STK]);
+}
+
+int ctx_peek(rpn_ctx_t *ctx, size_t index, RPN_T *nump) {
+    ctx_call_t call = {NULL, index, 0, 0.0, NULL};
+    int status = guard(ctx, peek_num, &call);
+    if (status == CTX_OK) {
+        *nump = call.num;
+    }
+    return status;
+}
+
+const RPN_T *ctx_stack(rpn_ctx_t *ctx, size_t *lenp) {
+    ctx_call_t call = {NULL, 0u, 0, 0.0, NULL};
+    if (guard_quiet(ctx, view_stack, &call) != CTX_OK) {
+        *lenp = 0u;
+        return NULL;
+    }
+    *lenp = call.len;
+    return call.nums;
+}
+
+int ctx_forget(rpn_ctx_t *ctx) {
+    ctx_call_t call = {NULL, 0u, 0, 0.0, NULL};
+    return guard_quiet(ctx, forget, &call);
+}
+
+int ctx_shrink(rpn_ctx_t *ctx) {
+    ctx_call_t call = {NULL, 0u, 0, 0.0, NULL};
+    int status = guard_quiet(ctx, shrink, &call);
+    if (status == CTX_FAILED) {
+        return status;
+    }
+    free(ctx->out.data);
+    free(ctx->err.data);
+    free(ctx->line);
+    free(ctx->view);
+    ctx->out = ctx->err = (out_sink_t){NULL, 0u, 0u};
+    ctx->line = NULL;
+    ctx->view = NULL;
+    ctx->linecap = ctx->viewcap = 0u;
+    return status;
+}
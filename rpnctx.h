@@ -0,0 +1,79 @@
+#ifndef RPNCTX_H
+#define RPNCTX_H
+#include <stddef.h>     // size_t
+#include "rpnstack.h"
+#include "rpnfunctions.h"
+
+// rpnctx.h
+// the api of librpn.a and librpn.so, make librpn.
+// a calculator as an object, for a program that wants many of them. a
+// context owns its three stacks, the history toggle, the last msg, its
+// output and everything a line leaves behind: vectors, big number digits,
+// compiled lines and words. contexts share nothing they change, so each
+// thread can run its own without locks. one context is for one thread at
+// a time.
+// fp_check, opt_level, jit_enabled and out_set_roundtrip() are for the
+// whole program, set them before the threads start
+
+typedef struct rpn_ctx rpn_ctx_t;
+
+// what ctx_eval() returns
+enum {
+    CTX_OK,     // the line ran
+    CTX_QUIT,   // it had a q, the rest of it didn't run
+    CTX_MSG,    // a msg like Stack too small or Division by zero, ctx_msg()
+    CTX_FAILED, // out of memory, ctx_failure(). only ctx_destroy() now
+};
+
+// NULL if there's no memory for it
+rpn_ctx_t *ctx_create(void);
+void ctx_destroy(rpn_ctx_t *ctx);
+
+// runs line like batch mode does, then its stack goes to the output.
+// messages aren't printed, the last one is kept. a '\n' starts a new line.
+// a line "save file" or "load file" saves or loads the session, rpnsave.h
+int ctx_eval(rpn_ctx_t *ctx, const char *line);
+// from now on "save file", "load file" and <file are CTX_MSG and touch no
+// file, for a context that runs someone else's lines
+void ctx_no_files(rpn_ctx_t *ctx);
+// the len chars at buf, lines like ctx_eval(), without printing the stack.
+// read it with ctx_stack() or ctx_pop()
+int ctx_run(rpn_ctx_t *ctx, const char *buf, size_t len);
+
+// a number onto the stack, and off it as d would. they're in the history
+// like typed ones, _ undoes them. ctx_pop() of an empty stack is CTX_MSG
+int ctx_push(rpn_ctx_t *ctx, RPN_T num);
+int ctx_pop(rpn_ctx_t *ctx, RPN_T *nump);
+
+// the last msg of the last ctx_eval(), JUNK if there was none.
+// funrows[msg].name says it
+token_t ctx_msg(const rpn_ctx_t *ctx);
+// what failed, after CTX_FAILED
+const char *ctx_failure(const rpn_ctx_t *ctx);
+
+// what the lines printed, since ctx_clear(). err is what batch mode would
+// have written to stderr, --fp-errors reports
+const char *ctx_output(const rpn_ctx_t *ctx, size_t *lenp);
+const char *ctx_errors(const rpn_ctx_t *ctx, size_t *lenp);
+void ctx_clear(rpn_ctx_t *ctx);
+
+// the stack, index 0u is the bottom, up to ctx_depth() - 1u.
+// a big number comes rounded, a vector is a nan. an index past the top is
+// CTX_MSG, Stack too small, like ctx_pop() of an empty stack
+size_t ctx_depth(const rpn_ctx_t *ctx);
+int ctx_peek(rpn_ctx_t *ctx, size_t index, RPN_T *nump);
+// all of it at once, bottom first, *lenp numbers. it's the stack's own
+// memory unless a roll wrapped it around, then a copy. good until the next
+// call with ctx. bigs and vectors are their nan handles here. NULL and
+// *lenp 0 if there was no memory for the copy, CTX_FAILED
+const RPN_T *ctx_stack(rpn_ctx_t *ctx, size_t *lenp);
+
+// drops the history and the snapshots, a long lived context grows them.
+// undo stops here
+int ctx_forget(rpn_ctx_t *ctx);
+// gives back what an idle context can do without: the stacks' spare room,
+// its compiled lines and buffers. output that wasn't read is dropped
+int ctx_shrink(rpn_ctx_t *ctx);
+// ctx_stack(), ctx_forget() and ctx_shrink() leave ctx_msg() as it was
+
+#endif // RPNCTX_H
@@ -1,12 +1,20 @@
 #include <stdio.h>      // fgets()
 #include <stdlib.h>     // strtold()
 #include <string.h>     // memmove() memcpy() for rotate()
-#include <math.h>       // for ^ powl(). link with -lm
+#include <strings.h>    // strncasecmp()
+#include <math.h>       // for ^ powl(), RPN_POW. link with -lm
 #include <fenv.h>       // man fenv; man math_error
 // #include <float.h>   // no. limits just for msg, works for this machine
 // #include <errno.h>   // in stack.c too. inf is better than error msgs
 #include "rpnstack.h"
+#include "rpnpstack.h"
 #include "rpnfunctions.h"
+#include "rpnnum.h"     // num_parse()
+#include "rpnout.h"     // out_num()
+#include "rpnvec.h"     // vectors in RPN_T nans
+#include "rpnbig.h"     // big numbers, the same
+#include "rpnprog.h"    // prog_run() for words
+#include "rpnword.h"
 
 // rpnfunctions.c
 // a reverse polish notation calculator
@@ -54,7 +62,7 @@ strtold(): 0 can be returned on both success and failure
 if (errno) {perror("strtold() error"); exit(EXIT_FAILURE);}
 
 using strcspn(tokenchars, &tok0) is buggy. a while loop works
-strtok_r() is overkill. strtok() is enough
+strtok() wrote into the input, lex() doesn't. chartab[] replaces the loop
 
 printmsg()
 there's a wrapper around it and a global to avoid repetition
@@ -74,9 +82,7 @@ undo could print what cmd is undone
 
 printmsg() can be spammy, have a toggle for it? run in batchmode
 
-is_zero(). what can a long double zero look like? would be obviated by flex
-(not very important. false positives don't matter much here)
-0 preceded by [+-] fails to insert, interpreted as the operations [+-]
+is_zero(). what can a long double zero look like? obviated by is_number()
 
 a conf file to set token chars
 
@@ -107,22 +113,17 @@ q
 */
 // ___ convenience for RPN_T stacks ____________________________________________
 
-// not a full abstraction layer
+// not a full abstraction layer. the num_ functions are inlined from the header
 RPN_T pop(stack_t *stk) {
-    RPN_T tmp;
-    stack_pop(&tmp, stk);
-    return tmp;
+    return num_pop(stk);
 }
 
 RPN_T top(stack_t *stk) {
-    RPN_T tmp;
-    stack_top(&tmp, stk);
-    return tmp;
+    return num_top(stk);
 }
 
 void push(RPN_T item, stack_t *stk) {
-    RPN_T tmp = item;
-    stack_push(&tmp, stk);
+    num_push(item, stk);
 }
 
 // moves _and_ returns the item. opposite arg order from memmove
@@ -135,8 +136,9 @@ RPN_T transfer(stack_t *src, stack_t *dest) {
 // ___ display, print __________________________________________________________
 
 // for interactive mode, use the vanilla print functions that do stuff
-void (*p_printmsg)(token_t msgcode) = printmsg;
-void (*p_printmsg_fresh)(token_t msgcode, token_t *last_msgp) = printmsg_fresh;
+RPN_LOCAL void (*p_printmsg)(token_t msgcode) = printmsg;
+RPN_LOCAL void (*p_printmsg_fresh)(token_t msgcode,
+                                   token_t *last_msgp) = printmsg_fresh;
 
 // checking has_msg a 2nd time, so it is not JUNK from math_err()
 void printmsg(token_t msgcode) {
@@ -145,8 +147,14 @@ void printmsg(token_t msgcode) {
         printf("%c ", funrows[msgcode].tok);
     }
     printf("%s\n", funrows[msgcode].name);
+    out_below(1u);
     if (msgcode == HELP || msgcode == RANG) {
-        printf("%s\n", multiline_messages[msgcode - HELP]);
+        const char *str = multiline_messages[msgcode - HELP];
+        printf("%s\n", str);
+        out_below(1u);
+        for (; *str; str++) {
+            out_below(*str == '\n');
+        }
     }
 }
 
@@ -161,17 +169,24 @@ void printmsg_fresh(token_t msgcode, token_t *last_msgp) {
     }
 }
 
+int fp_check = FP_CMD;
+
 // batch mode in main points p_printmsg and p_printmsg_fresh to these
 void donot_printmsg(token_t msgcode) { return; }
 void donot_printmsg_fresh(token_t msgcode, token_t *last_msgp) { return; }
 
-// format string RPN_FMT for long double is "%.10Lg"
+// RPN_FMT for long double is "%.10Lg", out_num() writes the same.
+// a vector shows its first 8 elements, w dumps all of it
 void print_num(void *itemp) {
-    printf(RPN_FMT, *(RPN_T*)itemp);
+    if (vec_is(*(RPN_T*)itemp)) {
+        out_vec(*(RPN_T*)itemp, 8u);
+        return;
+    }
+    out_num(*(RPN_T*)itemp);
 }
 
 void print_cmdname(void *itemp) {
-    printf("%s", funrows[*(token_t*)itemp].name);
+    out_str(funrows[*(token_t*)itemp].name);
 }
 
 
@@ -187,10 +202,10 @@ void display_stack(void (*print_item)(void*),
         z = stksize - display_len;
     }
     while (z < stksize) { // z < display_len
-        printf("%4zu: ", stksize - z - 1u); // pad the index
+        out_index(stksize - z - 1u); // pad the index
         stack_peek(itemp, z, stk);
         print_item(itemp);
-        printf("\n");
+        out_char('\n');
         z++;
     }
 }
@@ -199,24 +214,27 @@ void display_stack(void (*print_item)(void*),
 void display_history(stack_t *stks[]) {
     size_t hist_display_limit = 30u;
     if (!stack_empty(stks[H_NUMS])) {
-        puts("history numbers:");
+        out_str("history numbers:\n");
         RPN_T num;
         display_stack(print_num, &num, hist_display_limit, stks[H_NUMS]);
-        puts("");
+        out_char('\n');
     }
     if (!stack_empty(stks[H_CMDS])) {
-        puts("history cmds:");
+        out_str("history cmds:\n");
         token_t cmd;
         display_stack(print_cmdname, &cmd, hist_display_limit, stks[H_CMDS]);
-        puts(hist_sep);
-        puts("");
+        out_str(hist_sep);
+        out_str("\n\n");
     }
 }
 
 
 // print: separator, optional history stacks, interactive stack, prompt
+// the frame goes out in one write, on a terminal only the rows that changed
 void display(int *hist_flagp, stack_t *stks[]) {
-    puts(display_sep);
+    out_frame_begin();
+    out_str(display_sep);
+    out_char('\n');
     if (*hist_flagp) {
         display_history(stks);
     }
@@ -225,7 +243,8 @@ void display(int *hist_flagp, stack_t *stks[]) {
         RPN_T num;
         display_stack(print_num, &num, items_display_limit, stks[I_STK ]);
     }
-    printf("%s", rpn_prompt); // "#> "
+    out_str(rpn_prompt); // "#> "
+    out_frame();
 }
 
 
@@ -252,35 +271,75 @@ RPN_T sub(RPN_T x, RPN_T y) {
 }
 
 RPN_T powe(RPN_T x, RPN_T y) {
-    return powl(x, y);
+    return RPN_POW(x, y);
 }
 
 // root, radical anti-power x^(1/y)
 // a "2 v" input means square root
 RPN_T root(RPN_T x, RPN_T y) {
-    return powl(x, RPN_ONE / y); // 1.0L
+    return RPN_POW(x, RPN_ONE / y); // 1.0L
 }
 
 
 // unary operations EXPE x, LOGN l
 RPN_T expe(RPN_T x) {
-    return expl(x);
+    return RPN_EXP(x);
 }
 
 RPN_T logn(RPN_T x) {
-    return logl(x);
+    return RPN_LOG(x);
+}
+
+// g, 0 1 2 ... x - 1 as one vector
+RPN_T gene(RPN_T x) {
+    return vec_unary(GENE, x);
+}
+
+// MULA, x a * b + as one insn, rpnopt.c. two roundings like the two cmds,
+// or one with fused. the Makefile has -ffp-contract=off for the two
+static RPN_LOCAL RPN_T mula_a, mula_b;
+static RPN_LOCAL int mula_fused = 0;
+
+void mula_set(RPN_T a, RPN_T b, int fused) {
+    mula_a = a;
+    mula_b = b;
+    mula_fused = fused;
+}
+
+RPN_T mula(RPN_T x) {
+    if (mula_fused) {
+        return RPN_FMA(x, mula_a, mula_b);
+    }
+    RPN_T ax = x * mula_a;
+    return ax + mula_b;
 }
 
 // ___ commands ________________________________________________________________
 
 // negate, unary minus
 void neg(stack_t *stk) {
-    push(-pop(stk), stk);
+    RPN_T num = pop(stk);
+    if (vec_is(num)) {
+        num = vec_unary(NEG, num);
+    } else if (big_digits()) {
+        num = big_unary(NEG, num);
+    } else {
+        num = -big_native(num);
+    }
+    push(num, stk);
 }
 
 // invert
 void inve(stack_t *stk) {
-    push(RPN_ONE / pop(stk), stk);
+    RPN_T num = pop(stk);
+    if (vec_is(num)) {
+        num = vec_unary(INVE, num);
+    } else if (big_digits()) {
+        num = big_unary(INVE, num);
+    } else {
+        num = RPN_ONE / big_native(num);
+    }
+    push(num, stk);
 }
 
 void copy(stack_t *stk) {
@@ -301,17 +360,16 @@ void toggle(int *flag) {
     *flag = !(*flag);
 }
 
-// DUMP w, print the contents of the stack in one line
+// DUMP w, print the contents of the stack in one line, one write
 void dump_stack(stack_t *stk) {
     size_t lim = stack_size(stk);
     size_t z;
-    RPN_T item;
     for (z = 0u; z < lim; z++) {
-        stack_peek(&item, z, stk);
-        print_num(&item);
-        printf(" ");
+        out_num(num_peek(z, stk));
+        out_char(' ');
     }
-    puts("");
+    out_char('\n');
+    out_flush();
 }
 
 // roll stack up or down
@@ -327,16 +385,24 @@ void noop(void) { return; }
 
 // ___ handle input, use stacks, print msgs ____________________________________
 
-// undo is for restoring I_STK to a previous state
-// only for the functions < UNDO
-void undo(token_t *last_msgp, stack_t *stks[]) {
-    if (stack_empty(stks[H_CMDS])) {
-        p_printmsg_fresh(SMLU, last_msgp);
-        return;
+// how many H_NUMS cmd moved there. they're the top of I_STK before cmd
+size_t hist_nums(token_t cmd) {
+    if (funrows[cmd].type == BINARY || funrows[cmd].type == UNARY
+        || cmd == DISC) {
+        return funrows[cmd].minsz;
+    }
+    return 0u;
+}
+
+// one step back by doing the opposite of the last cmd with H_NUMS.
+// returns 0 if there is no history for it
+int undo_replay(stack_t *stks[]) {
+    token_t cmd = cmd_top(stks[H_CMDS]);
+    // with limited undo depth the H_NUMS it needs may have been dropped
+    if (stack_size(stks[H_NUMS]) < hist_nums(cmd)) {
+        return 0;
     }
-    p_printmsg_fresh(UNDO, last_msgp);
-    token_t cmd;
-    stack_pop(&cmd, stks[H_CMDS]);
+    cmd_pop(stks[H_CMDS]);
     if (cmd == NUM || cmd == COPY) { // testing COPY before other nonhists
         pop(stks[I_STK]);
     } else if (funrows[cmd].type == BINARY) { //  * + ^ / - v
@@ -351,7 +417,74 @@ void undo(token_t *last_msgp, stack_t *stks[]) {
         nonhist(funrows[cmd].anti, stks);
     } else if (cmd == DISC) {
         transfer(stks[H_NUMS], stks[I_STK ]);
+    } else if (cmd == DEFN) {
+        word_undo();
     }
+    return 1;
+}
+
+// undo is for restoring I_STK to a previous state
+// only for the functions < UNDO
+// the snapshots of I_STK jump back any number of steps at once, the
+// history stacks just drop what those steps added. older steps are replayed
+void undo(size_t steps, token_t *last_msgp, stack_t *stks[]) {
+    if (stack_empty(stks[H_CMDS])) {
+        p_printmsg_fresh(SMLU, last_msgp);
+        return;
+    }
+    if (steps > stack_size(stks[H_CMDS])) {
+        steps = stack_size(stks[H_CMDS]);
+    }
+    size_t jumped = pstack_undo(steps, stks[I_STK]);
+    size_t z, n;
+    for (z = 0u; z < jumped; z++) {
+        token_t cmd = cmd_pop(stks[H_CMDS]);
+        if (cmd == DEFN) {
+            word_undo();
+        }
+        n = hist_nums(cmd);
+        while (n-- && !stack_empty(stks[H_NUMS])) {
+            pop(stks[H_NUMS]);
+        }
+    }
+    for (z = jumped; z < steps; z++) {
+        if (!undo_replay(stks)) {
+            break;
+        }
+    }
+    if (z > jumped) { // replayed. the snapshots start over from here
+        pstack_forget(stks[I_STK]);
+    }
+    p_printmsg_fresh(z ? UNDO : SMLU, last_msgp);
+}
+
+// the steps that undo() jumped back, forward again. puts their history back
+void redo(size_t steps, token_t *last_msgp, stack_t *stks[]) {
+    size_t z;
+    for (z = 0u; z < steps; z++) {
+        int cmd = pstack_tag(z + 1, stks[I_STK]);
+        if (cmd < 0) {
+            break;
+        }
+        // H_NUMS from the top of the version before cmd, like transfer()
+        size_t size = pstack_size(z, stks[I_STK]);
+        size_t n = hist_nums(cmd);
+        RPN_T num;
+        while (n--) {
+            pstack_peek(&num, --size, z, stks[I_STK]);
+            push(num, stks[H_NUMS]);
+        }
+        cmd_push(cmd, stks[H_CMDS]);
+        if (cmd == DEFN) {
+            word_redo();
+        }
+    }
+    if (z == 0u) {
+        p_printmsg_fresh(NORE, last_msgp);
+        return;
+    }
+    pstack_redo(z, stks[I_STK]);
+    p_printmsg_fresh(REDO, last_msgp);
 }
 
 
@@ -359,19 +492,42 @@ void undo(token_t *last_msgp, stack_t *stks[]) {
 void binary(token_t cmd, stack_t *stks[]) {
     RPN_T topnum = transfer(stks[I_STK ], stks[H_NUMS]);
     RPN_T nextnum = transfer(stks[I_STK ], stks[H_NUMS]);
-    binaryp = funrows[cmd].fun;
-    push(binaryp(nextnum, topnum), stks[I_STK ]); // arg order is important
+    if (vec_is(nextnum) || vec_is(topnum)) {
+        push(vec_binary(cmd, nextnum, topnum), stks[I_STK ]);
+        return;
+    }
+    if (big_digits()) {
+        push(big_binary(cmd, nextnum, topnum), stks[I_STK ]);
+        return;
+    }
+    binary_fun_t binaryp = funrows[cmd].fun; // arg order is important
+    push(binaryp(big_native(nextnum), big_native(topnum)), stks[I_STK ]);
 }
 
 void unary(token_t cmd, stack_t *stks[]) {
     RPN_T operand = transfer(stks[I_STK ], stks[H_NUMS]);
-    unaryp = funrows[cmd].fun;
-    push(unaryp(operand), stks[I_STK ]);
+    if (cmd == MULA && (vec_is(operand) || big_digits())) { // as * then +
+        RPN_T ax = vec_is(operand) ? vec_binary(MUL, operand, mula_a)
+                                   : big_binary(MUL, operand, mula_a);
+        push(vec_is(ax) ? vec_binary(ADD, ax, mula_b)
+                        : big_binary(ADD, ax, mula_b), stks[I_STK ]);
+        return;
+    }
+    if (vec_is(operand)) {
+        push(vec_unary(cmd, operand), stks[I_STK ]);
+        return;
+    }
+    if (big_digits() && cmd != GENE) {
+        push(big_unary(cmd, operand), stks[I_STK ]);
+        return;
+    }
+    unary_fun_t unaryp = funrows[cmd].fun;
+    push(unaryp(big_native(operand)), stks[I_STK ]);
 }
 
 // just need I_STK, but using *stks[] to harmonize with other functions
 void nonhist(token_t cmd, stack_t *stks[]) {
-    nonhistp = funrows[cmd].fun;
+    nonhist_fun_t nonhistp = funrows[cmd].fun;
     nonhistp(stks[I_STK]);
 }
 
@@ -381,15 +537,18 @@ void other (token_t cmd, stack_t *stks[]) { return; }
 void msg   (token_t cmd, stack_t *stks[]) { return; }
 
 
-// feclearexcept(FE_ALL_EXCEPT) previously in vet_do()
+// feclearexcept(FE_ALL_EXCEPT) previously in vet_do(). one read of the
+// status word, the order of the tests is the order of the msgs
 token_t math_error(void) {
-    if (fetestexcept(FE_DIVBYZERO)) {
+    int raised = fetestexcept(FE_DIVBYZERO | FE_OVERFLOW | FE_UNDERFLOW
+                              | FE_INVALID);
+    if (raised & FE_DIVBYZERO) {
         return DBYZ; // 0 i
-    } else if (fetestexcept(FE_OVERFLOW)) {
+    } else if (raised & FE_OVERFLOW) {
         return OFLW; // 1e4932 2 ^    or  11357 e
-    } else if (fetestexcept(FE_UNDERFLOW)) {
+    } else if (raised & FE_UNDERFLOW) {
         return UFLW; // 1e4932 i
-    } else if (fetestexcept(FE_INVALID)) {
+    } else if (raised & FE_INVALID) {
         return INAN; // inf inf -     or  -1 2 v
     } else {
         return JUNK;
@@ -397,6 +556,12 @@ token_t math_error(void) {
 }
 
 
+void do_cmd(int *hist_flagp,
+            token_t *last_msgp,
+            RPN_T inputnum,
+            token_t cmd,
+            stack_t *stks[]);
+
 // vet cmds against stack size. print msgs, smallstack and math errors
 void vet_do(int *hist_flagp,
             token_t *last_msgp,
@@ -408,76 +573,192 @@ void vet_do(int *hist_flagp,
         p_printmsg_fresh(SMAL, last_msgp);
         return;
     }
-    if (funrows[cmd].type != NONOP) { // is not  _ w t q h n   (< UNDO)
-        stack_push(&cmd, stks[H_CMDS]);
+    do_cmd(hist_flagp, last_msgp, inputnum, cmd, stks);
+}
+
+// the rest of vet_do(), once the stack is big enough for cmd
+void do_cmd(int *hist_flagp,
+            token_t *last_msgp,
+            RPN_T inputnum,
+            token_t cmd,
+            stack_t *stks[])
+{
+    if (funrows[cmd].type != NONOP) { // is not  _ y w t q h n p (< UNDO)
+        cmd_push(cmd, stks[H_CMDS]);
+    }
+    size_t size = stack_size(stks[I_STK]);
+    if (fp_check == FP_CMD) {
+        feclearexcept(FE_ALL_EXCEPT);
     }
-    feclearexcept(FE_ALL_EXCEPT);
     if (cmd == NUM) {
-        stack_push(&inputnum, stks[I_STK]);
+        num_push(inputnum, stks[I_STK]);
     } else if (funrows[cmd].type < NONOP) { // BINARY, UNARY, NONHIST
         callfun[funrows[cmd].type](cmd, stks);
     } else if (cmd == DISC) {     // d  not using a discard()
         transfer(stks[I_STK ], stks[H_NUMS]);
     } else if (cmd == HTOG) {
         toggle(hist_flagp);
+    } else if (cmd == PREC) {
+        big_set_digits((size_t)inputnum);
+    } else if (cmd == DEFN) {   // the word from word_pending()
+        word_define();
     } else if (cmd == DUMP) {
         // w msg _before_ printing stack. below, msg is unfresh and supressed
         p_printmsg_fresh(cmd, last_msgp);
         dump_stack(stks[I_STK ]);
     }
+    if (funrows[cmd].type != NONOP) {
+        // snapshot the elements cmd wrote. a roll writes one at an end
+        size_t lo = size - funrows[cmd].minsz;
+        size_t hi = stack_size(stks[I_STK]);
+        if (cmd == ROLD) {
+            lo = 0u;
+            hi = 1u;
+        } else if (cmd == ROLU) {
+            lo = hi - 1u;
+        }
+        pstack_commit(lo, hi, cmd, stks[I_STK]);
+    }
     p_printmsg_fresh(cmd, last_msgp);
-    p_printmsg(math_error()); // print even if it's an old msg
+    if (fp_check == FP_CMD) {
+        p_printmsg(math_error()); // print even if it's an old msg
+    }
 }
 
 
-// 0*+^/-vel~icsrud_wtqhn       tok chars also used in printmsg()
-// 0123456789012345678901
-// looks only for numbers and single chars
-// naively checks tok0 == '0'. not using an is_zero()
-token_t tokenize(char *inputbuf, RPN_T *inputnum) {
-    *inputnum = strtold(inputbuf, NULL); // no error check
-    char tok0 = *inputbuf;
-    if (*inputnum || (tok0 == '0')) {
-        // not 0.0L, so it's a number || the input 0.0L comes from a '0'
+// ___ lexer ___________________________________________________________________
+
+// what a byte means to the lexer. cmd chars map to their token_t,
+// the rest to JUNK. filled from funrows by init_chartab()
+enum {CH_BLANK = JUNK + 1, CH_END};
+static RPN_LOCAL unsigned char chartab[256];
+static RPN_LOCAL int chartab_ready = 0;
+
+void init_chartab(void) {
+    int i;
+    for (i = 0; i < 256; i++) {
+        chartab[i] = JUNK;
+    }
+    for (i = 1; i < JUNK; i++) { // assuming 0 is NUM
+        chartab[(unsigned char)funrows[i].tok] = i;
+    }
+    chartab[' '] = chartab['\t'] = chartab['\n'] = chartab['\r'] = CH_BLANK;
+    chartab['\0'] = CH_END;
+    chartab_ready = 1;
+}
+
+// skips blanks, returns the start of the next token, NULL at the end.
+// *endp is set to just past the token. the input is not changed
+const char *lex(const char *str, const char **endp) {
+    if (!chartab_ready) {
+        init_chartab();
+    }
+    while (chartab[(unsigned char)*str] == CH_BLANK) {
+        str++;
+    }
+    if (chartab[(unsigned char)*str] == CH_END) {
+        return NULL;
+    }
+    const char *end = str + 1;
+    while (chartab[(unsigned char)*end] < CH_BLANK) {
+        end++;
+    }
+    *endp = end;
+    return str;
+}
+
+// does the token look like what strtold() reads. [+-] digit . inf nan
+int is_number(const char *tok) {
+    if (*tok == '+' || *tok == '-') {
+        tok++;
+    }
+    if ((*tok >= '0' && *tok <= '9')
+        || (*tok == '.' && tok[1] >= '0' && tok[1] <= '9')) {
+        return 1;
+    }
+    return !strncasecmp(tok, "inf", 3) || !strncasecmp(tok, "nan", 3);
+}
+
+// 0*+^/-velg ~icsrud:_ywtqhnp     tok chars also used in printmsg()
+// 012345678901234567890123456
+// looks only for numbers and single chars. the float parser only sees numbers.
+// <file is a number too, a vector. with p50 a number is a big
+// a number is anything strtold() starts to read, so -0 is a number now.
+// num_parse() reads it, strtold() only for the hard ones
+token_t tokenize(const char *tok, RPN_T *inputnum) {
+    if (!chartab_ready) {
+        init_chartab();
+    }
+    if (is_number(tok)) {
+        if (big_digits() && big_parse(tok, inputnum)) {
+            return NUM;
+        }
+        *inputnum = num_parse(tok, NULL); // no error check
         return NUM;
-    } else {
-        int i = 1; // assuming 0 is NUM
-        while (i < JUNK) {
-            if (tok0 == funrows[i].tok) {
-                return i;
-            }
-            i++;
+    }
+    if (*tok == '<') {
+        return vec_load(tok + 1, inputnum);
+    }
+    token_t cmd = chartab[(unsigned char)*tok];
+    if (cmd == UNDO || cmd == REDO || cmd == PREC) { // _3 y3 p50
+        *inputnum = RPN_ZERO;
+        if (tok[1] >= '0' && tok[1] <= '9') {
+            *inputnum = strtoul(tok + 1, NULL, 10);
         }
     }
-    return JUNK;
+    return cmd < JUNK ? cmd : JUNK;
 }
 
 
 int handle_input(int *hist_flagp,
                  token_t *last_msgp,
-                 char *inputbuf,
+                 const char *inputbuf,
                  stack_t *stks[])
+{
+    if (feof(stdin)) {
+        // EOF, 2 Ctrl-D presses to abandon line
+        printf("\n");
+        out_below(1u);
+        clearerr(stdin);
+        return 0;
+    }
+    return handle_tokens(hist_flagp, last_msgp, inputbuf, stks);
+}
+
+// the tokens in str, which needn't be a whole line. returns 1 on q
+int handle_tokens(int *hist_flagp,
+                  token_t *last_msgp,
+                  const char *str,
+                  stack_t *stks[])
 {
     RPN_T inputnum = RPN_ZERO;
-    char *chp, *str;
+    const char *end;
     token_t tok = NUM;
-    for (chp = inputbuf; tok != QUIT; chp = NULL) {
-        str = strtok(chp, " \t"); // not \n
-        if (str == NULL) {
-            break; // reached end of input
-        }
-        if (feof(stdin)) { // EOF, 2 Ctrl-D presses to abandon line
-            printf("\n");
-            clearerr(stdin);
-            break;
+    for (str = lex(str, &end); str && tok != QUIT; str = lex(end, &end)) {
+        rpn_word_t *word = word_find(str, end - str, NULL, 0u);
+        if (word) { // its body, compiled when it was defined
+            tok = prog_run(word->prog, hist_flagp, last_msgp, stks) ? QUIT
+                                                                    : NUM;
+            continue;
         }
         tok = tokenize(str, &inputnum);
-        if (tok == UNDO) {
-            undo(last_msgp, stks);
+        if (tok == DEFN) {
+            rpn_word_t *def = word_parse(end, &end, NULL, 0u);
+            if (def == NULL) {
+                p_printmsg_fresh(BADW, last_msgp);
+                continue;
+            }
+            word_pending(def);
+            vet_do(hist_flagp, last_msgp, inputnum, tok, stks);
+            word_free(def);
+        } else if (tok == UNDO || tok == REDO) {
+            size_t steps = inputnum >= RPN_ONE ? (size_t)inputnum : 1u;
+            (tok == UNDO ? undo : redo)(steps, last_msgp, stks);
         } else if (tok < JUNK) {
             vet_do(hist_flagp, last_msgp, inputnum, tok, stks);
         }
     }
+    vec_collect(stks);
     return (tok == QUIT);
 }
 
@@ -5,11 +5,122 @@
 // rpnfunctions.h
 // a reverse polish notation calculator
 
+// numeric backends, picked at compile time: -DRPN_FLOAT, -DRPN_DOUBLE,
+// -DRPN_FLOAT128 (link with -lquadmath). long double is the default.
+// RPN_PREC digits are printed. MANT_DIG, MIN_EXP, MAX_EXP are the float.h
+// ones. POW10_EXACT: the largest exact power of ten, 5^n < 2^MANT_DIG.
+// ROUNDTRIP_DIG digits always read back as the same number
 # ifndef RPN_T
-#  define RPN_T long double
-#  define RPN_FMT "%.10Lg"
-#  define RPN_ZERO 0.0L
-#  define RPN_ONE  1.0L
+#  if defined(RPN_FLOAT)
+#   define RPN_T float
+#   define RPN_NAME "float"
+#   define RPN_FMT "%.7g"
+#   define RPN_PREC 7
+#   define RPN_ZERO 0.0f
+#   define RPN_ONE  1.0f
+#   define RPN_POW powf
+#   define RPN_EXP expf
+#   define RPN_LOG logf
+#   define RPN_FLOOR floorf
+#   define RPN_FMA fmaf
+#   define RPN_FABS fabsf
+#   define RPN_LDEXP ldexpf
+#   define RPN_ILOGB ilogbf
+#   define RPN_STRTO strtof
+#   define RPN_SNPRINTF(buf, size, prec, num) \
+           snprintf((buf), (size), "%.*g", (prec), (double)(num))
+#   define RPN_MANT_DIG 24
+#   define RPN_MIN_EXP (-125)
+#   define RPN_MAX_EXP 128
+#   define RPN_POW10_EXACT 10
+#   define RPN_ROUNDTRIP_DIG 9
+#   define RPN_RANGE_MSG \
+    "IEEE 754 says floats have 6 digit precision\n" \
+    "[ ± FLT_MIN: ± 1.17549e-38  ]\n" \
+    "[ ± FLT_MAX: ± 3.40282e+38  ]"
+#  elif defined(RPN_DOUBLE)
+#   define RPN_T double
+#   define RPN_NAME "double"
+#   define RPN_FMT "%.10g"
+#   define RPN_PREC 10
+#   define RPN_ZERO 0.0
+#   define RPN_ONE  1.0
+#   define RPN_POW pow
+#   define RPN_EXP exp
+#   define RPN_LOG log
+#   define RPN_FLOOR floor
+#   define RPN_FMA fma
+#   define RPN_FABS fabs
+#   define RPN_LDEXP ldexp
+#   define RPN_ILOGB ilogb
+#   define RPN_STRTO strtod
+#   define RPN_SNPRINTF(buf, size, prec, num) \
+           snprintf((buf), (size), "%.*g", (prec), (num))
+#   define RPN_MANT_DIG 53
+#   define RPN_MIN_EXP (-1021)
+#   define RPN_MAX_EXP 1024
+#   define RPN_POW10_EXACT 22
+#   define RPN_ROUNDTRIP_DIG 17
+#   define RPN_RANGE_MSG \
+    "IEEE 754 says doubles have 15 digit precision\n" \
+    "[ ± DBL_MIN: ± 2.22507e-308 ]\n" \
+    "[ ± DBL_MAX: ± 1.79769e+308 ]"
+#  elif defined(RPN_FLOAT128)
+#   include <quadmath.h>
+#   define RPN_T __float128
+#   define RPN_NAME "__float128"
+#   define RPN_FMT "%.10Qg" // for quadmath_snprintf(), not printf()
+#   define RPN_PREC 10
+#   define RPN_ZERO 0.0Q
+#   define RPN_ONE  1.0Q
+#   define RPN_POW powq
+#   define RPN_EXP expq
+#   define RPN_LOG logq
+#   define RPN_FLOOR floorq
+#   define RPN_FMA fmaq
+#   define RPN_FABS fabsq
+#   define RPN_LDEXP ldexpq
+#   define RPN_ILOGB ilogbq
+#   define RPN_STRTO strtoflt128
+#   define RPN_SNPRINTF(buf, size, prec, num) \
+           quadmath_snprintf((buf), (size), "%.*Qg", (prec), (num))
+#   define RPN_MANT_DIG 113
+#   define RPN_MIN_EXP (-16381)
+#   define RPN_MAX_EXP 16384
+#   define RPN_POW10_EXACT 48
+#   define RPN_ROUNDTRIP_DIG 36
+#   define RPN_RANGE_MSG \
+    "IEEE 754 says quads have 33 digit precision\n" \
+    "[ ± FLT128_MIN: ± 3.3621e-4932  ]\n" \
+    "[ ± FLT128_MAX: ± 1.18973e+4932 ]"
+#  else
+#   define RPN_T long double
+#   define RPN_NAME "long double"
+#   define RPN_FMT "%.10Lg"
+#   define RPN_PREC 10
+#   define RPN_ZERO 0.0L
+#   define RPN_ONE  1.0L
+#   define RPN_POW powl
+#   define RPN_EXP expl
+#   define RPN_LOG logl
+#   define RPN_FLOOR floorl
+#   define RPN_FMA fmal
+#   define RPN_FABS fabsl
+#   define RPN_LDEXP ldexpl
+#   define RPN_ILOGB ilogbl
+#   define RPN_STRTO strtold
+#   define RPN_SNPRINTF(buf, size, prec, num) \
+           snprintf((buf), (size), "%.*Lg", (prec), (num))
+#   define RPN_MANT_DIG 64
+#   define RPN_MIN_EXP (-16381)
+#   define RPN_MAX_EXP 16384
+#   define RPN_POW10_EXACT 27
+#   define RPN_ROUNDTRIP_DIG 21
+#   define RPN_RANGE_MSG \
+    "IEEE 754 says long doubles have 30 digit precision\n" \
+    "[ ± LDBL_MIN: ± 3.3621e-4932  ]\n" \
+    "[ ± LDBL_MAX: ± 1.18973e+4932 ]"
+#  endif
 # endif
 
 // subsets of these enums have different roles
@@ -27,33 +138,47 @@ typedef enum token_e {
 
     LOGN,  //   l     7     1       unary
     EXPE,  //   e     8     1
-
-     NEG,  //   ~     9     1       nonhists. have msgs, no H_NUMS
-    INVE,  //   i    10     1       also msg DBYZ
-    COPY,  //   c    11     1
-    SWAP,  //   s    12     2
-    ROLD,  //   r    13     2
-    ROLU,  //   u    14     2
-    DISC,  //   d    15     1       uses H_NUMS
+    GENE,  //   g     9     1       vector 0 to n - 1
+    MULA,  //        10     1       x a * b +, only from rpnopt.c
+
+     NEG,  //   ~    11     1       nonhists. have msgs, no H_NUMS
+    INVE,  //   i    12     1       also msg DBYZ
+    COPY,  //   c    13     1
+    SWAP,  //   s    14     2
+    ROLD,  //   r    15     2
+    ROLU,  //   u    16     2
+    DISC,  //   d    17     1       uses H_NUMS
+    DEFN,  //   :    18     0       : name ... ; a user word, rpnword.h
 //                                  not in history:
-    UNDO,  //   _    16     0       undo_score. C-_ is emacs undo
-    DUMP,  //   w    17     0       print stack. reset stacks
-    HTOG,  //   t    18     0       toggle history
-    QUIT,  //   q    19     0
-    HELP,  //   h    20     0       msg is multiline
-    RANG,  //   n    21     0       numberrange, not r
+    UNDO,  //   _    19     0       undo_score. C-_ is emacs undo. _3
+    REDO,  //   y    20     0       yank it back. y3
+    DUMP,  //   w    21     0       print stack. reset stacks
+    HTOG,  //   t    22     0       toggle history
+    QUIT,  //   q    23     0
+    HELP,  //   h    24     0       msg is multiline
+    RANG,  //   n    25     0       numberrange, not r
+    PREC,  //   p    26     0       big number digits, rpnbig.h. p50
 //
-    JUNK,  //        22             token limit, possible defaultval, ignore
-    DBYZ,  //        23             msg math_error() Division by zero
-    OFLW,  //        24             msg math_error() Overflow
-    UFLW,  //        25             msg math_error() Underflow
-    INAN,  //        26             msg math_error() Invalid
-    SMAL,  //        27             msg Stack too small
-    SMLU,  //        28             msg No history to undo. stack too small
+    JUNK,  //        27             token limit, possible defaultval, ignore
+    DBYZ,  //        28             msg math_error() Division by zero
+    OFLW,  //        29             msg math_error() Overflow
+    UFLW,  //        30             msg math_error() Underflow
+    INAN,  //        31             msg math_error() Invalid
+    SMAL,  //        32             msg Stack too small
+    SMLU,  //        33             msg No history to undo. stack too small
+    NORE,  //        34             msg Nothing to redo
+    BADW,  //        35             msg no ; or a <file in a definition
+    SESF,  //        36             msg a session can't be saved or loaded
 } token_t;
 
+// inlined typed access to the rpn_stacks. I_STK and H_NUMS hold RPN_T,
+// H_CMDS holds token_t. see STACK_TYPED in rpnstack.h
+STACK_TYPED(num, RPN_T)
+STACK_TYPED(cmd, token_t)
+
 
-static RPN_T (*binaryp)(RPN_T x, RPN_T y);
+// funrows[].fun is one of these, each call has its own pointer
+typedef RPN_T (*binary_fun_t)(RPN_T x, RPN_T y);
 RPN_T  mul(RPN_T x, RPN_T y);
 RPN_T  add(RPN_T x, RPN_T y);
 RPN_T powe(RPN_T x, RPN_T y); // the name pow() is taken
@@ -61,11 +186,14 @@ RPN_T divi(RPN_T x, RPN_T y); // the name div() is taken
 RPN_T  sub(RPN_T x, RPN_T y);
 RPN_T root(RPN_T x, RPN_T y);
 
-static RPN_T (*unaryp)(RPN_T x);
+typedef RPN_T (*unary_fun_t)(RPN_T x);
 RPN_T logn(RPN_T x);
 RPN_T expe(RPN_T x);
+RPN_T gene(RPN_T x); // a vector, rpnvec.h
+RPN_T mula(RPN_T x); // x a * b +, a b from mula_set()
+void mula_set(RPN_T a, RPN_T b, int fused);
 
-static void (*nonhistp)(stack_t *stk);
+typedef void (*nonhist_fun_t)(stack_t *stk);
 // can undo neg and inve easily without H_NUMS, unlike logn, expe
 void  neg(stack_t *stk);
 void inve(stack_t *stk);
@@ -112,6 +240,8 @@ static struct funrow {
 
     { 'l', logn, 1u, UNARY  , 1, JUNK, "log"            }, // LOGN
     { 'e', expe, 1u, UNARY  , 1, JUNK, "exp"            }, // EXPE
+    { 'g', gene, 1u, UNARY  , 1, JUNK, "generate"       }, // GENE
+    {'\0', mula, 1u, UNARY  , 0, JUNK, "muladd"         }, // MULA
 
     { '~', neg , 1u, NONHIST, 1,  NEG, "negate"         }, //  NEG
     { 'i', inve, 1u, NONHIST, 1, INVE, "invert"         }, // INVE
@@ -121,13 +251,16 @@ static struct funrow {
     { 'u', rolu, 2u, NONHIST, 1, ROLD, "rollup"         }, // ROLU
 
     { 'd', noop, 1u, OTHER  , 1, JUNK, "discard"        }, // DISC
+    { ':', noop, 0u, OTHER  , 1, JUNK, "define"         }, // DEFN
 
     { '_', noop, 0u, NONOP  , 1, JUNK, "undo"           }, // UNDO
+    { 'y', noop, 0u, NONOP  , 1, JUNK, "redo"           }, // REDO
     { 'w', noop, 1u, NONOP  , 1, JUNK, "dumpstack"      }, // DUMP
     { 't', noop, 0u, NONOP  , 1, JUNK, "togglehist"     }, // HTOG
     { 'q', noop, 0u, NONOP  , 1, JUNK, "quit"           }, // QUIT
     { 'h', noop, 0u, NONOP  , 1, JUNK, "help"           }, // HELP
     { 'n', noop, 0u, NONOP  , 1, JUNK, "numberrange"    }, // RANG
+    { 'p', noop, 0u, NONOP  , 1, JUNK, "precision"      }, // PREC
 
     {'\0', noop, 0u, OTHER  , 0, JUNK, "Junk"           }, // JUNK
     {'\0', noop, 0u, MSG    , 1, JUNK, "Divide by zero" }, // DBYZ
@@ -136,6 +269,9 @@ static struct funrow {
     {'\0', noop, 0u, MSG    , 1, JUNK, "Invalid num"    }, // INAN
     {'\0', noop, 0u, MSG    , 1, JUNK, "Stack too small"}, // SMAL
     {'\0', noop, 0u, MSG    , 1, JUNK, "No undo history"}, // SMLU
+    {'\0', noop, 0u, MSG    , 1, JUNK, "Nothing to redo"}, // NORE
+    {'\0', noop, 0u, MSG    , 1, JUNK, "Bad definition" }, // BADW
+    {'\0', noop, 0u, MSG    , 1, JUNK, "Session failed" }, // SESF
 }; // wall-to-wall padding
 
 
@@ -145,15 +281,17 @@ static const char *multiline_messages[] = {
     "rpn, Reverse Polish Notation floating point calculator\n"
     "Input number to push to the stack. hex format, inf and nan work too\n"
     "Operators: + * - /,    ^ power, v root, e exp, l log\n"
+    "  Vectors: <file numbers from a file, g generate 0 to n - 1\n"
+    "Precision: p50 numbers of 50 digits, p back to " RPN_NAME "\n"
     " Commands: ~ negate, i invert, c copy, d discard, s swap,\n"
     "           r rolldown, u rollup, w dump stack, t toggle history,\n"
-    "           _ undo, h this help, n number range, q quit",
+    "           _ undo, y redo, _3 y3 undo redo 3 steps,\n"
+    "    Words: : sq c * ; defines sq, then 3 sq is 9. ~/.rpnrc runs first\n"
+    "  Session: save file, load file, a line of its own\n"
+    "           h this help, n number range, q quit",
 
-    // not #include'ing <float.h> for these limits
-    // redo the numbers for other types
-    "IEEE 754 says long doubles have 30 digit precision\n"
-    "[ ± LDBL_MIN: ± 3.3621e-4932  ]\n"
-    "[ ± LDBL_MAX: ± 1.18973e+4932 ]", // no newline in the last strings
+    // not #include'ing <float.h> for these limits, see RPN_T above
+    RPN_RANGE_MSG, // no newline in the last strings
 };
 
 
@@ -165,11 +303,19 @@ static char *rpn_prompt = "#> ";
 
 void printmsg(token_t msgcode);
 void printmsg_fresh(token_t msgcode, token_t *last_msgp);
-// supress printing in batch mode
+// when math errors are looked for. FP_CMD: around every cmd, for the
+// interactive msgs. the others are for batch mode, which doesn't print
+// them: FP_OFF never, FP_LINE once a line, to stderr. FP_PRECISE also runs
+// a line with an error again to find the cmd. see prog_run_line()
+enum {FP_CMD, FP_OFF, FP_LINE, FP_PRECISE};
+extern int fp_check;
+
+// supress printing in batch mode. a thread starts out printing, rpnpar.c
+// gives its threads main's, rpnctx.c points them at its context
 void donot_printmsg(token_t msgcode);
 void donot_printmsg_fresh(token_t msgcode, token_t *last_msgp);
-void (*p_printmsg)(token_t msgcode);
-void (*p_printmsg_fresh)(token_t msgcode, token_t *last_msgp);
+extern RPN_LOCAL void (*p_printmsg)(token_t msgcode);
+extern RPN_LOCAL void (*p_printmsg_fresh)(token_t msgcode, token_t *last_msgp);
 
 void dump_stack(stack_t *stack);
 
@@ -182,9 +328,31 @@ enum {I_STK, H_NUMS, H_CMDS};
 
 int handle_input(int *hist_flagp,
                  token_t *last_msgp,
-                 char *inputbuf,
+                 const char *inputbuf,
                  stack_t *stks[]);
 
+// handle_input() without the EOF check, for rpnstream.c
+int handle_tokens(int *hist_flagp,
+                  token_t *last_msgp,
+                  const char *str,
+                  stack_t *stks[]);
+
+// the parts of handle_input() that rpnprog.c compiles a line with
+const char *lex(const char *str, const char **endp);
+token_t tokenize(const char *tok, RPN_T *inputnum);
+void undo(size_t steps, token_t *last_msgp, stack_t *stks[]);
+void redo(size_t steps, token_t *last_msgp, stack_t *stks[]);
+// vet_do() without the stack size check
+void do_cmd(int *hist_flagp,
+            token_t *last_msgp,
+            RPN_T inputnum,
+            token_t cmd,
+            stack_t *stks[]);
+// how many H_NUMS do_cmd() moves there for cmd, rpnjit.c leaves as many
+size_t hist_nums(token_t cmd);
+
+
+token_t math_error(void);
 
 // ___ prototypes for when you write tests. not used in main ___________________
 
@@ -208,16 +376,12 @@ void print_cmdname(void *itemp);
 
 void toggle(int *flag);
 
-void undo(token_t *last_msgp, stack_t *stks[]);
-token_t math_error(void);
 void vet_do(int *hist_flagp,
             token_t *last_msgp,
             RPN_T inputnum,
             token_t cmd,
             stack_t *stks[]);
 
-token_t tokenize(char *inputbuf, RPN_T *inputnum);
-
 # endif // RPN_TEST
 #endif // RPNFUNCTIONS_H
 
@@ -0,0 +1,375 @@
+#include <stdlib.h>     // malloc(), free()
+#include <string.h>     // memcpy()
+#include <stdint.h>     // uint32_t, uint64_t
+#include <sys/mman.h>   // mmap(), mprotect()
+#include "rpnstack.h"
+#include "rpnpstack.h"
+#include "rpnfunctions.h"
+#include "rpnprog.h"
+#include "rpnopt.h"     // OPT_FAST
+#include "rpnbig.h"     // big_digits()
+#include "rpnjit.h"
+
+// rpnjit.c
+// x87 code for compiled lines
+
+/* ___ comments ________________________________________________________________
+
+the function is void fn(RPN_T *slots). slots 0 to need - 1 hold the top
+of the rpn stack, need - 1 the top, the line's results go back to slots
+0 to out - 1. the 8 slots after JIT_DEPTH are where the registers go
+while powe() and co. run, the x87 stack has to be empty for a call.
+the slots after those get what the line's cmds move to H_NUMS, in the
+order binary() and co. would push them, each stored and loaded back.
+long double args go on the stack, 16 bytes each, the result is in st(0).
+
+    push rbx; mov rbx, rdi; sub rsp, 32    the args at [rsp], [rsp + 16]
+    fld tbyte [rbx + 16 i]                 each slot the line needs
+    ... the insns
+    fstp tbyte [rbx + 16 i]                each result, top first
+    add rsp, 32; pop rbx; ret
+
+a number is fld tbyte [rip + disp], the numbers go after the code.
+x87 ops round to long double like the C ones, so the numbers are the same
+as rpnprog.c's, bit for bit, and so are the fp flags
+*/
+
+#define JIT_DEPTH 8u    // x87 registers
+
+int jit_enabled = 0;
+
+struct rpn_jit {
+    void (*fn)(RPN_T *slots);
+    void *mem;
+    size_t size;
+    size_t need;    // stack elements the line takes
+    size_t out;     // and leaves
+    RPN_T *slots;   // 2 JIT_DEPTH, then nhist for H_NUMS
+    size_t nhist;
+    token_t *cmds;  // for H_CMDS, as do_cmd() pushes them
+    size_t ncmds;
+};
+
+#if defined(__x86_64__) && !defined(RPN_FLOAT) && !defined(RPN_DOUBLE) \
+    && !defined(RPN_FLOAT128)
+
+typedef struct {
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+    size_t *fixups;     // where a disp32 to a number is
+    size_t nfixups;
+} code_t;
+
+// ___ helper functions ________________________________________________________
+
+static void emit(code_t *code, const unsigned char *bytes, size_t n) {
+    if (code->len + n > code->cap) {
+        code->cap = 2u * (code->len + n);
+        code->buf = realloc(code->buf, code->cap);
+        if (code->buf == NULL) {
+            stack_error("Failed to jit line");
+        }
+    }
+    memcpy(code->buf + code->len, bytes, n);
+    code->len += n;
+}
+
+#define EMIT(code, ...) do {                                                  \
+    const unsigned char bytes_[] = {__VA_ARGS__};                             \
+    emit((code), bytes_, sizeof(bytes_));                                     \
+} while (0)
+
+static void emit32(code_t *code, uint32_t v) {
+    EMIT(code, v & 0xffu, (v >> 8) & 0xffu, (v >> 16) & 0xffu, v >> 24);
+}
+
+// fld, fstp tbyte [rbx + 16 slot]
+static void fld_slot(code_t *code, size_t slot) {
+    EMIT(code, 0xdb, 0xab);
+    emit32(code, (uint32_t)(slot * sizeof(RPN_T)));
+}
+
+static void fstp_slot(code_t *code, size_t slot) {
+    EMIT(code, 0xdb, 0xbb);
+    emit32(code, (uint32_t)(slot * sizeof(RPN_T)));
+}
+
+// fld, fstp tbyte [rsp + off]
+static void fld_arg(code_t *code, unsigned char off) {
+    EMIT(code, 0xdb, 0x6c, 0x24, off);
+}
+
+static void fstp_arg(code_t *code, unsigned char off) {
+    EMIT(code, 0xdb, 0x7c, 0x24, off);
+}
+
+// fld tbyte [rip + disp], the number num of the line
+static void fld_num(code_t *code, size_t num) {
+    EMIT(code, 0xdb, 0x2d);
+    code->fixups[code->nfixups++] = code->len;
+    emit32(code, (uint32_t)num); // replaced once the code's length is known
+}
+
+// a copy of st(0), or of st(1), in the history slot
+static void hist_slot(code_t *code, int st1, size_t slot) {
+    if (st1) {
+        EMIT(code, 0xd9, 0xc9); // fxch st(1)
+    }
+    fstp_slot(code, slot);
+    fld_slot(code, slot);
+    if (st1) {
+        EMIT(code, 0xd9, 0xc9);
+    }
+}
+
+// fun(x) or fun(x, y) on the top of the depth registers
+static void emit_call(code_t *code, void *fun, size_t nargs, size_t depth) {
+    size_t rest = depth - nargs, k;
+    if (nargs == 2u) {
+        fstp_arg(code, 16u);
+    }
+    fstp_arg(code, 0u);
+    for (k = 0u; k < rest; k++) {
+        fstp_slot(code, JIT_DEPTH + k);
+    }
+    uint64_t addr = (uint64_t)(uintptr_t)fun;
+    EMIT(code, 0x48, 0xb8); // mov rax, imm64
+    emit32(code, (uint32_t)addr);
+    emit32(code, (uint32_t)(addr >> 32));
+    EMIT(code, 0xff, 0xd0); // call rax
+    if (rest) { // the result goes back on top of them
+        fstp_arg(code, 0u);
+        for (k = rest; k-- > 0u; ) {
+            fld_slot(code, JIT_DEPTH + k);
+        }
+        fld_arg(code, 0u);
+    }
+}
+
+// what the insn pops and pushes. 0 if it isn't jitted
+static int effect(const rpn_insn_t *insn, int level, size_t *popp,
+                  size_t *pushp)
+{
+    *pushp = 1u;
+    switch (insn->op) {
+    case NUM:
+        *popp = 0u;
+        return insn->imm == insn->imm; // a nan may be a vector
+    case MUL: case ADD: case POWE: case DIVI: case SUB: case ROOT:
+        *popp = 2u;
+        return 1;
+    case LOGN: case EXPE: case NEG: case INVE:
+        *popp = 1u;
+        return 1;
+    case MULA:
+        *popp = 1u;
+        return level != OPT_FAST; // x87 has no fma
+    case COPY:
+        *popp = 1u;
+        *pushp = 2u;
+        return 1;
+    case SWAP:
+        *popp = 2u;
+        *pushp = 2u;
+        return 1;
+    case DISC:
+        *popp = 1u;
+        *pushp = 0u;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void jit_free(struct rpn_jit *jit) {
+    free(jit->slots);
+    free(jit->cmds);
+    free(jit);
+}
+
+// ___ public functions ________________________________________________________
+
+struct rpn_jit *jit_compile(const rpn_prog_t *prog) {
+    size_t z, pop, push;
+    long depth = 0, low = 0, high = 0;
+    if (prog->ninsns == 0u) {
+        return NULL;
+    }
+    // how deep the line reaches into the stack, and how high it goes.
+    // a number, i and MULA need one more register for a moment
+    for (z = 0u; z < prog->ninsns; z++) {
+        if (!effect(&prog->insns[z], prog->level, &pop, &push)) {
+            return NULL;
+        }
+        depth -= (long)pop;
+        low = depth < low ? depth : low;
+        depth += (long)push;
+        long peak = depth + (prog->insns[z].op == INVE
+                             || prog->insns[z].op == MULA);
+        high = peak > high ? peak : high;
+    }
+    size_t need = (size_t)-low;
+    if (need > JIT_DEPTH || need + (size_t)high > JIT_DEPTH) {
+        return NULL;
+    }
+
+    code_t code = {NULL, 0u, 0u, NULL, 0u};
+    code.fixups = malloc(2u * prog->ninsns * sizeof(*code.fixups));
+    RPN_T *nums = malloc(2u * prog->ninsns * sizeof(*nums));
+    if (code.fixups == NULL || nums == NULL) {
+        stack_error("Failed to jit line");
+    }
+    size_t nnums = 0u;
+    EMIT(&code, 0x53, 0x48, 0x89, 0xfb, 0x48, 0x83, 0xec, 0x20);
+    for (z = 0u; z < need; z++) {
+        fld_slot(&code, z);
+    }
+    size_t d = need, nhist = 0u, n;
+    for (z = 0u; z < prog->ninsns; z++) {
+        const rpn_insn_t *insn = &prog->insns[z];
+        // top first, like transfer() in binary()
+        for (n = 0u; n < hist_nums(insn->op); n++) {
+            hist_slot(&code, (int)n, 2u * JIT_DEPTH + nhist++);
+        }
+        switch (insn->op) {
+        case NUM:
+            nums[nnums] = insn->imm;
+            fld_num(&code, nnums++);
+            break;
+        case ADD:  EMIT(&code, 0xde, 0xc1); break; // faddp st(1), st
+        case MUL:  EMIT(&code, 0xde, 0xc9); break; // fmulp st(1), st
+        case SUB:  EMIT(&code, 0xde, 0xe9); break; // fsubp, st(1) - st
+        case DIVI: EMIT(&code, 0xde, 0xf9); break; // fdivp, st(1) / st
+        case NEG:  EMIT(&code, 0xd9, 0xe0); break; // fchs
+        case INVE: EMIT(&code, 0xd9, 0xe8, 0xde, 0xf1); break; // fld1 fdivrp
+        case COPY: EMIT(&code, 0xd9, 0xc0); break; // fld st(0)
+        case SWAP: EMIT(&code, 0xd9, 0xc9); break; // fxch st(1)
+        case DISC: EMIT(&code, 0xdd, 0xd8); break; // fstp st(0)
+        case MULA:
+            nums[nnums] = insn->imm;
+            fld_num(&code, nnums++);
+            EMIT(&code, 0xde, 0xc9);
+            nums[nnums] = insn->imm2;
+            fld_num(&code, nnums++);
+            EMIT(&code, 0xde, 0xc1);
+            break;
+        case POWE: case ROOT:
+            emit_call(&code, funrows[insn->op].fun, 2u, d);
+            break;
+        default: // LOGN EXPE
+            emit_call(&code, funrows[insn->op].fun, 1u, d);
+        }
+        effect(insn, prog->level, &pop, &push);
+        d = d - pop + push;
+    }
+    for (z = d; z-- > 0u; ) {
+        fstp_slot(&code, z);
+    }
+    EMIT(&code, 0x48, 0x83, 0xc4, 0x20, 0x5b, 0xc3);
+
+    // the numbers after the code, 16 aligned
+    size_t numoff = (code.len + 15u) & ~(size_t)15u;
+    for (z = 0u; z < code.nfixups; z++) {
+        size_t at = code.fixups[z];
+        uint32_t num = code.buf[at] | code.buf[at + 1u] << 8
+                       | code.buf[at + 2u] << 16 | (uint32_t)code.buf[at + 3u] << 24;
+        uint32_t disp = (uint32_t)(numoff + num * sizeof(RPN_T) - (at + 4u));
+        memcpy(code.buf + at, &disp, sizeof(disp)); // little endian
+    }
+    struct rpn_jit *jit = malloc(sizeof(*jit));
+    if (jit == NULL) {
+        stack_error("Failed to jit line");
+    }
+    jit->slots = malloc((2u * JIT_DEPTH + nhist) * sizeof(*jit->slots));
+    jit->cmds = malloc(prog->ninsns * sizeof(*jit->cmds));
+    if (jit->slots == NULL || jit->cmds == NULL) {
+        stack_error("Failed to jit line");
+    }
+    jit->nhist = nhist;
+    jit->ncmds = 0u;
+    for (z = 0u; z < prog->ninsns; z++) { // every jitted op is in H_CMDS
+        jit->cmds[jit->ncmds++] = prog->insns[z].op;
+    }
+    jit->size = numoff + nnums * sizeof(RPN_T);
+    jit->mem = mmap(NULL, jit->size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->mem == MAP_FAILED) {
+        jit_free(jit);
+        jit = NULL;
+    } else {
+        memcpy(jit->mem, code.buf, code.len);
+        if (nnums) {
+            memcpy((char *)jit->mem + numoff, nums, nnums * sizeof(RPN_T));
+        }
+        if (mprotect(jit->mem, jit->size, PROT_READ | PROT_EXEC)) {
+            munmap(jit->mem, jit->size);
+            jit_free(jit);
+            jit = NULL;
+        } else {
+            *(void **)&jit->fn = jit->mem; // object to function pointer
+            jit->need = need;
+            jit->out = d;
+        }
+    }
+    free(code.buf);
+    free(code.fixups);
+    free(nums);
+    return jit;
+}
+
+void jit_destroy(struct rpn_jit *jit) {
+    if (jit) {
+        munmap(jit->mem, jit->size);
+        jit_free(jit);
+    }
+}
+
+int jit_run(struct rpn_jit *jit, stack_t *stks[]) {
+    stack_t *stk = stks[I_STK];
+    size_t size = stack_size(stk), z;
+    RPN_T *slots = jit->slots;
+    if (size < jit->need || stk->versions || big_digits()) {
+        return 0;
+    }
+    for (z = 0u; z < jit->need; z++) {
+        slots[z] = num_peek(size - jit->need + z, stk);
+        if (slots[z] != slots[z]) { // maybe a vector or a big
+            return 0;
+        }
+    }
+    for (z = 0u; z < jit->need; z++) {
+        num_pop(stk);
+    }
+    jit->fn(slots);
+    for (z = 0u; z < jit->out; z++) {
+        num_push(slots[z], stk);
+    }
+    // the history the cmds would have left, undo replays it
+    for (z = 0u; z < jit->ncmds; z++) {
+        cmd_push(jit->cmds[z], stks[H_CMDS]);
+    }
+    for (z = 0u; z < jit->nhist; z++) {
+        num_push(slots[2u * JIT_DEPTH + z], stks[H_NUMS]);
+    }
+    return 1;
+}
+
+#else // no jit, the insns run in rpnprog.c
+
+struct rpn_jit *jit_compile(const rpn_prog_t *prog) {
+    (void)prog;
+    return NULL;
+}
+
+void jit_destroy(struct rpn_jit *jit) {
+    (void)jit;
+}
+
+int jit_run(struct rpn_jit *jit, stack_t *stks[]) {
+    (void)jit;
+    (void)stks;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef RPNJIT_H
+#define RPNJIT_H
+#include "rpnstack.h"
+#include "rpnprog.h"
+
+// rpnjit.h
+// native code for hot compiled lines, ./rpn --jit. x86-64 and the long
+// double build: the x87 registers are a stack of 8, the line's part of the
+// rpn stack lives in them, st(0) is the top. numbers and + * - / ~ i c s d
+// are x87 instructions, ^ v e l call powe() root() expe() logn().
+// a jitted line leaves the history its cmds would, and undo replays it.
+// --jit turns the snapshots off, they'd need a version for each cmd.
+// lines with anything else, a stack too small for the line, or a vector
+// or big number on it run in rpnprog.c as before
+
+extern int jit_enabled;
+
+// NULL if the line can't be jitted
+struct rpn_jit *jit_compile(const rpn_prog_t *prog);
+void jit_destroy(struct rpn_jit *jit);
+
+// 0 if it didn't run, the insns have to
+int jit_run(struct rpn_jit *jit, stack_t *stks[]);
+
+#endif // RPNJIT_H
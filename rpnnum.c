@@ -0,0 +1,352 @@
+#include <stdio.h>      // snprintf()
+#include <stdlib.h>     // strtold(), RPN_STRTO
+#include <string.h>     // memcpy()
+#include <strings.h>    // strncasecmp()
+#include <stdint.h>     // uint64_t
+#include <math.h>       // ldexpl(), RPN_LDEXP, INFINITY, NAN
+#include "rpnfunctions.h"
+#include "rpnnum.h"
+
+// rpnnum.c
+// reading and writing numbers
+
+/* ___ comments ________________________________________________________________
+
+Clinger's fast path: a decimal with a mantissa m that fits in RPN_T and a
+power of ten that is exact in RPN_T is m * 10^e or m / 10^-e, one correctly
+rounded operation. that's the same number strtold() gives.
+long double has a 64 bit mantissa. 10^27 = 2^27 * 5^27 and 5^27 < 2^64,
+so 10^0 to 10^27 are exact. 19 decimal digits always fit in 64 bits.
+the other backends have their own RPN_MANT_DIG and RPN_POW10_EXACT, a
+mantissa over RPN_MANT_DIG bits goes the slow way, RPN_STRTO().
+
+hex is exact as long as the mantissa fits, ldexpl() only changes the
+exponent. subnormal and huge results go the slow way.
+
+x87 must compute in extended precision for this, the default on linux.
+float and double are SSE on x86-64, no double rounding either.
+
+writing is the other way around: %.<prec>Lg wants the exponent X of num
+and the prec digits m = num * 10^(prec - 1 - X), rounded to nearest even.
+with an exact power of ten the product is off by at most half an ulp,
+2^-64 relative. unless that lands near .5, where rounding could go either
+way, rounding the product gives the digits printf() finds. near .5 and
+for the rest, nonfinite nums and big exponents, it's snprintf()
+float has too few bits to decide 7 digits this way, it's always snprintf()
+
+shortest round trip: the smallest prec that num_parse() reads back as num.
+prec RPN_ROUNDTRIP_DIG always does, 21 for long double
+*/
+
+#define NUM_POW10_MAX  RPN_POW10_EXACT
+
+// 10^0 to 10^NUM_POW10_MAX, all exact. multiplied up, there's no literal
+// suffix for every RPN_T
+static RPN_LOCAL RPN_T pow10s[NUM_POW10_MAX + 1];
+static RPN_LOCAL int pow10s_ready = 0;
+
+// ___ helper functions ________________________________________________________
+
+static void init_pow10s(void) {
+    int i;
+    pow10s[0] = RPN_ONE;
+    for (i = 1; i <= NUM_POW10_MAX; i++) {
+        pow10s[i] = pow10s[i - 1] * 10;
+    }
+    pow10s_ready = 1;
+}
+
+// fits in RPN_T without rounding
+static int mant_fits(uint64_t mant) {
+    return RPN_MANT_DIG >= 64 || mant >> (RPN_MANT_DIG % 64) == 0u;
+}
+
+static int is_digit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+static int hex_value(char ch) {
+    if (ch >= '0' && ch <= '9') { return ch - '0'; }
+    if (ch >= 'a' && ch <= 'f') { return ch - 'a' + 10; }
+    if (ch >= 'A' && ch <= 'F') { return ch - 'A' + 10; }
+    return -1;
+}
+
+// [eEpP][+-]digits. leaves *strp alone if there are no digits, like strtold
+static int parse_exponent(const char **strp, long *expp) {
+    const char *str = *strp + 1;
+    int negative = 0;
+    if (*str == '+' || *str == '-') {
+        negative = (*str++ == '-');
+    }
+    if (!is_digit(*str)) {
+        return 0;
+    }
+    long exp = 0;
+    while (is_digit(*str)) {
+        if (exp < 100000) { // saturate, the slow path gets it anyway
+            exp = exp * 10 + (*str - '0');
+        }
+        str++;
+    }
+    *expp = negative ? -exp : exp;
+    *strp = str;
+    return 1;
+}
+
+// str is after the 0x. returns 0 if it needs the slow path
+static int parse_hex(const char *str, const char **endp, RPN_T *nump) {
+    uint64_t mant = 0u;
+    long exp2 = 0;
+    int ndigits = 0, seen_dot = 0, any = 0, value;
+    for (;; str++) {
+        if (*str == '.' && !seen_dot) {
+            seen_dot = 1;
+            continue;
+        }
+        value = hex_value(*str);
+        if (value < 0) {
+            break;
+        }
+        any = 1;
+        if (mant == 0u && value == 0) { // leading zeros
+            exp2 -= seen_dot ? 4 : 0;
+            continue;
+        }
+        if (++ndigits > 16) {
+            return 0;
+        }
+        mant = mant << 4 | (uint64_t)value;
+        exp2 -= seen_dot ? 4 : 0;
+    }
+    if (!any || !mant_fits(mant)) {
+        return 0; // "0x" alone, strtold reads the 0
+    }
+    long exp = 0;
+    if ((*str == 'p' || *str == 'P') && parse_exponent(&str, &exp)) {
+        exp2 += exp;
+    }
+    // normal, 2^exp2 <= num < 2^(exp2 + 64)
+    if (exp2 < RPN_MIN_EXP - 1 || exp2 + 64 > RPN_MAX_EXP) {
+        return 0;
+    }
+    *nump = RPN_LDEXP((RPN_T)mant, (int)exp2);
+    *endp = str;
+    return 1;
+}
+
+// returns 0 if it needs the slow path
+static int parse_decimal(const char *str, const char **endp, RPN_T *nump) {
+    uint64_t mant = 0u;
+    long exp10 = 0;
+    int ndigits = 0, seen_dot = 0, any = 0;
+    for (;; str++) {
+        if (*str == '.' && !seen_dot) {
+            seen_dot = 1;
+            continue;
+        }
+        if (!is_digit(*str)) {
+            break;
+        }
+        any = 1;
+        if (mant == 0u && *str == '0') { // leading zeros
+            exp10 -= seen_dot;
+            continue;
+        }
+        if (++ndigits > 19) {
+            return 0;
+        }
+        mant = mant * 10u + (uint64_t)(*str - '0');
+        exp10 -= seen_dot;
+    }
+    if (!any || !mant_fits(mant)) {
+        return 0;
+    }
+    long exp = 0;
+    if ((*str == 'e' || *str == 'E') && parse_exponent(&str, &exp)) {
+        exp10 += exp;
+    }
+    if (mant == 0u) {
+        *nump = RPN_ZERO;
+    } else if (exp10 >= 0 && exp10 <= NUM_POW10_MAX) {
+        *nump = (RPN_T)mant * pow10s[exp10];
+    } else if (exp10 < 0 && exp10 >= -NUM_POW10_MAX) {
+        *nump = (RPN_T)mant / pow10s[-exp10];
+    } else {
+        return 0;
+    }
+    *endp = str;
+    return 1;
+}
+
+// the digits of m into buf, ndigits of them, leading zeros too
+static void write_digits(char *buf, uint64_t m, int ndigits) {
+    int i;
+    for (i = ndigits - 1; i >= 0; i--) {
+        buf[i] = '0' + m % 10u;
+        m /= 10u;
+    }
+}
+
+// %.<prec>Lg of m * 10^(X - prec + 1), where m has exactly prec digits
+static size_t write_g(char *buf, int negative, uint64_t m, int prec, int X) {
+    char digits[20];
+    char *out = buf;
+    int n = prec; // digits after trailing zeros are removed
+    write_digits(digits, m, prec);
+    while (n > 1 && digits[n - 1] == '0') {
+        n--;
+    }
+    if (negative) {
+        *out++ = '-';
+    }
+    if (X >= -4 && X < prec) {  // fixed
+        if (X < 0) {
+            *out++ = '0';
+            *out++ = '.';
+            memset(out, '0', -X - 1);
+            out += -X - 1;
+            memcpy(out, digits, n);
+            out += n;
+        } else if (n <= X + 1) { // no fraction left
+            memcpy(out, digits, n);
+            memset(out + n, '0', X + 1 - n);
+            out += X + 1;
+        } else {
+            memcpy(out, digits, X + 1);
+            out += X + 1;
+            *out++ = '.';
+            memcpy(out, digits + X + 1, n - X - 1);
+            out += n - X - 1;
+        }
+    } else {                    // exponent
+        *out++ = digits[0];
+        if (n > 1) {
+            *out++ = '.';
+            memcpy(out, digits + 1, n - 1);
+            out += n - 1;
+        }
+        *out++ = 'e';
+        *out++ = X < 0 ? '-' : '+';
+        int absx = X < 0 ? -X : X;
+        int nexp = absx >= 1000 ? 4 : absx >= 100 ? 3 : 2;
+        write_digits(out, (uint64_t)absx, nexp);
+        out += nexp;
+    }
+    *out = '\0';
+    return out - buf;
+}
+
+// the fast way to num_format(). returns 0 when it has to be snprintf()
+static size_t format_fast(char *buf, RPN_T num, int prec) {
+    if (prec < 1 || prec > 19 || prec > NUM_POW10_MAX || !isfinite(num)) {
+        return 0u;
+    }
+    // the error is under 2^-MANT_DIG of scaled, under 10^prec * 2^-MANT_DIG
+    RPN_T margin = RPN_LDEXP(pow10s[prec], 2 - RPN_MANT_DIG);
+    if (margin >= 0.25) { // can't tell, float
+        return 0u;
+    }
+    int negative = signbit(num) != 0;
+    RPN_T absnum = negative ? -num : num;
+    if (absnum == RPN_ZERO) {
+        return write_g(buf, negative, 0u, 1, 0);
+    }
+    // X from the binary exponent, off by one at most
+    int X = (int)floor(RPN_ILOGB(absnum) * 0.30102999566398119521);
+    int tries;
+    for (tries = 0; tries < 3; tries++) {
+        int scale = prec - 1 - X;
+        if (scale > NUM_POW10_MAX || scale < -NUM_POW10_MAX) {
+            return 0u;
+        }
+        RPN_T scaled = scale >= 0 ? absnum * pow10s[scale]
+                                  : absnum / pow10s[-scale];
+        RPN_T whole = RPN_FLOOR(scaled);
+        RPN_T frac = scaled - whole;
+        if (RPN_FABS(frac - RPN_ONE / 2) <= margin) { // an RPN_T for fabsf()
+            return 0u; // too close to call
+        }
+        RPN_T rounded = frac > 0.5 ? whole + 1 : whole;
+        if (rounded >= pow10s[prec]) {
+            X++;
+        } else if (rounded < pow10s[prec - 1]) {
+            X--;
+        } else {
+            return write_g(buf, negative, (uint64_t)rounded, prec, X);
+        }
+    }
+    return 0u;
+}
+
+// ___ public functions ________________________________________________________
+
+RPN_T num_parse(const char *str, const char **endp) {
+    const char *start = str;
+    const char *end = str;
+    int negative = 0;
+    RPN_T num = RPN_ZERO;
+    if (!pow10s_ready) {
+        init_pow10s();
+    }
+    if (*str == '+' || *str == '-') {
+        negative = (*str++ == '-');
+    }
+    int fast;
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        fast = parse_hex(str + 2, &end, &num);
+    } else if (is_digit(*str) || *str == '.') {
+        fast = parse_decimal(str, &end, &num);
+    } else if (!strncasecmp(str, "inf", 3)) {
+        fast = 1;
+        num = INFINITY;
+        end = str + (strncasecmp(str, "infinity", 8) ? 3 : 8);
+    } else if (!strncasecmp(str, "nan", 3) && str[3] != '(') {
+        fast = 1;
+        num = NAN; // strtold("nan") is the positive quiet nan too
+        end = str + 3;
+    } else {
+        fast = 0;
+    }
+    if (!fast) {
+        char *slow_end;
+        num = RPN_STRTO(start, &slow_end);
+        if (endp) {
+            *endp = slow_end;
+        }
+        return num;
+    }
+    if (endp) {
+        *endp = end;
+    }
+    return negative ? -num : num;
+}
+
+size_t num_format(char *buf, RPN_T num, int prec) {
+    if (!pow10s_ready) {
+        init_pow10s();
+    }
+    size_t len = format_fast(buf, num, prec);
+    if (len == 0u) {
+        len = (size_t)RPN_SNPRINTF(buf, NUM_BUFSIZ, prec, num);
+    }
+    return len;
+}
+
+// prec that round trips is monotonic, so binary search it
+size_t num_format_shortest(char *buf, RPN_T num) {
+    if (!isfinite(num)) {
+        return num_format(buf, num, 1);
+    }
+    int lo = 1, hi = RPN_ROUNDTRIP_DIG; // hi always round trips
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        num_format(buf, num, mid);
+        if (num_parse(buf, NULL) == num) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return num_format(buf, num, lo);
+}
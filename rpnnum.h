@@ -0,0 +1,20 @@
+#ifndef RPNNUM_H
+#define RPNNUM_H
+#include "rpnfunctions.h" // RPN_T
+
+// rpnnum.h
+// reading and writing numbers. the same results as strtold() and printf(),
+// bit for bit, but the common cases don't go through them
+
+#define NUM_BUFSIZ 64 // enough for any number num_format() writes
+
+// like strtold(str, endp). str doesn't need to end after the number
+RPN_T num_parse(const char *str, const char **endp);
+
+// like snprintf(buf, NUM_BUFSIZ, "%.*Lg", prec, num), or the RPN_T's own
+// format. returns the length
+size_t num_format(char *buf, RPN_T num, int prec);
+// the fewest digits that num_parse() reads back to the same num
+size_t num_format_shortest(char *buf, RPN_T num);
+
+#endif // RPNNUM_H
@@ -0,0 +1,164 @@
+#include <fenv.h>       // fetestexcept(), fegetexceptflag()
+#include "rpnfunctions.h"
+#include "rpnprog.h"
+#include "rpnopt.h"
+
+// rpnopt.c
+// peephole optimizer for compiled lines
+
+/* ___ comments ________________________________________________________________
+
+each insn is appended to the insns kept so far, then the rules are tried on
+the end of them until none fits. so "2 3 * 4 +" folds 2 3 * when * comes,
+then 6 4 + when + comes. a rule only ever makes the line shorter, or keeps
+its length, so the output fits where the input was.
+
+a fold is done at compile time with the same RPN_T functions the cmd would
+call, which is what keeps OPT_EXACT exact. a fold that raises an fp flag
+isn't done, the line raises it when it runs, like it did. nans aren't
+folded: a NUM nan may be a vector, rpnvec.h
+*/
+
+int opt_level = OPT_OFF;
+
+// ___ helper functions ________________________________________________________
+
+static int is_const(const rpn_insn_t *insn) {
+    return insn->op == NUM && insn->imm == insn->imm;
+}
+
+// op applied to x, y as the cmd would, into *resultp. 0 if that raised
+static int fold(token_t op, RPN_T x, RPN_T y, RPN_T *resultp) {
+    fexcept_t flags;
+    RPN_T result;
+    fegetexceptflag(&flags, FE_ALL_EXCEPT);
+    feclearexcept(FE_ALL_EXCEPT);
+    if (op == NEG) {
+        result = -x;
+    } else if (op == INVE) {
+        result = RPN_ONE / x;
+    } else if (funrows[op].type == UNARY) {
+        unary_fun_t unaryp = funrows[op].fun;
+        result = unaryp(x);
+    } else {
+        binary_fun_t binaryp = funrows[op].fun;
+        result = binaryp(x, y);
+    }
+    int raised = fetestexcept(FE_DIVBYZERO | FE_OVERFLOW | FE_UNDERFLOW
+                              | FE_INVALID);
+    fesetexceptflag(&flags, FE_ALL_EXCEPT);
+    if (raised || result != result) {
+        return 0;
+    }
+    *resultp = result;
+    return 1;
+}
+
+// how many numbers the first n insns have surely put on the stack, over
+// what the line found there. a cmd that fails leaves the stack as it was,
+// one that can take more than it finds counts as taking everything
+static size_t pushed(const rpn_insn_t *insns, size_t n) {
+    size_t depth = 0u, z;
+    for (z = 0u; z < n; z++) {
+        token_t op = insns[z].op;
+        if (op == NUM) {
+            depth++;
+        } else if (funrows[op].type == BINARY) {
+            depth = depth > 1u ? depth - 1u : depth;
+        } else if (op == COPY) {
+            depth = depth ? depth + 1u : 0u;
+        } else if (funrows[op].type != UNARY && op != MULA && op != NEG
+                   && op != INVE && op != SWAP && op != ROLD && op != ROLU) {
+            depth = 0u;
+        }
+    }
+    return depth;
+}
+
+// one rule on the n insns ending at end. returns 1 if one fit
+static int rewrite(rpn_insn_t *insns, size_t *np, int level) {
+    size_t n = *np;
+    rpn_insn_t *t = insns + n; // t[-1] is the last
+    RPN_T r;
+    if (n >= 3u && is_const(&t[-3]) && is_const(&t[-2])
+        && funrows[t[-1].op].type == BINARY
+        && fold(t[-1].op, t[-3].imm, t[-2].imm, &r))
+    {   // a b op
+        t[-3].imm = r;
+        *np -= 2u;
+        return 1;
+    }
+    if (n >= 2u && is_const(&t[-2])
+        && (t[-1].op == LOGN || t[-1].op == EXPE || t[-1].op == NEG
+            || t[-1].op == INVE)
+        && fold(t[-1].op, t[-2].imm, RPN_ZERO, &r))
+    {   // a op
+        t[-2].imm = r;
+        *np -= 1u;
+        return 1;
+    }
+    if (n >= 2u && funrows[t[-2].op].type == NONHIST
+        && funrows[t[-2].op].anti == t[-1].op
+        && (t[-1].op != INVE || level == OPT_FAST))
+    {   // ~ ~, s s, r u. i i isn't x again
+        *np -= 2u;
+        return 1;
+    }
+    if (level == OPT_FAST && n >= 2u && is_const(&t[-2])
+        && (t[-1].op == SUB || t[-1].op == DIVI) && pushed(insns, n - 2u))
+    {   // only with x there, "a /" alone leaves a, not 1/a
+        if (t[-1].op == SUB) { // x a - is x -a +
+            t[-2].imm = -t[-2].imm;
+            t[-1].op = ADD;
+            return 1;
+        }
+        if (t[-1].op == DIVI && fold(INVE, t[-2].imm, RPN_ZERO, &r)) {
+            t[-2].imm = r;
+            t[-1].op = MUL;
+            return 1;
+        }
+    }
+    if (level == OPT_FAST && n >= 4u && is_const(&t[-4]) && is_const(&t[-2])
+        && (t[-3].op == ADD || t[-3].op == MUL) && t[-1].op == t[-3].op
+        && fold(t[-1].op, t[-4].imm, t[-2].imm, &r))
+    {   // x a + b +
+        t[-4].imm = r;
+        *np -= 2u;
+        return 1;
+    }
+    if (n >= 4u && is_const(&t[-4]) && t[-3].op == MUL && is_const(&t[-2])
+        && (t[-1].op == ADD || t[-1].op == SUB))
+    {   // x a * b +. x a * -b + is the same number as x a * b -
+        RPN_T b = t[-1].op == SUB ? -t[-2].imm : t[-2].imm;
+        t[-4].op = MULA;
+        t[-4].minsz = funrows[MULA].minsz;
+        t[-4].imm2 = b;
+        *np -= 3u;
+        return 1;
+    }
+    if (level == OPT_FAST && n >= 3u && t[-3].op == MULA
+        && is_const(&t[-2]) && t[-1].op == ADD
+        && fold(ADD, t[-3].imm2, t[-2].imm, &r))
+    {   // x a * b + c +
+        t[-3].imm2 = r;
+        *np -= 2u;
+        return 1;
+    }
+    return 0;
+}
+
+// ___ public functions ________________________________________________________
+
+size_t opt_insns(rpn_insn_t *insns, size_t ninsns, int level) {
+    size_t n = 0u, z;
+    if (level == OPT_OFF) {
+        return ninsns;
+    }
+    for (z = 0u; z < ninsns; z++) {
+        insns[n++] = insns[z];
+        while (rewrite(insns, &n, level)) {
+            continue;
+        }
+    }
+    return n;
+}
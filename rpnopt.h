@@ -0,0 +1,24 @@
+#ifndef RPNOPT_H
+#define RPNOPT_H
+#include <stddef.h>     // size_t
+#include "rpnprog.h"    // rpn_insn_t
+
+// rpnopt.h
+// a peephole pass over a compiled line, for batch mode.
+// OPT_EXACT leaves the numbers the same, bit for bit: constants are
+// folded, "2 3 * 4 +" is 10, the pairs in funrows' anti column go,
+// "~ ~" "s s" "r u", and "a * b +" or "a * b -" is one insn, MULA.
+// OPT_FAST rounds MULA once, RPN_FMA, reassociates "a + b +" to
+// "a b + +" and "a * b *" the same way, divides by multiplying with the
+// reciprocal and drops "i i". "a -" and "a /" are rewritten only where the
+// line itself put their x on the stack, "a /" alone must leave a.
+// undo would see the line it was optimized to, 10 as one number, MULA as
+// one step, so rpn.c only sets a level for lines whose history goes with
+// them, --independent and -e. a line with _ y or p isn't optimized
+enum {OPT_OFF, OPT_EXACT, OPT_FAST};
+extern int opt_level;
+
+// rewrites the ninsns insns in place, returns how many are left
+size_t opt_insns(rpn_insn_t *insns, size_t ninsns, int level);
+
+#endif // RPNOPT_H
@@ -0,0 +1,372 @@
+#include <stdio.h>      // fflush()
+#include <stdlib.h>     // malloc()
+#include <string.h>     // memcpy()
+#include <errno.h>
+#include <unistd.h>     // write()
+#include <sys/ioctl.h>  // TIOCGWINSZ
+#include "rpnfunctions.h"
+#include "rpnnum.h"
+#include "rpnvec.h"
+#include "rpnbig.h"
+#include "rpnout.h"
+
+// rpnout.c
+// buffered output
+
+/* ___ comments ________________________________________________________________
+
+diff rendering. a frame is rows of text ending in the prompt. the last frame
+is kept, and the cursor is somewhere below its prompt: on the row after the
+user's input and the messages. out_below() counts those rows.
+
+if the whole last frame is still on the screen, the rows are reached with
+cursor up and newlines, relative to where the cursor is. that doesn't care
+about where on the screen the frame is, and scrollback stays as it was.
+within a row only the part that changed is written: a push changes the
+index of every row, "   4: 1.5" -> "   5: 1.5" is a cursor move and a "5".
+the prompt row is always written, and everything below it cleared.
+
+anything unsure, no terminal size, a row as wide as the terminal, a frame
+that scrolled away, and it's the full frame printed after the last one
+*/
+
+#define OUT_BUFSIZ  (1u << 16)
+#define OUT_PREC    RPN_PREC // the 10 of RPN_FMT "%.10Lg"
+
+static RPN_LOCAL char outbuf[OUT_BUFSIZ];
+static RPN_LOCAL size_t outlen = 0u;
+static RPN_LOCAL out_sink_t *out_sink = NULL;
+static RPN_LOCAL out_sink_t *err_sink = NULL;
+static int roundtrip = 0;
+
+static int render = 0;
+static int in_frame = 0;
+static int frame_broken = 0;    // the frame didn't fit in outbuf
+static char *last_frame = NULL; // NULL: nothing to diff against
+static size_t last_len = 0u;
+static size_t last_rows = 0u;   // the prompt is on row last_rows - 1
+static size_t below = 0u;
+static size_t term_cols = 0u;
+
+// ___ helper functions ________________________________________________________
+
+static void out_write(const char *data, size_t len) {
+    if (out_sink) {
+        out_sink_append(out_sink, data, len);
+        return;
+    }
+    while (len > 0u) {
+        ssize_t n = write(1, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return; // stdout is gone, as with printf()
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+// room for len more, a full buffer goes out mid line
+static void out_reserve(size_t len) {
+    if (outlen + len > OUT_BUFSIZ) {
+        frame_broken |= in_frame;
+        out_flush();
+    }
+}
+
+// 0u if stdout isn't a terminal
+static size_t term_size(size_t *colsp) {
+    struct winsize ws;
+    if (ioctl(1, TIOCGWINSZ, &ws) < 0 || ws.ws_row == 0u) {
+        *colsp = 0u;
+        return 0u;
+    }
+    *colsp = ws.ws_col;
+    return ws.ws_row;
+}
+
+// where the rows start, and how many. 0u if a row is too wide to count
+static size_t split_rows(const char *text, size_t len, size_t *starts,
+                         size_t maxrows, size_t cols) {
+    size_t rows = 0u, i, start = 0u;
+    for (i = 0u; i <= len; i++) {
+        if (i == len || text[i] == '\n') {
+            if (rows == maxrows || i - start >= cols) {
+                return 0u;
+            }
+            starts[rows++] = start;
+            start = i + 1u;
+        }
+    }
+    return rows;
+}
+
+// escape sequences go straight into a small buffer, not through outbuf
+static size_t put_esc(char *out, size_t n, char code) {
+    return (size_t)sprintf(out, "\033[%zu%c", n, code);
+}
+
+// the rows of frame that differ from last_frame, then the prompt.
+// cur is the row the cursor is on, counting from the first row of the frames
+static void send_diff(const char *frame, size_t len, size_t *starts,
+                      size_t rows, size_t *last_starts, size_t cur)
+{
+    char *diff = malloc(len * 2u + 64u * rows + 64u);
+    if (diff == NULL) {
+        out_write(frame, len);
+        return;
+    }
+    char *out = diff;
+    size_t r;
+    for (r = 0u; r < rows; r++) {
+        const char *row = frame + starts[r];
+        size_t rowlen = (r + 1u < rows ? starts[r + 1u] - 1u : len) - starts[r];
+        size_t from = 0u, oldlen = 0u;
+        if (r + 1u < last_rows && r + 1u < rows) { // prompts are rewritten
+            const char *old = last_frame + last_starts[r];
+            oldlen = last_starts[r + 1u] - 1u - last_starts[r];
+            while (from < rowlen && from < oldlen && row[from] == old[from]) {
+                from++;
+            }
+            if (from == rowlen && rowlen == oldlen) {
+                continue;
+            }
+            // same length: stop at the last difference, "4" -> "5"
+            if (rowlen == oldlen && r + 1u < rows) {
+                size_t to = rowlen;
+                while (to > from && row[to - 1u] == old[to - 1u]) {
+                    to--;
+                }
+                rowlen = to;
+                oldlen = to;
+            }
+        }
+        if (r < cur) {
+            out += put_esc(out, cur - r, 'A');
+            cur = r;
+        }
+        for (; cur < r; cur++) {
+            *out++ = '\n'; // down, and scrolls if the frame grew
+        }
+        *out++ = '\r';
+        if (from < 5u) { // the cursor move would be longer
+            from = 0u;
+        } else {
+            out += put_esc(out, from, 'C');
+        }
+        memcpy(out, row + from, rowlen - from);
+        out += rowlen - from;
+        if (rowlen < oldlen || r + 1u >= last_rows || r + 1u == rows) {
+            out += sprintf(out, "\033[K");
+        }
+    }
+    out += sprintf(out, "\033[J"); // old input and messages below the prompt
+    out_write(diff, out - diff);
+    free(diff);
+}
+
+// ___ public functions ________________________________________________________
+
+void out_flush(void) {
+    if (out_sink == NULL) { // printf()s don't go to a sink, no need
+        fflush(stdout);
+    }
+    out_write(outbuf, outlen);
+    if (render && !in_frame) { // dump_stack() lines go below the frame
+        size_t i, width = 0u;
+        for (i = 0u; i < outlen; i++) {
+            if (outbuf[i] == '\n') {
+                below++;
+                width = 0u;
+            } else if (term_cols && width++ == term_cols) { // wrapped
+                below++;
+                width = 1u;
+            }
+        }
+    }
+    outlen = 0u;
+}
+
+void out_set_sinks(out_sink_t *out, out_sink_t *err) {
+    out_sink = out;
+    err_sink = err;
+}
+
+void out_sink_append(out_sink_t *sink, const char *data, size_t len) {
+    if (sink->len + len > sink->cap) {
+        size_t cap = 2u * (sink->len + len);
+        char *data = realloc(sink->data, cap);
+        if (data == NULL) {
+            stack_error("Failed to grow output buffer");
+        }
+        sink->data = data;
+        sink->cap = cap;
+    }
+    memcpy(sink->data + sink->len, data, len);
+    sink->len += len;
+}
+
+void out_err(const char *str) {
+    if (err_sink) {
+        out_sink_append(err_sink, str, strlen(str));
+        return;
+    }
+    fflush(stdout); // after what the lines before it printed
+    fputs(str, stderr);
+}
+
+void out_char(char ch) {
+    out_reserve(1u);
+    outbuf[outlen++] = ch;
+}
+
+void out_str(const char *str) {
+    size_t len = strlen(str);
+    if (len > OUT_BUFSIZ) {
+        out_flush();
+        out_write(str, len);
+        return;
+    }
+    out_reserve(len);
+    memcpy(outbuf + outlen, str, len);
+    outlen += len;
+}
+
+void out_num(RPN_T num) {
+    if (vec_is(num)) {
+        out_vec(num, (size_t)-1);
+        return;
+    }
+    if (big_is(num)) {
+        size_t size = big_format_size(num);
+        if (size > OUT_BUFSIZ) {
+            char *buf = malloc(size);
+            if (buf == NULL) {
+                return;
+            }
+            size_t len = big_format(buf, num);
+            out_flush();
+            out_write(buf, len);
+            free(buf);
+            return;
+        }
+        out_reserve(size);
+        outlen += big_format(outbuf + outlen, num);
+        return;
+    }
+    out_reserve(NUM_BUFSIZ);
+    if (roundtrip) {
+        outlen += num_format_shortest(outbuf + outlen, num);
+    } else {
+        outlen += num_format(outbuf + outlen, num, OUT_PREC);
+    }
+}
+
+// [a b c], or the first limit elements then "...] (len)"
+void out_vec(RPN_T num, size_t limit) {
+    rpn_vec_t *vec = vec_get(num);
+    size_t z;
+    out_char('[');
+    for (z = 0u; z < vec->len && z < limit; z++) {
+        if (z) {
+            out_char(' ');
+        }
+        out_num(vec->data[z]);
+    }
+    if (z < vec->len) {
+        out_str(" ...] (");
+        out_num((RPN_T)vec->len);
+        out_char(')');
+        return;
+    }
+    out_char(']');
+}
+
+// right aligned in 4, like the printf() it replaces
+void out_index(size_t index) {
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = '0' + index % 10u;
+        index /= 10u;
+    } while (index);
+    out_reserve(n + 6u);
+    for (; n < 4; n++) {
+        digits[n] = ' ';
+    }
+    while (n) {
+        outbuf[outlen++] = digits[--n];
+    }
+    outbuf[outlen++] = ':';
+    outbuf[outlen++] = ' ';
+}
+
+void out_set_roundtrip(int on) {
+    roundtrip = on;
+}
+
+
+void out_set_render(int on) {
+    render = on;
+    free(last_frame);
+    last_frame = NULL;
+}
+
+void out_frame_begin(void) {
+    out_flush();
+    in_frame = 1;
+    frame_broken = 0;
+}
+
+void out_frame(void) {
+    in_frame = 0;
+    if (!render || frame_broken) {
+        out_flush();
+        free(last_frame);
+        last_frame = NULL;
+        return;
+    }
+    fflush(stdout);
+    size_t cols, term_rows = term_size(&cols);
+    size_t maxrows = term_rows ? term_rows : 1u;
+    size_t *starts = malloc(2u * maxrows * sizeof(*starts));
+    size_t rows = 0u, old_rows = 0u;
+    if (starts && term_rows) {
+        rows = split_rows(outbuf, outlen, starts, maxrows, cols);
+    }
+    if (rows && last_frame && cols == term_cols) {
+        old_rows = split_rows(last_frame, last_len, starts + maxrows,
+                              maxrows, cols);
+    }
+    // the cursor is below rows we can get back to, all of the last frame
+    if (old_rows && old_rows == last_rows && last_rows - 1u + below < term_rows) {
+        send_diff(outbuf, outlen, starts, rows, starts + maxrows,
+                  last_rows - 1u + below);
+    } else {
+        out_write(outbuf, outlen);
+    }
+    char *keep = rows ? malloc(outlen) : NULL;
+    free(last_frame);
+    last_frame = keep;
+    if (keep) {
+        memcpy(keep, outbuf, outlen);
+        last_len = outlen;
+        last_rows = rows;
+    }
+    term_cols = cols;
+    below = 0u;
+    outlen = 0u;
+    free(starts);
+}
+
+void out_below(size_t lines) {
+    below += lines;
+}
+
+// the prompt, then len chars, then the newline that ended the line
+void out_echoed(size_t len) {
+    size_t width = strlen(rpn_prompt) + len;
+    below += term_cols ? width / term_cols + 1u : 1u;
+}
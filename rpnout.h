@@ -0,0 +1,45 @@
+#ifndef RPNOUT_H
+#define RPNOUT_H
+#include <stddef.h> // size_t
+#include "rpnfunctions.h" // RPN_T
+
+// rpnout.h
+// output goes into one buffer and out with one write() per line or display
+// frame. out_flush() flushes stdout first, so printf()s elsewhere stay in
+// order as long as the out_*() calls end with out_flush()
+
+void out_char(char ch);
+void out_str(const char *str);
+void out_num(RPN_T num);            // RPN_FMT, or shortest round trip
+void out_vec(RPN_T num, size_t limit); // a vector, limit elements of it
+void out_index(size_t index);       // "%4zu: "
+void out_flush(void);
+
+// a thread of --independent collects its output here instead of writing
+// it, rpnpar.c writes it in the order of the lines. err is for stderr.
+// NULL, NULL: back to writing
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} out_sink_t;
+void out_set_sinks(out_sink_t *out, out_sink_t *err);
+void out_sink_append(out_sink_t *sink, const char *data, size_t len);
+// str to stderr, after what's been written to stdout
+void out_err(const char *str);
+
+// 1: out_num() writes the fewest digits that read back the same
+void out_set_roundtrip(int on);
+
+// display frames. between out_frame_begin() and out_frame() the frame is
+// collected, out_frame() sends it. with render on, it sends only the rows
+// that changed since the last frame, by moving the cursor back up to them
+void out_set_render(int on); // on for a terminal
+void out_frame_begin(void);
+void out_frame(void);
+// what went to the terminal below the last frame, so out_frame() knows how
+// far up it is. lines of messages, and the line the user typed
+void out_below(size_t lines);
+void out_echoed(size_t len);
+
+#endif // RPNOUT_H
@@ -0,0 +1,535 @@
+#include <stdio.h>      // perror()
+#include <stdlib.h>     // malloc(), free()
+#include <string.h>     // memchr(), memcpy(), strlen()
+#include <errno.h>
+#include <math.h>       // NAN
+#include <fcntl.h>      // open()
+#include <unistd.h>     // read(), write(), sysconf()
+#include <time.h>       // clock_gettime()
+#include <sys/mman.h>   // mmap()
+#include <sys/stat.h>   // fstat()
+#include <pthread.h>
+#include "rpnstack.h"
+#include "rpnpstack.h"
+#include "rpnfunctions.h"
+#include "rpnprog.h"
+#include "rpnbig.h"     // big_set_digits()
+#include "rpnjit.h"     // jit_enabled
+#include "rpnword.h"    // word_share()
+#include "rpnnum.h"     // num_parse()
+#include "rpnvec.h"     // vec_clear()
+#include "rpnout.h"
+#include "rpnpar.h"
+
+// rpnpar.c
+// independent lines on threads
+
+/* ___ comments ________________________________________________________________
+
+the lines are cut into blocks of PAR_BLOCK. each thread starts with an
+equal run of blocks in its queue, lo to hi, and takes them from lo. one
+that runs out takes the upper half of the first queue it finds with blocks
+left, the thread it took them from is still working on its lo end. a queue
+is only ever refilled by its own thread, so once they're all empty the
+threads are done. a lock a queue, held for a few instructions a block.
+
+a block's stdout and stderr go to its two sinks, with where each line
+ended in them. the main thread waits for the blocks in order and writes
+them, a line's stderr before its stdout like prog_run_line() does. so
+lines stream out while the later ones still run.
+
+a line starts from empty stacks, no history, p off. the history is popped,
+not freed, the stacks keep their size from line to line.
+
+with -e the lines are rows. each thread compiles the program once, and a
+row's fields go on the stack as NUM cmds, as if they were typed before the
+program. a mapped file isn't written to, so a row is a start and a length
+and a field is copied out to be parsed. a written block's sinks are freed,
+the output of a big file isn't all in memory at the end
+*/
+
+#define PAR_BLOCK  64u      // lines, a thread takes one block at a time
+#define PAR_CACHED 256u     // longer lines aren't cached, like rpnstream.c
+#define PAR_FIELD  128u     // longer fields are copied to the heap
+
+typedef struct {
+    const char *text;   // a row of a mapped file doesn't end in '\0'
+    size_t len;
+    size_t line;
+} par_line_t;
+
+typedef struct {
+    void *addr;
+    size_t len;
+} par_map_t;
+
+typedef struct {
+    out_sink_t out;
+    out_sink_t err;
+    size_t out_end[PAR_BLOCK]; // where each line's output ends
+    size_t err_end[PAR_BLOCK];
+    size_t nran;
+    int quit;   // its last line quit
+    int done;
+} par_block_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t lo;
+    size_t hi;
+    pthread_t thread;
+} par_queue_t;
+
+static par_line_t *lines = NULL;
+static size_t nlines = 0u, lines_cap = 0u;
+static char **inputs = NULL;    // what par_read() read, freed by par_run()
+static size_t ninputs = 0u;
+static par_map_t *maps = NULL;  // what par_map() mapped
+static size_t nmaps = 0u;
+
+static par_block_t *blocks;
+static par_queue_t *queues;
+static size_t nqueues;
+static const par_opts_t *par_opts;
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int stop = 0;            // a line quit, under done_lock
+static word_state_t par_words;  // main's, for the threads to read
+static void (*par_printmsg)(token_t msgcode);
+static void (*par_printmsg_fresh)(token_t msgcode, token_t *last_msgp);
+
+// ___ helper functions ________________________________________________________
+
+static void write_all(int fd, const char *data, size_t len) {
+    while (len > 0u) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+static void make_stacks(stack_t *stks[]) {
+    stks[I_STK ] = stack_create(sizeof(RPN_T));
+    stks[H_NUMS] = stack_create(sizeof(RPN_T));
+    stks[H_CMDS] = stack_create(sizeof(token_t));
+    if (par_opts->hist_limit) {
+        size_t limit = par_opts->hist_limit;
+        stack_limit(limit, limit / 2u, 1, stks[H_NUMS]);
+        stack_limit(limit, limit / 2u, 1, stks[H_CMDS]);
+    } else if (par_opts->undo_depth) {
+        stack_limit(2u * par_opts->undo_depth, 1u, 0, stks[H_NUMS]);
+        stack_limit(par_opts->undo_depth, 1u, 0, stks[H_CMDS]);
+    }
+    if (par_opts->snapshots && !jit_enabled) {
+        pstack_enable(par_opts->snapshots, stks[I_STK]);
+    }
+}
+
+// as they were before the first line
+static void fresh_stacks(stack_t *stks[]) {
+    while (!stack_empty(stks[I_STK])) {
+        num_pop(stks[I_STK]);
+    }
+    while (!stack_empty(stks[H_NUMS])) {
+        num_pop(stks[H_NUMS]);
+    }
+    while (!stack_empty(stks[H_CMDS])) {
+        cmd_pop(stks[H_CMDS]);
+    }
+    pstack_forget(stks[I_STK]);
+    big_set_digits(0u);
+}
+
+static int is_blank(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+// a field that isn't all one number is nan, like a failed strtold() isn't
+static RPN_T parse_field(const char *str, size_t len) {
+    char buf[PAR_FIELD + 1u], *field = buf;
+    const char *end;
+    while (len && is_blank(*str)) {
+        str++;
+        len--;
+    }
+    while (len && is_blank(str[len - 1u])) {
+        len--;
+    }
+    if (len == 0u) {
+        return NAN;
+    }
+    if (len > PAR_FIELD) {
+        field = malloc(len + 1u);
+        if (field == NULL) {
+            stack_error("Failed to allocate field");
+        }
+    }
+    memcpy(field, str, len);
+    field[len] = '\0';
+    RPN_T num = num_parse(field, &end);
+    if (end != field + len) {
+        num = NAN;
+    }
+    if (field != buf) {
+        free(field);
+    }
+    return num;
+}
+
+// the fields of a row, split at sep, or at runs of blanks if sep is '\0'
+static void push_fields(const par_line_t *pl,
+                        int *hist_flagp,
+                        token_t *last_msgp,
+                        stack_t *stks[])
+{
+    const char *str = pl->text, *end = str + pl->len, *next;
+    char sep = par_opts->sep;
+    if (str < end && end[-1] == '\r') {
+        end--;
+    }
+    while (str < end) {
+        if (sep == '\0') {
+            while (str < end && is_blank(*str)) {
+                str++;
+            }
+            for (next = str; next < end && !is_blank(*next); next++) {
+            }
+            if (str == next) {
+                break;
+            }
+        } else {
+            next = memchr(str, sep, end - str);
+            next = next ? next : end;
+        }
+        RPN_T num = parse_field(str, next - str);
+        do_cmd(hist_flagp, last_msgp, num, NUM, stks);
+        if (sep != '\0' && next + 1 == end) { // "1,2," has an empty third
+            do_cmd(hist_flagp, last_msgp, NAN, NUM, stks);
+        }
+        str = next + (next < end);
+    }
+}
+
+static int run_line(const par_line_t *pl, rpn_prog_t *prog, stack_t *stks[]) {
+    int hist_flag = 0;
+    token_t last_msg = JUNK;
+    int quit;
+    if (prog) {
+        push_fields(pl, &hist_flag, &last_msg, stks);
+        quit = prog_run_line(prog, pl->line, &hist_flag, &last_msg, stks);
+    } else if (pl->len <= PAR_CACHED) {
+        quit = prog_run_line(prog_cached(pl->text), pl->line,
+                             &hist_flag, &last_msg, stks);
+    } else {
+        rpn_prog_t *prog = prog_compile(pl->text);
+        quit = prog_run_line(prog, pl->line, &hist_flag, &last_msg, stks);
+        prog_destroy(prog);
+    }
+    if (!quit) {
+        dump_stack(stks[I_STK]);
+    }
+    return quit;
+}
+
+static void run_block(size_t b, rpn_prog_t *prog, stack_t *stks[]) {
+    par_block_t *block = &blocks[b];
+    size_t first = b * PAR_BLOCK, i;
+    out_set_sinks(&block->out, &block->err);
+    for (i = 0u; i < PAR_BLOCK && first + i < nlines; i++) {
+        fresh_stacks(stks);
+        int quit = run_line(&lines[first + i], prog, stks);
+        block->out_end[i] = block->out.len;
+        block->err_end[i] = block->err.len;
+        if (quit) {
+            block->quit = 1;
+            i++;
+            break;
+        }
+    }
+    out_set_sinks(NULL, NULL);
+    block->nran = i;
+}
+
+// the next block of queue q, from its own end. 0 if it's empty
+static int take(par_queue_t *q, size_t *bp) {
+    int took = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->lo < q->hi) {
+        *bp = q->lo++;
+        took = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return took;
+}
+
+// the upper half of another queue into q's, the first block of it to *bp
+static int steal(size_t self, size_t *bp) {
+    size_t k;
+    for (k = 1u; k < nqueues; k++) {
+        par_queue_t *victim = &queues[(self + k) % nqueues];
+        size_t lo = 0u, hi = 0u;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->lo < victim->hi) {
+            lo = victim->lo + (victim->hi - victim->lo) / 2u;
+            hi = victim->hi;
+            victim->hi = lo;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (lo < hi) {
+            par_queue_t *q = &queues[self];
+            pthread_mutex_lock(&q->lock);
+            q->lo = lo + 1u;
+            q->hi = hi;
+            pthread_mutex_unlock(&q->lock);
+            *bp = lo;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *worker(void *arg) {
+    size_t self = (size_t)arg, b;
+    stack_t *stks[3];
+    word_state_t words = par_words;
+    word_swap(&words);
+    p_printmsg = par_printmsg;
+    p_printmsg_fresh = par_printmsg_fresh;
+    make_stacks(stks);
+    rpn_prog_t *prog = par_opts->prog ? prog_compile(par_opts->prog) : NULL;
+    int stopped = 0;
+    while (!stopped && (take(&queues[self], &b) || steal(self, &b))) {
+        run_block(b, prog, stks);
+        pthread_mutex_lock(&done_lock);
+        blocks[b].done = 1;
+        stopped = stop;
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&done_lock);
+    }
+    if (prog) {
+        prog_destroy(prog);
+    }
+    prog_cache_clear();
+    vec_clear();
+    stack_destroy(stks[I_STK ]);
+    stack_destroy(stks[H_NUMS]);
+    stack_destroy(stks[H_CMDS]);
+    word_swap(&words); // its own again, the shared one isn't freed
+    return NULL;
+}
+
+static void add_line(const char *text, size_t len, size_t line) {
+    if (nlines == lines_cap) {
+        lines_cap = lines_cap ? 2u * lines_cap : 1024u;
+        lines = realloc(lines, lines_cap * sizeof(*lines));
+        if (lines == NULL) {
+            perror("Failed to allocate lines");
+            exit(EXIT_FAILURE);
+        }
+    }
+    lines[nlines].text = text;
+    lines[nlines].len = len;
+    lines[nlines].line = line;
+    nlines++;
+}
+
+// ___ public functions ________________________________________________________
+
+void par_line(char *text, size_t line) {
+    add_line(text, strlen(text), line);
+}
+
+void par_read(int fd) {
+    size_t size = 1u << 20, len = 0u;
+    char *buf = malloc(size + 1u);
+    while (buf) {
+        if (len == size) {
+            size *= 2u;
+            buf = realloc(buf, size + 1u);
+            if (buf == NULL) {
+                break;
+            }
+        }
+        ssize_t n = read(fd, buf + len, size - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            perror("Failed to read input");
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+    if (buf == NULL) {
+        perror("Failed to allocate input buffer");
+        exit(EXIT_FAILURE);
+    }
+    buf[len] = '\0';
+    inputs = realloc(inputs, (ninputs + 1u) * sizeof(*inputs));
+    if (inputs == NULL) {
+        perror("Failed to allocate input buffer");
+        exit(EXIT_FAILURE);
+    }
+    inputs[ninputs++] = buf;
+    size_t start = 0u, line = 1u;
+    char *nl;
+    while ((nl = memchr(buf + start, '\n', len - start))) {
+        *nl = '\0';
+        par_line(buf + start, line++);
+        start = nl - buf + 1;
+    }
+    if (start < len) { // the last line, without a newline
+        par_line(buf + start, line);
+    }
+}
+
+int par_map(const char *path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    size_t len = (size_t)st.st_size, start = 0u, line = 1u;
+    if (len == 0u) {
+        close(fd);
+        return 1;
+    }
+    const char *buf = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) {
+        perror(path);
+        return 0;
+    }
+    maps = realloc(maps, (nmaps + 1u) * sizeof(*maps));
+    if (maps == NULL) {
+        perror("Failed to allocate maps");
+        exit(EXIT_FAILURE);
+    }
+    maps[nmaps].addr = (void *)buf;
+    maps[nmaps++].len = len;
+    while (start < len) {
+        const char *nl = memchr(buf + start, '\n', len - start);
+        size_t end = nl ? (size_t)(nl - buf) : len;
+        add_line(buf + start, end - start, line++);
+        start = end + 1u;
+    }
+    return 1;
+}
+
+int par_run(size_t nthreads, const par_opts_t *opts) {
+    size_t nblocks = (nlines + PAR_BLOCK - 1u) / PAR_BLOCK, b, t;
+    if (nthreads == 0u) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpus > 0 ? (size_t)ncpus : 1u;
+    }
+    if (nthreads > nblocks) {
+        nthreads = nblocks ? nblocks : 1u;
+    }
+    blocks = calloc(nblocks ? nblocks : 1u, sizeof(*blocks));
+    queues = calloc(nthreads, sizeof(*queues));
+    if (blocks == NULL || queues == NULL) {
+        perror("Failed to allocate threads");
+        exit(EXIT_FAILURE);
+    }
+    par_opts = opts;
+    nqueues = nthreads;
+    stop = 0;
+    word_share(&par_words);
+    par_printmsg = p_printmsg;
+    par_printmsg_fresh = p_printmsg_fresh;
+    for (t = 0u; t < nthreads; t++) {
+        pthread_mutex_init(&queues[t].lock, NULL);
+        queues[t].lo = nblocks * t / nthreads;
+        queues[t].hi = nblocks * (t + 1u) / nthreads;
+    }
+    for (t = 0u; t < nthreads; t++) {
+        if (pthread_create(&queues[t].thread, NULL, worker, (void *)t)) {
+            perror("Failed to start thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int quit = 0;
+    size_t nrows = 0u;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    fflush(stdout);
+    for (b = 0u; b < nblocks && !quit; b++) {
+        par_block_t *block = &blocks[b];
+        pthread_mutex_lock(&done_lock);
+        while (!block->done) {
+            pthread_cond_wait(&done_cond, &done_lock);
+        }
+        pthread_mutex_unlock(&done_lock);
+        if (block->err.len == 0u) {
+            write_all(1, block->out.data, block->out.len);
+        } else {
+            size_t i, out = 0u, err = 0u;
+            for (i = 0u; i < block->nran; i++) {
+                write_all(2, block->err.data + err, block->err_end[i] - err);
+                write_all(1, block->out.data + out, block->out_end[i] - out);
+                err = block->err_end[i];
+                out = block->out_end[i];
+            }
+        }
+        nrows += block->nran;
+        free(block->out.data);
+        free(block->err.data);
+        block->out.data = block->err.data = NULL;
+        if (block->quit) {
+            quit = 1;
+            pthread_mutex_lock(&done_lock);
+            stop = 1;
+            pthread_mutex_unlock(&done_lock);
+        }
+    }
+    for (t = 0u; t < nthreads; t++) {
+        pthread_join(queues[t].thread, NULL);
+    }
+    // any worker may lock any queue in steal(), so none goes before all joined
+    for (t = 0u; t < nthreads; t++) {
+        pthread_mutex_destroy(&queues[t].lock);
+    }
+    if (opts->rate) {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%zu rows, %.3f s, %.0f rows/s\n",
+                 nrows, secs, secs > 0.0 ? nrows / secs : 0.0);
+        write_all(2, msg, strlen(msg));
+    }
+    for (b = 0u; b < nblocks; b++) {
+        free(blocks[b].out.data);
+        free(blocks[b].err.data);
+    }
+    for (b = 0u; b < ninputs; b++) {
+        free(inputs[b]);
+    }
+    for (b = 0u; b < nmaps; b++) {
+        munmap(maps[b].addr, maps[b].len);
+    }
+    free(blocks);
+    free(queues);
+    free(inputs);
+    free(maps);
+    free(lines);
+    inputs = NULL;
+    ninputs = 0u;
+    maps = NULL;
+    nmaps = 0u;
+    lines = NULL;
+    nlines = lines_cap = 0u;
+    return quit;
+}
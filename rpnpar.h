@@ -0,0 +1,42 @@
+#ifndef RPNPAR_H
+#define RPNPAR_H
+#include <stddef.h>     // size_t
+#include "rpnstack.h"
+#include "rpnfunctions.h"
+
+// rpnpar.h
+// ./rpn --independent ...: every batch mode line runs on empty stacks, as
+// if it were the only one, so the lines can run on threads at once.
+// each thread has its stacks, compiled lines, vectors, big numbers and
+// output buffer, RPN_LOCAL. they take blocks of lines from their own queue
+// and steal half of another's when theirs is empty. the output is written
+// in the order of the lines, the same bytes as the lines one at a time.
+// a line's : definitions are for the rest of that line, ~/.rpnrc's words
+// are there for all of them.
+// ./rpn -e PROG -F, data.csv runs PROG on each row of the file, after its
+// fields, like the row were typed before PROG: "1,2" with -e + gives 3.
+// the file is mapped, not read, each thread compiles PROG once
+
+// how each thread makes its stacks, see main()
+typedef struct {
+    size_t hist_limit;
+    size_t undo_depth;
+    size_t snapshots;
+    const char *prog;   // -e, the lines are rows of fields then. NULL if not
+    char sep;           // -F, '\0' splits at runs of blanks
+    int rate;           // rows/s on stderr at the end
+} par_opts_t;
+
+// the lines to run, in order. line is its number in what it came from.
+// par_line() doesn't copy text, it has to last until par_run()
+void par_line(char *text, size_t line);
+// all of fd, a line a line like stream_run()
+void par_read(int fd);
+// the rows of a file, mapped until par_run() is done. 0 if it can't be
+int par_map(const char *path);
+
+// runs them on nthreads threads, 0 for one per core. returns 1 on q,
+// the output stops at the line with it like it would have
+int par_run(size_t nthreads, const par_opts_t *opts);
+
+#endif // RPNPAR_H
@@ -0,0 +1,386 @@
+#include <stdio.h>      // snprintf()
+#include <stdlib.h>     // malloc(), free()
+#include <string.h>     // strcmp(), strlen(), memcpy(), strchr()
+#include <fenv.h>       // feclearexcept()
+#include "rpnstack.h"
+#include "rpnpstack.h"
+#include "rpnfunctions.h"
+#include "rpnprog.h"
+#include "rpnvec.h"     // vec_collect()
+#include "rpnbig.h"     // big_digits()
+#include "rpnopt.h"
+#include "rpnjit.h"
+#include "rpnword.h"
+#include "rpnout.h"     // out_err()
+
+// rpnprog.c
+// compiled input lines
+
+#define PROG_BUCKETS   1024u   // power of 2
+#define PROG_CACHE_MAX 4096u   // entries, then the cache starts over
+#define JIT_HOT 2u              // runs, a line that comes up again
+
+static RPN_LOCAL rpn_prog_t *uncached = NULL; // the last line with a <file
+
+// chained hash table, keyed by the line's text
+typedef struct prog_entry {
+    struct prog_entry *next;
+    size_t hash;
+    rpn_prog_t *prog;
+    char line[];
+} prog_entry_t;
+
+static RPN_LOCAL prog_entry_t **buckets = NULL; // PROG_BUCKETS of them
+static RPN_LOCAL size_t nentries = 0u;
+
+// ___ helper functions ________________________________________________________
+
+/* ___ comments ________________________________________________________________
+
+reading and writing the fp status word around every cmd is as slow as the
+cmd itself, and batch mode throws the msgs away. so batch mode doesn't, or
+once a line. FP_PRECISE goes back to before the line with undo and runs it
+again, testing after each insn. the second run pushes the same history, the
+stacks end up the same. it needs a snapshot for each cmd of the line, and
+no _ y in it, otherwise only the line is reported. the second run is of
+the line as it was typed, not as rpnopt.c left it, so the cmd it names is
+one that's in the line
+*/
+
+// FNV-1a
+static size_t hash_line(const char *line) {
+    size_t hash = 14695981039346656037u;
+    while (*line) {
+        hash ^= (unsigned char)*line++;
+        hash *= 1099511628211u;
+    }
+    return hash;
+}
+
+// MULA with nothing to multiply: a * b + as the cmds, * finds only a
+static void unfuse(const rpn_insn_t *insn,
+                   size_t *ncmdsp,
+                   int *hist_flagp,
+                   token_t *last_msgp,
+                   stack_t *stks[])
+{
+    do_cmd(hist_flagp, last_msgp, insn->imm, NUM, stks);
+    p_printmsg_fresh(SMAL, last_msgp);
+    do_cmd(hist_flagp, last_msgp, insn->imm2, NUM, stks);
+    do_cmd(hist_flagp, last_msgp, RPN_ZERO, ADD, stks);
+    *ncmdsp += 3u;
+}
+
+// the loop of handle_input() and the check of vet_do(). *ncmdsp counts the
+// cmds that went into the history. with *badp, the fp flags are tested
+// after each insn, *badp is set to the first one that raised one.
+// src runs the line as it was, not as rpnopt.c left it
+static int run(rpn_prog_t *prog,
+               int src,
+               size_t *ncmdsp,
+               rpn_insn_t **badp,
+               int *hist_flagp,
+               token_t *last_msgp,
+               stack_t *stks[])
+{
+    if (!src && jit_enabled) {
+        if (prog->jit == NULL && ++prog->runs == JIT_HOT) {
+            prog->jit = jit_compile(prog);
+        }
+        if (prog->jit && jit_run(prog->jit, stks)) {
+            return 0;
+        }
+    }
+    rpn_insn_t *insn = src ? prog->src : prog->insns;
+    rpn_insn_t *end = insn + (src ? prog->nsrc : prog->ninsns);
+    for (; insn < end; insn++) {
+        if (insn->op == UNDO || insn->op == REDO) {
+            size_t steps = insn->imm >= RPN_ONE ? (size_t)insn->imm : 1u;
+            (insn->op == UNDO ? undo : redo)(steps, last_msgp, stks);
+        } else if (insn->op == MULA && stack_empty(stks[I_STK])) {
+            unfuse(insn, ncmdsp, hist_flagp, last_msgp, stks);
+        } else if (stack_size(stks[I_STK]) < insn->minsz) {
+            p_printmsg_fresh(SMAL, last_msgp);
+        } else {
+            if (insn->op == MULA) {
+                mula_set(insn->imm, insn->imm2, prog->level == OPT_FAST);
+            } else if (insn->op == DEFN) {
+                word_pending(prog->words[(size_t)insn->imm]);
+            }
+            do_cmd(hist_flagp, last_msgp, insn->imm, insn->op, stks);
+            *ncmdsp += (funrows[insn->op].type != NONOP);
+        }
+        if (badp && *badp == NULL && math_error() != JUNK) {
+            *badp = insn;
+        }
+        if (insn->op == QUIT) {
+            return 1;
+        }
+    }
+    vec_collect(stks);
+    return 0;
+}
+
+// room for n more insns
+static void grow(rpn_prog_t *prog, size_t *capp, size_t n) {
+    if (prog->ninsns + n <= *capp) {
+        return;
+    }
+    while (prog->ninsns + n > *capp) {
+        *capp *= 2u;
+    }
+    prog->insns = realloc(prog->insns, *capp * sizeof(*prog->insns));
+    if (prog->insns == NULL) {
+        stack_error("Failed to compile line");
+    }
+}
+
+static int has_undo(rpn_prog_t *prog) {
+    size_t i;
+    for (i = 0u; i < prog->nsrc; i++) {
+        if (prog->src[i].op == UNDO || prog->src[i].op == REDO) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// _ y count cmds, they'd count the optimized ones. after p the numbers
+// are bigs, rpnopt.c folds RPN_T
+static int can_optimize(rpn_prog_t *prog) {
+    size_t i;
+    if (opt_level == OPT_OFF || big_digits() || has_undo(prog)) {
+        return 0;
+    }
+    for (i = 0u; i < prog->nsrc; i++) {
+        if (prog->src[i].op == PREC) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// ___ public functions ________________________________________________________
+
+// the same tokens handle_input() would act on. JUNK is left out, q ends it
+rpn_prog_t *prog_compile(const char *line) {
+    return prog_compile_scoped(line, NULL, 0u);
+}
+
+rpn_prog_t *prog_compile_scoped(const char *line,
+                                struct rpn_word **scope,
+                                size_t nscope)
+{
+    rpn_prog_t *prog = malloc(sizeof(*prog));
+    if (prog == NULL) {
+        stack_error("Failed to compile line");
+    }
+    size_t cap = 8u;
+    prog->ninsns = 0u;
+    prog->insns = malloc(cap * sizeof(*prog->insns));
+    if (prog->insns == NULL) {
+        stack_error("Failed to compile line");
+    }
+    prog->nwords = 0u;
+    prog->words = NULL;
+    const char *str, *end;
+    token_t tok = NUM;
+    for (str = lex(line, &end); str && tok != QUIT; str = lex(end, &end)) {
+        // a line has its definitions, a body those of the line it's in
+        rpn_word_t *word = prog->nwords
+                           ? word_find(str, end - str, prog->words, prog->nwords)
+                           : word_find(str, end - str, scope, nscope);
+        if (word) { // the body as it was typed, the line is optimized whole
+            grow(prog, &cap, word->prog->nsrc);
+            memcpy(prog->insns + prog->ninsns, word->prog->src,
+                   word->prog->nsrc * sizeof(*prog->insns));
+            prog->ninsns += word->prog->nsrc;
+            continue;
+        }
+        RPN_T inputnum = RPN_ZERO;
+        tok = tokenize(str, &inputnum);
+        if (tok == DEFN) {
+            rpn_word_t *def = word_parse(end, &end, prog->words, prog->nwords);
+            if (def == NULL) {
+                continue;
+            }
+            prog->words = realloc(prog->words,
+                                  (prog->nwords + 1u) * sizeof(*prog->words));
+            if (prog->words == NULL) {
+                stack_error("Failed to compile line");
+            }
+            inputnum = (RPN_T)prog->nwords;
+            prog->words[prog->nwords++] = def;
+        }
+        if (tok == JUNK) {
+            continue;
+        }
+        grow(prog, &cap, 1u);
+        rpn_insn_t *insn = &prog->insns[prog->ninsns++];
+        insn->op = tok;
+        insn->minsz = funrows[tok].minsz;
+        insn->imm = inputnum;
+        insn->imm2 = RPN_ZERO;
+    }
+    prog->src = prog->insns;
+    prog->nsrc = prog->ninsns;
+    prog->level = OPT_OFF;
+    prog->runs = 0u;
+    prog->jit = NULL;
+    prog->gen = word_gen();
+    if (can_optimize(prog)) {
+        size_t bytes = prog->nsrc * sizeof(*prog->src);
+        prog->src = malloc(bytes ? bytes : 1u);
+        if (prog->src == NULL) {
+            stack_error("Failed to compile line");
+        }
+        memcpy(prog->src, prog->insns, bytes);
+        prog->ninsns = opt_insns(prog->insns, prog->ninsns, opt_level);
+        prog->level = opt_level;
+    }
+    return prog;
+}
+
+void prog_destroy(rpn_prog_t *prog) {
+    size_t i;
+    jit_destroy(prog->jit);
+    for (i = 0u; i < prog->nwords; i++) {
+        word_free(prog->words[i]);
+    }
+    free(prog->words);
+    if (prog->src != prog->insns) {
+        free(prog->src);
+    }
+    free(prog->insns);
+    free(prog);
+}
+
+int prog_run(rpn_prog_t *prog,
+             int *hist_flagp,
+             token_t *last_msgp,
+             stack_t *stks[])
+{
+    size_t ncmds = 0u;
+    return run(prog, 0, &ncmds, NULL, hist_flagp, last_msgp, stks);
+}
+
+int prog_run_line(rpn_prog_t *prog,
+                  size_t line,
+                  int *hist_flagp,
+                  token_t *last_msgp,
+                  stack_t *stks[])
+{
+    if (fp_check != FP_LINE && fp_check != FP_PRECISE) {
+        return prog_run(prog, hist_flagp, last_msgp, stks);
+    }
+    size_t ncmds = 0u;
+    feclearexcept(FE_ALL_EXCEPT);
+    int quit = run(prog, 0, &ncmds, NULL, hist_flagp, last_msgp, stks);
+    token_t err = math_error();
+    if (err == JUNK) {
+        return quit;
+    }
+    rpn_insn_t *bad = NULL;
+    if (fp_check == FP_PRECISE && !quit && ncmds && !has_undo(prog)
+        && pstack_behind(stks[I_STK]) >= ncmds
+        && stack_size(stks[H_CMDS]) >= ncmds)
+    {
+        undo(ncmds, last_msgp, stks);
+        ncmds = 0u;
+        feclearexcept(FE_ALL_EXCEPT);
+        run(prog, 1, &ncmds, &bad, hist_flagp, last_msgp, stks);
+    }
+    prog_fp_report(line, err, bad ? bad->op : JUNK);
+    return quit;
+}
+
+// "line 3: Divide by zero", cmd JUNK if it isn't known
+void prog_fp_report(size_t line, token_t err, token_t cmd) {
+    char msg[128];
+    if (cmd == JUNK) {
+        snprintf(msg, sizeof(msg), "line %zu: %s\n", line, funrows[err].name);
+    } else if (cmd == NUM) {
+        snprintf(msg, sizeof(msg), "line %zu: %s, number\n", line,
+                 funrows[err].name);
+    } else {
+        snprintf(msg, sizeof(msg), "line %zu: %s, %c %s\n", line,
+                 funrows[err].name, funrows[cmd].tok, funrows[cmd].name);
+    }
+    out_err(msg);
+}
+
+
+// a <file is read when the line is compiled, those lines are compiled
+// every time. the vector would be freed while the cache still holds it.
+// so would the big numbers, with p50
+rpn_prog_t *prog_cached(const char *line) {
+    if (strchr(line, '<') || big_digits()) {
+        if (uncached) {
+            prog_destroy(uncached);
+        }
+        uncached = prog_compile(line);
+        return uncached;
+    }
+    if (buckets == NULL) {
+        buckets = calloc(PROG_BUCKETS, sizeof(*buckets));
+        if (buckets == NULL) {
+            stack_error("Failed to cache line");
+        }
+    }
+    size_t hash = hash_line(line);
+    prog_entry_t **bucket = &buckets[hash & (PROG_BUCKETS - 1u)];
+    prog_entry_t *entry;
+    for (entry = *bucket; entry; entry = entry->next) {
+        if (entry->hash == hash && !strcmp(entry->line, line)) {
+            if (entry->prog->gen != word_gen()) { // a word changed
+                prog_destroy(entry->prog);
+                entry->prog = prog_compile(line);
+            }
+            return entry->prog;
+        }
+    }
+    if (nentries == PROG_CACHE_MAX) { // bucket went with the rest
+        prog_cache_clear();
+        return prog_cached(line);
+    }
+    size_t len = strlen(line);
+    entry = malloc(sizeof(*entry) + len + 1u);
+    if (entry == NULL) {
+        stack_error("Failed to cache line");
+    }
+    memcpy(entry->line, line, len + 1u);
+    entry->hash = hash;
+    entry->prog = prog_compile(line);
+    entry->next = *bucket;
+    *bucket = entry;
+    nentries++;
+    return entry->prog;
+}
+
+void prog_cache_clear(void) {
+    size_t b;
+    for (b = 0u; b < PROG_BUCKETS && buckets; b++) {
+        prog_entry_t *entry = buckets[b];
+        while (entry) {
+            prog_entry_t *next = entry->next;
+            prog_destroy(entry->prog);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(buckets);
+    buckets = NULL;
+    nentries = 0u;
+    if (uncached) {
+        prog_destroy(uncached);
+        uncached = NULL;
+    }
+}
+
+void prog_swap(prog_state_t *state) {
+    prog_state_t was = {buckets, nentries, uncached};
+    buckets = state->buckets;
+    nentries = state->nentries;
+    uncached = state->uncached;
+    *state = was;
+}
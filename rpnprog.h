@@ -0,0 +1,71 @@
+#ifndef RPNPROG_H
+#define RPNPROG_H
+#include "rpnstack.h"
+#include "rpnfunctions.h"
+
+// rpnprog.h
+// compiled input lines for batch mode. a line is lexed and tokenized once
+// into insns, then run as often as it comes up without looking at the text
+
+// one token of the line. minsz is copied from funrows
+typedef struct {
+    token_t op;
+    size_t minsz;
+    RPN_T imm;      // NUM: the number. UNDO, REDO: the count. MULA: a
+    RPN_T imm2;     // MULA: b of x a * b +
+} rpn_insn_t;
+
+// insns is what runs, src the line as it was. they're the same array
+// unless rpnopt.c rewrote insns
+typedef struct {
+    size_t ninsns;
+    rpn_insn_t *insns;
+    size_t nsrc;
+    rpn_insn_t *src;
+    int level;      // opt_level when it was compiled
+    size_t runs;    // --jit compiles it on the JIT_HOT th
+    struct rpn_jit *jit; // rpnjit.h, NULL if it isn't jitted
+    size_t gen;     // word_gen() when it was compiled
+    size_t nwords;  // the : definitions in it, DEFN's imm is the index
+    struct rpn_word **words; // rpnword.h
+} rpn_prog_t;
+
+rpn_prog_t *prog_compile(const char *line);
+// a word's body. a name that isn't a word yet may be in scope, the words
+// the line defined before it
+rpn_prog_t *prog_compile_scoped(const char *line,
+                                struct rpn_word **scope,
+                                size_t nscope);
+void prog_destroy(rpn_prog_t *prog);
+
+// like handle_input(). returns 1 on q
+int prog_run(rpn_prog_t *prog,
+             int *hist_flagp,
+             token_t *last_msgp,
+             stack_t *stks[]);
+
+// prog_run() for a batch mode line, with the math error check fp_check
+// asks for. errors go to stderr with the line number
+int prog_run_line(rpn_prog_t *prog,
+                  size_t line,
+                  int *hist_flagp,
+                  token_t *last_msgp,
+                  stack_t *stks[]);
+// err is a math_error() msg. cmd is the one that raised it, or JUNK
+void prog_fp_report(size_t line, token_t err, token_t cmd);
+
+// compiles line the first time, then finds it by its text.
+// the cache owns the program
+rpn_prog_t *prog_cached(const char *line);
+void prog_cache_clear(void);
+
+// the cache of one calculator. a thread has one, prog_swap() trades it for
+// *state, so a rpn_ctx_t brings its own while it runs. zeros are empty
+typedef struct {
+    struct prog_entry **buckets;
+    size_t nentries;
+    rpn_prog_t *uncached;
+} prog_state_t;
+void prog_swap(prog_state_t *state);
+
+#endif // RPNPROG_H
@@ -0,0 +1,346 @@
+#include <stdlib.h>     // malloc(), free()
+#include <string.h>     // memcpy()
+#include <stddef.h>     // max_align_t
+#include "rpnstack.h"
+#include "rpnpstack.h"
+
+// rpnpstack.c
+// persistent versions of a stack_t
+
+#define PSTACK_LEAF   16u   // elements in a leaf
+#define PSTACK_BRANCH 16u   // kids of a branch
+
+// a leaf holds elements, a branch holds kids. shared, freed at refs 0
+typedef struct pstack_node {
+    size_t refs;
+    max_align_t data[];
+} pstack_node_t;
+
+// the ring of the stack_t at one point in time
+typedef struct {
+    pstack_node_t *root;
+    size_t nelems;
+    size_t head;
+    size_t index;
+    int tag;
+} pstack_version_t;
+
+// versions is a ring too, first is the oldest, cursor is where stk is
+struct pstack {
+    size_t cap;
+    size_t first;
+    size_t count;
+    size_t cursor;
+    pstack_version_t *versions;
+};
+
+// ___ helper functions ________________________________________________________
+
+static pstack_version_t *version(size_t i, struct pstack *ps) {
+    return &ps->versions[(ps->first + i) % ps->cap];
+}
+
+static pstack_node_t **kids(pstack_node_t *node) {
+    return (pstack_node_t **)node->data;
+}
+
+static size_t nleaves(size_t nelems) {
+    return (nelems + PSTACK_LEAF - 1u) / PSTACK_LEAF;
+}
+
+// how many leaves a node at depth covers
+static size_t span(size_t depth) {
+    size_t leaves = 1u;
+    while (depth--) {
+        leaves *= PSTACK_BRANCH;
+    }
+    return leaves;
+}
+
+static size_t depth_of(size_t nelems) {
+    size_t depth = 0u;
+    while (span(depth) < nleaves(nelems)) {
+        depth++;
+    }
+    return depth;
+}
+
+static pstack_node_t *node_new(size_t datasz) {
+    pstack_node_t *node = malloc(sizeof(*node) + datasz);
+    if (node == NULL) {
+        stack_error("Failed to snapshot stack");
+    }
+    node->refs = 1u;
+    return node;
+}
+
+static void node_release(pstack_node_t *node, size_t depth) {
+    if (node == NULL || --node->refs) { return; }
+    if (depth > 0u) {
+        size_t i;
+        for (i = 0u; i < PSTACK_BRANCH; i++) {
+            node_release(kids(node)[i], depth - 1u);
+        }
+    }
+    free(node);
+}
+
+static void version_release(pstack_version_t *v) {
+    node_release(v->root, depth_of(v->nelems));
+    v->root = NULL;
+}
+
+// elements of leaf from the ring's data, the last leaf may be short
+static size_t leaf_len(size_t leaf, size_t nelems) {
+    size_t start = leaf * PSTACK_LEAF;
+    return nelems - start < PSTACK_LEAF ? nelems - start : PSTACK_LEAF;
+}
+
+static pstack_node_t *leaf_new(size_t leaf, stack_t *stk) {
+    pstack_node_t *node = node_new(PSTACK_LEAF * stk->elemsz);
+    memcpy(node->data, stk->data + leaf * PSTACK_LEAF * stk->elemsz,
+           leaf_len(leaf, stk->nelems) * stk->elemsz);
+    return node;
+}
+
+// copy leaves lo to hi from stk, share the others with old
+static pstack_node_t *update(pstack_node_t *old, size_t depth, size_t base,
+                             size_t lo, size_t hi, stack_t *stk)
+{
+    if (depth == 0u) {
+        return leaf_new(base, stk);
+    }
+    pstack_node_t *node = node_new(PSTACK_BRANCH * sizeof(node));
+    size_t kidspan = span(depth - 1u);
+    size_t i;
+    for (i = 0u; i < PSTACK_BRANCH; i++) {
+        size_t kidbase = base + i * kidspan;
+        pstack_node_t *kid = old ? kids(old)[i] : NULL;
+        if (kidbase >= nleaves(stk->nelems)) {
+            kid = NULL;
+        } else if (kidbase <= hi && lo < kidbase + kidspan) {
+            kid = update(kid, depth - 1u, kidbase, lo, hi, stk);
+        } else if (kid) {
+            kid->refs++;
+        }
+        kids(node)[i] = kid;
+    }
+    return node;
+}
+
+// write the leaves of to that differ from from into stk. *lowp is the
+// lowest dataindex written, with the head where it is
+static void restore(pstack_node_t *from, pstack_node_t *to,
+                    size_t depth, size_t base, stack_t *stk, size_t *lowp)
+{
+    if (from == to || to == NULL) { return; }
+    if (depth == 0u) {
+        size_t first = base * PSTACK_LEAF, len = leaf_len(base, stk->nelems);
+        memcpy(stk->data + first * stk->elemsz, to->data, len * stk->elemsz);
+        size_t low = stk->head >= first && stk->head < first + len
+                     ? 0u : (first + stk->nelems - stk->head) % stk->nelems;
+        *lowp = low < *lowp ? low : *lowp;
+        return;
+    }
+    size_t kidspan = span(depth - 1u);
+    size_t i;
+    for (i = 0u; i < PSTACK_BRANCH; i++) {
+        restore(from ? kids(from)[i] : NULL, kids(to)[i],
+                depth - 1u, base + i * kidspan, stk, lowp);
+    }
+}
+
+// make stk what version to is, stk is at version from now
+static void checkout(pstack_version_t *from, pstack_version_t *to,
+                     stack_t *stk)
+{
+    if (stk->nelems != to->nelems) {
+        stk->index = 0u; // all of it is overwritten, don't copy it
+        stk->head = 0u;
+        stack_resize(to->nelems, stk, "Failed to restore stack");
+        from = NULL;
+    }
+    size_t low = to->index;
+    restore(from ? from->root : NULL, to->root, depth_of(to->nelems), 0u, stk,
+            &low);
+    if (from == NULL || from->head != to->head) { // every element moved
+        low = 0u;
+    }
+    stk->head = to->head;
+    stk->index = to->index;
+    stack_touch(stk->spilled + low, stk);
+}
+
+static void append(pstack_version_t *v, struct pstack *ps) {
+    if (ps->count == ps->cap) {
+        version_release(version(0u, ps));
+        ps->first = (ps->first + 1u) % ps->cap;
+        ps->count--;
+    }
+    *version(ps->count++, ps) = *v;
+    ps->cursor = ps->count - 1u;
+}
+
+static void snapshot_all(int tag, stack_t *stk) {
+    pstack_version_t v = {NULL, stk->nelems, stk->head, stk->index, tag};
+    if (stk->nelems) {
+        v.root = update(NULL, depth_of(stk->nelems), 0u,
+                        0u, nleaves(stk->nelems) - 1u, stk);
+    }
+    append(&v, stk->versions);
+}
+
+// ___ public functions ________________________________________________________
+
+void pstack_enable(size_t maxversions, stack_t *stk) {
+    struct pstack *ps = malloc(sizeof(*ps));
+    if (ps == NULL || maxversions == 0u) {
+        stack_error("Failed to create snapshots");
+    }
+    ps->versions = malloc(maxversions * sizeof(*ps->versions));
+    if (ps->versions == NULL) {
+        stack_error("Failed to create snapshots");
+    }
+    ps->cap = maxversions;
+    ps->first = 0u;
+    ps->count = 0u;
+    ps->cursor = 0u;
+    stk->versions = ps;
+    snapshot_all(-1, stk);
+}
+
+void pstack_destroy(struct pstack *ps) {
+    size_t i;
+    for (i = 0u; i < ps->count; i++) {
+        version_release(version(i, ps));
+    }
+    free(ps->versions);
+    free(ps);
+}
+
+void pstack_commit(size_t lo, size_t hi, int tag, stack_t *stk) {
+    struct pstack *ps = stk->versions;
+    if (ps == NULL) { return; }
+    while (ps->count > ps->cursor + 1u) { // no redo after a change
+        version_release(version(--ps->count, ps));
+    }
+    pstack_version_t *cur = version(ps->cursor, ps);
+    if (cur->nelems != stk->nelems) { // resized, the slots moved
+        snapshot_all(tag, stk);
+        return;
+    }
+    pstack_version_t v = {cur->root, stk->nelems, stk->head, stk->index, tag};
+    if (lo >= hi) {
+        if (v.root) {
+            v.root->refs++;
+        }
+        append(&v, ps);
+        return;
+    }
+    size_t depth = depth_of(stk->nelems);
+    size_t first = stack_slot(lo, stk) / PSTACK_LEAF;
+    size_t last = stack_slot(hi - 1u, stk) / PSTACK_LEAF;
+    if (first <= last) {
+        v.root = update(cur->root, depth, 0u, first, last, stk);
+    } else { // wraps around the end of the ring
+        pstack_node_t *upper =
+            update(cur->root, depth, 0u, first, nleaves(stk->nelems), stk);
+        v.root = update(upper, depth, 0u, 0u, last, stk);
+        node_release(upper, depth);
+    }
+    append(&v, ps);
+}
+
+size_t pstack_undo(size_t n, stack_t *stk) {
+    struct pstack *ps = stk->versions;
+    if (ps == NULL) { return 0u; }
+    if (n > ps->cursor) {
+        n = ps->cursor;
+    }
+    if (n) {
+        checkout(version(ps->cursor, ps), version(ps->cursor - n, ps), stk);
+        ps->cursor -= n;
+    }
+    return n;
+}
+
+size_t pstack_redo(size_t n, stack_t *stk) {
+    struct pstack *ps = stk->versions;
+    if (ps == NULL) { return 0u; }
+    if (n > ps->count - 1u - ps->cursor) {
+        n = ps->count - 1u - ps->cursor;
+    }
+    if (n) {
+        checkout(version(ps->cursor, ps), version(ps->cursor + n, ps), stk);
+        ps->cursor += n;
+    }
+    return n;
+}
+
+size_t pstack_behind(stack_t *stk) {
+    return stk->versions ? stk->versions->cursor : 0u;
+}
+
+int pstack_tag(long offset, stack_t *stk) {
+    struct pstack *ps = stk->versions;
+    if (ps == NULL || (long)ps->cursor + offset < 0
+        || (long)ps->cursor + offset >= (long)ps->count) {
+        return -1;
+    }
+    return version(ps->cursor + offset, ps)->tag;
+}
+
+size_t pstack_size(long offset, stack_t *stk) {
+    return version(stk->versions->cursor + offset, stk->versions)->index;
+}
+
+// 0u is bottom, like stack_peek()
+void pstack_peek(void *itemp, size_t dataindex, long offset, stack_t *stk) {
+    pstack_version_t *v = version(stk->versions->cursor + offset,
+                                  stk->versions);
+    size_t slot = (v->head + dataindex) % v->nelems;
+    size_t leaf = slot / PSTACK_LEAF;
+    size_t depth = depth_of(v->nelems);
+    pstack_node_t *node = v->root;
+    while (depth > 0u) {
+        size_t kidspan = span(--depth);
+        node = kids(node)[leaf / kidspan];
+        leaf %= kidspan;
+    }
+    memcpy(itemp, (char *)node->data + slot % PSTACK_LEAF * stk->elemsz,
+           stk->elemsz);
+}
+
+// every element of every version, once per version that has it
+void pstack_foreach(void (*fun)(void *itemp, void *ctx), void *ctx,
+                    stack_t *stk)
+{
+    struct pstack *ps = stk->versions;
+    if (ps == NULL) { return; }
+    size_t i, z;
+    for (i = 0u; i < ps->count; i++) {
+        pstack_version_t *v = version(i, ps);
+        for (z = 0u; z < v->index; z++) {
+            size_t slot = (v->head + z) % v->nelems;
+            size_t leaf = slot / PSTACK_LEAF;
+            size_t depth = depth_of(v->nelems);
+            pstack_node_t *node = v->root;
+            while (depth > 0u) {
+                size_t kidspan = span(--depth);
+                node = kids(node)[leaf / kidspan];
+                leaf %= kidspan;
+            }
+            fun((char *)node->data + slot % PSTACK_LEAF * stk->elemsz, ctx);
+        }
+    }
+}
+
+void pstack_forget(stack_t *stk) {
+    struct pstack *ps = stk->versions;
+    if (ps == NULL) { return; }
+    while (ps->count) {
+        version_release(version(--ps->count, ps));
+    }
+    ps->first = 0u;
+    snapshot_all(-1, stk);
+}
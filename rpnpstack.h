@@ -0,0 +1,40 @@
+#ifndef RPNPSTACK_H
+#define RPNPSTACK_H
+#include "rpnstack.h"
+
+// rpnpstack.h
+// persistent versions of a stack_t, for undo and redo in one jump.
+// a version is a trie over the ring's slots, 16 elements a leaf. committing
+// copies only the leaves that changed and the path to them, the rest is
+// shared with the version before. a roll changes one slot and the head
+// so it is as cheap as a push. resizing the ring makes a full copy
+
+// keep maxversions versions of stk, the oldest are forgotten
+void pstack_enable(size_t maxversions, stack_t *stk);
+void pstack_destroy(struct pstack *ps);
+
+// after a change to stk: elements lo up to hi are new since the last commit.
+// tag is for the caller, the cmd here. forgets the versions to redo
+void pstack_commit(size_t lo, size_t hi, int tag, stack_t *stk);
+
+// move n versions back or forward. returns how many it could
+size_t pstack_undo(size_t n, stack_t *stk);
+size_t pstack_redo(size_t n, stack_t *stk);
+
+// how many versions pstack_undo() can go back
+size_t pstack_behind(stack_t *stk);
+
+// about the version offset steps from the current one. -1, 1 are next
+// to it. tag is -1 if there is no such version
+int pstack_tag(long offset, stack_t *stk);
+size_t pstack_size(long offset, stack_t *stk);
+void pstack_peek(void *itemp, size_t dataindex, long offset, stack_t *stk);
+
+// call fun on each element of each version, for rpnvec.c
+void pstack_foreach(void (*fun)(void *itemp, void *ctx), void *ctx,
+                    stack_t *stk);
+
+// start over with the current contents as the only version
+void pstack_forget(stack_t *stk);
+
+#endif // RPNPSTACK_H
@@ -0,0 +1,465 @@
+#include <stdio.h>      // fopen(), fwrite(), rename()
+#include <stdlib.h>     // free()
+#include <string.h>     // strcmp(), strncmp(), strdup()
+#include <stdint.h>     // uint64_t
+#include <errno.h>
+#include <unistd.h>     // sysconf(), ftruncate()
+#include <sys/mman.h>   // mmap()
+#include <sys/stat.h>   // fstat()
+#include "rpnstack.h"
+#include "rpnpstack.h"
+#include "rpnfunctions.h"
+#include "rpnvec.h"     // vec_write()
+#include "rpnbig.h"     // big_digits()
+#include "rpnword.h"    // word_write()
+#include "rpnsave.h"
+
+// rpnsave.c
+// sessions in a file
+
+/* ___ comments ________________________________________________________________
+
+the file is a header page, then each stack's pages, then the words as
+text and the boxes. a stack's elements are bottom first, so its pages are
+what stack_adopt() takes, like an arena's: a load maps them private and
+points the stacks at them. nothing is read until it's used, and a stack
+that outgrows its pages moves to the heap as an arena stack does. the
+pages have room for a quarter more than was saved, the file is sparse
+there.
+
+autosave keeps the file open and writes in place. a stack's clean mark
+says how many elements from the bottom are still as written, pops below
+it lower it (rpnstack.h), so only the ones above it are written again.
+a roll moves every element, and so does an undo that jumps to a snapshot
+with another head, those write the stack again. the words and boxes are
+written again when word_gen() or vec_gen() changed, the header last. a
+stack that doesn't fit its pages any more writes a new file, renamed over
+the old one. the map of a load stays valid then, it's of the old file.
+
+the autosave file may be the one the stacks are mapped from, and a page
+of a private map that wasn't copied yet sees writes to the file. what is
+written at an element's place is that element as long as the ring starts
+at the bottom of the pages, once a roll or a spill moved it the pages
+the write goes over are copied first
+*/
+
+#define SAVE_MAGIC   "rpnsess"
+#define SAVE_VERSION 1u
+#define SAVE_BUF     (64u << 10) // bytes written at a time
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t numsz;         // the elements, sizeof(RPN_T) and token_t
+    uint32_t cmdsz;
+    int32_t hist_flag;
+    char numname[16];       // RPN_NAME, long double and __float128 are 16
+    uint64_t digits;        // big_digits()
+    uint64_t offsets[3];
+    uint64_t caps[3];
+    uint64_t counts[3];
+    uint64_t tail;          // the words, then the boxes
+    uint64_t words_len;
+    uint64_t boxes_len;
+} save_header_t;
+
+// the layout a write decides, kept for the autosave file
+typedef struct {
+    size_t offsets[3];
+    size_t caps[3];
+    size_t tail;
+    size_t words_len;
+    size_t boxes_len;
+} save_layout_t;
+
+// ___ helper functions ________________________________________________________
+
+static size_t page_round(size_t bytes) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (bytes + page - 1u) / page * page;
+}
+
+// room for a quarter more, on whole pages
+static size_t slack(size_t count, size_t elemsz) {
+    size_t bytes = page_round((count + count / 4u + 1u) * elemsz);
+    return bytes / elemsz;
+}
+
+static void header(save_header_t *hdr,
+                   const save_layout_t *layout,
+                   int hist_flag,
+                   stack_t *stks[])
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, SAVE_MAGIC, sizeof(SAVE_MAGIC));
+    hdr->version = SAVE_VERSION;
+    hdr->numsz = (uint32_t)stks[I_STK]->elemsz;
+    hdr->cmdsz = (uint32_t)stks[H_CMDS]->elemsz;
+    hdr->hist_flag = hist_flag;
+    strncpy(hdr->numname, RPN_NAME, sizeof(hdr->numname) - 1u);
+    hdr->digits = big_digits();
+    int z;
+    for (z = I_STK; z <= H_CMDS; z++) {
+        hdr->offsets[z] = layout->offsets[z];
+        hdr->caps[z] = layout->caps[z];
+        hdr->counts[z] = stack_size(stks[z]);
+    }
+    hdr->tail = layout->tail;
+    hdr->words_len = layout->words_len;
+    hdr->boxes_len = layout->boxes_len;
+}
+
+// the elements from dataindex up to the top, at their place in the file
+static int write_elems(FILE *fp, size_t offset, size_t dataindex,
+                       stack_t *stk)
+{
+    char buf[SAVE_BUF];
+    size_t per = SAVE_BUF / stk->elemsz, size = stack_size(stk);
+    if (fseek(fp, (long)(offset + dataindex * stk->elemsz), SEEK_SET)) {
+        return 0;
+    }
+    while (dataindex < size) {
+        size_t n = size - dataindex < per ? size - dataindex : per;
+        stack_copy_out(buf, dataindex, n, stk);
+        if (fwrite(buf, stk->elemsz, n, fp) != n) {
+            return 0;
+        }
+        dataindex += n;
+    }
+    return 1;
+}
+
+// a stack in the map whose ring moved: copy the pages from dataindex up,
+// the write to them shouldn't show through
+static void own_pages(save_state_t *state, size_t dataindex, stack_t *stk) {
+    char *data = stk->data, *map = state->map;
+    if (stk->owned || (stk->head == 0u && stk->spilled == 0u)
+        || data < map || data >= map + state->maplen) {
+        return;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t end = stack_size(stk) < stk->nelems ? stack_size(stk) : stk->nelems;
+    size_t at = dataindex * stk->elemsz / page * page;
+    for (; at < end * stk->elemsz; at += page) {
+        volatile char *p = data + at;
+        *p = *p;
+    }
+}
+
+// the words and boxes at layout->tail, the file ends after them
+static int write_tail(FILE *fp, save_layout_t *layout) {
+    if (fseek(fp, (long)layout->tail, SEEK_SET) || !word_write(fp)) {
+        return 0;
+    }
+    long words_end = ftell(fp);
+    if (words_end < 0 || !vec_write(fp)) {
+        return 0;
+    }
+    long end = ftell(fp);
+    if (end < 0 || fflush(fp) || ftruncate(fileno(fp), end)) {
+        return 0;
+    }
+    layout->words_len = (size_t)words_end - layout->tail;
+    layout->boxes_len = (size_t)(end - words_end);
+    return 1;
+}
+
+static int write_header(FILE *fp,
+                        const save_layout_t *layout,
+                        int hist_flag,
+                        stack_t *stks[])
+{
+    save_header_t hdr;
+    header(&hdr, layout, hist_flag, stks);
+    return !fseek(fp, 0L, SEEK_SET)
+           && fwrite(&hdr, sizeof(hdr), 1u, fp) == 1u
+           && !fflush(fp);
+}
+
+// all of it to path, through a temp file renamed over it. *layout is
+// where things went
+static int write_file(const char *path,
+                      save_layout_t *layout,
+                      int hist_flag,
+                      stack_t *stks[])
+{
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return 0;
+    }
+    FILE *fp = fopen(tmp, "w+b");
+    if (fp == NULL) {
+        return 0;
+    }
+    size_t offset = page_round(sizeof(save_header_t));
+    int z, ok = 1;
+    for (z = I_STK; z <= H_CMDS; z++) {
+        size_t elemsz = stks[z]->elemsz;
+        layout->offsets[z] = offset;
+        layout->caps[z] = slack(stack_size(stks[z]), elemsz);
+        offset += layout->caps[z] * elemsz;
+        ok = ok && write_elems(fp, layout->offsets[z], 0u, stks[z]);
+    }
+    layout->tail = offset;
+    ok = ok && write_tail(fp, layout)
+            && write_header(fp, layout, hist_flag, stks);
+    if (fclose(fp) || !ok || rename(tmp, path)) {
+        remove(tmp);
+        return 0;
+    }
+    return 1;
+}
+
+// hdr's layout fits in a file of size bytes: the stacks in order, each on
+// its element's alignment with caps that fit before the next, then the
+// tail. no sum or product here can wrap, the file may be anyone's
+static int valid_layout(const save_header_t *hdr, uint64_t size,
+                        stack_t *stks[])
+{
+    if (hdr->offsets[I_STK] != page_round(sizeof(*hdr)) || hdr->tail > size
+        || hdr->words_len > size - hdr->tail
+        || hdr->boxes_len > size - hdr->tail - hdr->words_len) {
+        return 0;
+    }
+    int z;
+    for (z = I_STK; z <= H_CMDS; z++) { // each in its pages, in order
+        uint64_t elemsz = stks[z]->elemsz;
+        uint64_t next = z < H_CMDS ? hdr->offsets[z + 1] : hdr->tail;
+        if (hdr->offsets[z] % elemsz || next > hdr->tail
+            || hdr->offsets[z] > next
+            || hdr->caps[z] > (next - hdr->offsets[z]) / elemsz
+            || hdr->counts[z] > hdr->caps[z]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// path into the stacks, words and boxes. *layout is the file's
+static int load_file(save_state_t *state,
+                     const char *path,
+                     save_layout_t *layout,
+                     int *hist_flagp,
+                     stack_t *stks[])
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    save_header_t hdr;
+    struct stat st;
+    int z, ok = fread(&hdr, sizeof(hdr), 1u, fp) == 1u
+                && fstat(fileno(fp), &st) == 0
+                && !memcmp(hdr.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC))
+                && hdr.version == SAVE_VERSION
+                && hdr.numsz == stks[I_STK]->elemsz
+                && hdr.cmdsz == stks[H_CMDS]->elemsz
+                && !strncmp(hdr.numname, RPN_NAME, sizeof(hdr.numname))
+                && valid_layout(&hdr, (uint64_t)st.st_size, stks);
+    if (!ok) {
+        fclose(fp);
+        errno = errno ? errno : EINVAL;
+        return 0;
+    }
+    size_t base = hdr.offsets[I_STK], len = hdr.tail - base;
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     fileno(fp), (off_t)base);
+    if (map == MAP_FAILED) {
+        fclose(fp);
+        return 0;
+    }
+    // a failure from here on leaves the words or boxes half read. words
+    // are defined without p digits
+    size_t digits = big_digits();
+    big_set_digits(0u);
+    if (fseek(fp, (long)hdr.tail, SEEK_SET)
+        || !word_read(fp, hdr.words_len) || !vec_read(fp)) {
+        big_set_digits(digits);
+        munmap(map, len);
+        fclose(fp);
+        errno = errno ? errno : EINVAL;
+        return 0;
+    }
+    fclose(fp);
+    big_set_digits(hdr.digits);
+    for (z = I_STK; z <= H_CMDS; z++) {
+        stack_t *stk = stks[z];
+        stack_adopt(map + (hdr.offsets[z] - base), hdr.caps[z],
+                    hdr.counts[z], stk);
+        if (stk->limit) { // spills or drops what's over it
+            stack_limit(stk->limit, stk->chunk, stk->spill != NULL, stk);
+        }
+        layout->offsets[z] = hdr.offsets[z];
+        layout->caps[z] = hdr.caps[z];
+    }
+    pstack_forget(stks[I_STK]); // the snapshots were of the old stack
+    layout->tail = hdr.tail;
+    layout->words_len = hdr.words_len;
+    layout->boxes_len = hdr.boxes_len;
+    if (state->map) {
+        munmap(state->map, state->maplen);
+    }
+    state->map = map;
+    state->maplen = len;
+    *hist_flagp = hdr.hist_flag;
+    return 1;
+}
+
+// the autosave file was just written or read with layout, as the stacks are
+static void synced(save_state_t *state,
+                   const save_layout_t *layout,
+                   stack_t *stks[])
+{
+    int z;
+    for (z = I_STK; z <= H_CMDS; z++) {
+        state->offsets[z] = layout->offsets[z];
+        state->caps[z] = layout->caps[z];
+        stack_mark_clean(stks[z]);
+    }
+    state->tail = layout->tail;
+    state->words_len = layout->words_len;
+    state->boxes_len = layout->boxes_len;
+    state->word_gen = word_gen();
+    state->vec_gen = vec_gen();
+    state->full = 0;
+}
+
+static void state_layout(const save_state_t *state, save_layout_t *layout) {
+    int z;
+    for (z = I_STK; z <= H_CMDS; z++) {
+        layout->offsets[z] = state->offsets[z];
+        layout->caps[z] = state->caps[z];
+    }
+    layout->tail = state->tail;
+    layout->words_len = state->words_len;
+    layout->boxes_len = state->boxes_len;
+}
+
+// reopens the autosave file after it was replaced
+static int reopen(save_state_t *state) {
+    if (state->fp) {
+        fclose(state->fp);
+    }
+    state->fp = fopen(state->path, "r+b");
+    return state->fp != NULL;
+}
+
+// ___ public functions ________________________________________________________
+
+int save_session(save_state_t *state,
+                 const char *path,
+                 int hist_flag,
+                 stack_t *stks[])
+{
+    if (state->path && !strcmp(path, state->path)) { // keep its layout
+        state->full = 1;
+        return save_sync(state, hist_flag, stks);
+    }
+    save_layout_t layout;
+    return write_file(path, &layout, hist_flag, stks);
+}
+
+int save_load(save_state_t *state,
+              const char *path,
+              int *hist_flagp,
+              stack_t *stks[])
+{
+    save_layout_t layout;
+    errno = 0;
+    return load_file(state, path, &layout, hist_flagp, stks);
+}
+
+int save_autosave(save_state_t *state,
+                  const char *path,
+                  int *hist_flagp,
+                  stack_t *stks[])
+{
+    free(state->path);
+    state->path = strdup(path);
+    if (state->path == NULL) {
+        return 0;
+    }
+    save_layout_t layout;
+    errno = 0;
+    if (load_file(state, path, &layout, hist_flagp, stks) && reopen(state)) {
+        synced(state, &layout, stks);
+        return 1;
+    }
+    state->full = 1; // none yet, the first save_sync() makes it
+    return errno == ENOENT;
+}
+
+int save_sync(save_state_t *state, int hist_flag, stack_t *stks[]) {
+    if (state->path == NULL) {
+        return 1;
+    }
+    int z, full = state->full || state->fp == NULL;
+    for (z = I_STK; z <= H_CMDS; z++) {
+        full |= stack_size(stks[z]) > state->caps[z];
+    }
+    save_layout_t layout;
+    if (full) {
+        if (!write_file(state->path, &layout, hist_flag, stks)
+            || !reopen(state)) {
+            return 0;
+        }
+        synced(state, &layout, stks);
+        return 1;
+    }
+    state_layout(state, &layout);
+    int ok = 1;
+    for (z = I_STK; z <= H_CMDS && ok; z++) {
+        own_pages(state, stks[z]->clean, stks[z]);
+        ok = write_elems(state->fp, state->offsets[z], stks[z]->clean,
+                         stks[z]);
+    }
+    if (ok && (state->word_gen != word_gen() || state->vec_gen != vec_gen())) {
+        ok = write_tail(state->fp, &layout);
+    }
+    if (!ok || !write_header(state->fp, &layout, hist_flag, stks)) {
+        state->full = 1; // don't trust the file, write a new one next time
+        return 0;
+    }
+    synced(state, &layout, stks);
+    return 1;
+}
+
+int save_line(save_state_t *state,
+              const char *line,
+              int *hist_flagp,
+              token_t *last_msgp,
+              stack_t *stks[])
+{
+    const char *cmd, *end, *path;
+    cmd = lex(line, &end);
+    if (cmd == NULL || end - cmd != 4
+        || (strncmp(cmd, "save", 4u) && strncmp(cmd, "load", 4u))) {
+        return 0;
+    }
+    int saving = *cmd == 's', ok = 0;
+    path = lex(end, &end);
+    if (path && !state->no_files) {
+        char name[4096];
+        size_t len = end - path < (long)sizeof(name) ? end - path : 0u;
+        memcpy(name, path, len);
+        name[len] = '\0';
+        ok = len && (saving ? save_session(state, name, *hist_flagp, stks)
+                            : save_load(state, name, hist_flagp, stks));
+    }
+    if (!ok) {
+        p_printmsg_fresh(SESF, last_msgp);
+    }
+    return 1;
+}
+
+void save_close(save_state_t *state) {
+    if (state->fp) {
+        fclose(state->fp);
+    }
+    if (state->map) {
+        munmap(state->map, state->maplen);
+    }
+    free(state->path);
+    *state = (save_state_t){0};
+}
@@ -0,0 +1,69 @@
+#ifndef RPNSAVE_H
+#define RPNSAVE_H
+#include <stdio.h>      // FILE
+#include <stddef.h>     // size_t
+#include "rpnstack.h"
+#include "rpnfunctions.h"
+
+// rpnsave.h
+// sessions in a file: the three stacks, the history toggle, the words, the
+// vectors and bigs and the p digits. the stacks are laid out as their
+// elements, bottom first, each on its own pages, so loading maps the file
+// and the stacks use its pages as they are, a page is copied the first
+// time it changes. a line "save file" or "load file" does it, interactive
+// or in a rpn_ctx_t. ./rpn --load file starts with it, --autosave file
+// too, and saves after each line what changed since the last time.
+// the file is for the numeric backend that wrote it
+
+// one calculator's, zeros are nothing loaded and no autosave
+typedef struct {
+    void *map;          // the last load's pages, the stacks may be in them
+    size_t maplen;
+    char *path;         // the autosave file
+    FILE *fp;
+    size_t offsets[3];  // its layout, where each stack's pages are
+    size_t caps[3];     // and how many elements they hold
+    size_t tail;        // the words and boxes, after the stacks
+    size_t words_len;
+    size_t boxes_len;
+    size_t word_gen;    // when the tail was written
+    size_t vec_gen;
+    int full;           // the next autosave writes all of it
+    int no_files;       // save and load lines fail, a served session's
+} save_state_t;
+
+// 0 if it can't, errno says why
+int save_session(save_state_t *state,
+                 const char *path,
+                 int hist_flag,
+                 stack_t *stks[]);
+// replaces the stacks, words and boxes with the file's. 0 if it can't be
+// read or is another backend's, nothing changed then
+int save_load(save_state_t *state,
+              const char *path,
+              int *hist_flagp,
+              stack_t *stks[]);
+
+// from now on save_sync() writes to path. a session already there is
+// loaded first. 0 if it's there but can't be loaded
+int save_autosave(save_state_t *state,
+                  const char *path,
+                  int *hist_flagp,
+                  stack_t *stks[]);
+// what changed since the last one: the elements above the stacks' clean
+// marks, the tail if a word or box changed, and the header. all of it when
+// a stack outgrew its pages. 1 without autosave
+int save_sync(save_state_t *state, int hist_flag, stack_t *stks[]);
+
+// 1 if line is "save file" or "load file", and does it. msg SESF if that
+// failed, or no_files is set
+int save_line(save_state_t *state,
+              const char *line,
+              int *hist_flagp,
+              token_t *last_msgp,
+              stack_t *stks[]);
+
+// after the stacks are destroyed, they may be in the map
+void save_close(save_state_t *state);
+
+#endif // RPNSAVE_H
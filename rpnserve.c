@@ -0,0 +1,355 @@
+#include <stdio.h>      // perror()
+#include <stdlib.h>     // malloc(), free()
+#include <string.h>     // memchr(), memmove()
+#include <errno.h>
+#include <fcntl.h>      // fcntl()
+#include <unistd.h>     // close(), unlink(), sysconf()
+#include <time.h>       // clock_gettime()
+#define stack_t sig_stack_t // signal.h's sigaltstack() one, not rpnstack.h's
+#include <signal.h>     // sigaction()
+#undef stack_t
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>   // stat()
+#include <sys/un.h>     // sockaddr_un
+#include <sys/resource.h> // setrlimit()
+#include "rpnctx.h"
+#include "rpnserve.h"
+
+// rpnserve.c
+// a server for sessions on a unix socket
+
+/* ___ comments ________________________________________________________________
+
+the main thread accepts, and hands each connection to the next worker in
+turn by adding it to that worker's epoll set. from then on only that
+worker touches the session, so its context needs no lock. a worker links
+a session into its list the first time it sees it, for the idle scan.
+
+epoll is level triggered. a readable session gets one read(), the whole
+lines in it run through ctx_eval() and its output goes back. what send()
+doesn't take waits in the context's output, the session waits for
+EPOLLOUT and doesn't read meanwhile once SERVE_PENDING is waiting, so a
+client that doesn't read can't grow the server without bound.
+
+a line without a newline waits for the rest, up to SERVE_LINE bytes, then
+the session is dropped.
+
+a socket file already at the path is another server's if connect() gets
+through, and left alone then. refused, nobody listens and it's unlinked.
+the server is ended with a signal, the handler unlinks its socket and
+dies of the signal, unlink() and raise() are safe in a handler
+*/
+
+#define SERVE_READ    (64u << 10)  // bytes a read()
+#define SERVE_LINE    (1u << 20)   // longest line
+#define SERVE_PENDING (1u << 20)   // unsent output before it stops reading
+#define SERVE_IDLE    10.0         // seconds before an idle session shrinks
+#define SERVE_EVENTS  256
+
+typedef struct session {
+    struct session *next;  // in its worker's list
+    struct session *prev;
+    int fd;
+    int listed;
+    int shrunk;
+    int quit;               // send what's left, then close
+    rpn_ctx_t *ctx;
+    char *in;               // the unfinished line
+    size_t inlen;
+    size_t incap;
+    size_t sent;            // of ctx_output()
+    double last;            // when it last had a line
+} session_t;
+
+typedef struct {
+    int epfd;
+    pthread_t thread;
+    session_t *sessions;
+} serve_worker_t;
+
+static char sock_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+// ___ helper functions ________________________________________________________
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void session_close(serve_worker_t *w, session_t *s) {
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    if (s->listed) {
+        if (s->prev) {
+            s->prev->next = s->next;
+        } else {
+            w->sessions = s->next;
+        }
+        if (s->next) {
+            s->next->prev = s->prev;
+        }
+    }
+    ctx_destroy(s->ctx);
+    free(s->in);
+    free(s);
+}
+
+// as much of the output as the socket takes. 0 if the client is gone
+static int session_send(session_t *s) {
+    size_t len;
+    const char *out = ctx_output(s->ctx, &len);
+    while (s->sent < len) {
+        ssize_t n = send(s->fd, out + s->sent, len - s->sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 1;
+        }
+        if (n < 0) {
+            return 0;
+        }
+        s->sent += (size_t)n;
+    }
+    ctx_clear(s->ctx);
+    s->sent = 0u;
+    return 1;
+}
+
+// EPOLLOUT while output waits, no EPOLLIN while too much of it does
+static void session_watch(serve_worker_t *w, session_t *s) {
+    size_t len;
+    ctx_output(s->ctx, &len);
+    size_t pending = len - s->sent;
+    struct epoll_event ev = {0};
+    ev.data.ptr = s;
+    ev.events = (pending ? EPOLLOUT : 0u)
+                | (pending < SERVE_PENDING && !s->quit ? EPOLLIN : 0u);
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, s->fd, &ev);
+}
+
+// the whole lines of what came in. 0 to close the session
+static int session_lines(session_t *s) {
+    size_t start = 0u;
+    char *nl;
+    while (!s->quit && (nl = memchr(s->in + start, '\n', s->inlen - start))) {
+        *nl = '\0';
+        int status = ctx_eval(s->ctx, s->in + start);
+        if (status == CTX_QUIT || status == CTX_FAILED) {
+            s->quit = 1; // out of memory, it's only good for closing
+        }
+        start = nl - s->in + 1;
+    }
+    s->inlen -= start;
+    memmove(s->in, s->in + start, s->inlen);
+    return s->inlen < SERVE_LINE;
+}
+
+// one read(), the lines in it. 0 to close the session
+static int session_read(session_t *s) {
+    if (s->incap - s->inlen < SERVE_READ) {
+        char *in = realloc(s->in, s->inlen + SERVE_READ);
+        if (in == NULL) {
+            return 0;
+        }
+        s->in = in;
+        s->incap = s->inlen + SERVE_READ;
+    }
+    ssize_t n = read(s->fd, s->in + s->inlen, s->incap - s->inlen);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 1;
+    }
+    if (n <= 0) { // closed, a last line without a newline runs
+        if (n == 0 && s->inlen && !s->quit) {
+            s->in[s->inlen++] = '\n';
+            session_lines(s);
+            session_send(s);
+        }
+        return 0;
+    }
+    s->inlen += (size_t)n;
+    s->last = now();
+    s->shrunk = 0;
+    return session_lines(s);
+}
+
+// gives back the memory of the sessions that have been idle a while
+static void shrink_idle(serve_worker_t *w, double t) {
+    session_t *s;
+    for (s = w->sessions; s; s = s->next) {
+        size_t len;
+        ctx_output(s->ctx, &len);
+        if (!s->shrunk && len == 0u && t - s->last >= SERVE_IDLE) {
+            ctx_shrink(s->ctx);
+            free(s->in);
+            s->in = NULL;
+            s->inlen = s->incap = 0u;
+            s->shrunk = 1;
+        }
+    }
+}
+
+static void *worker(void *arg) {
+    serve_worker_t *w = arg;
+    struct epoll_event evs[SERVE_EVENTS];
+    double scanned = now();
+    for (;;) {
+        int n = epoll_wait(w->epfd, evs, SERVE_EVENTS, 1000);
+        int i;
+        for (i = 0; i < n; i++) {
+            session_t *s = evs[i].data.ptr;
+            if (!s->listed) {
+                s->next = w->sessions;
+                s->prev = NULL;
+                if (w->sessions) {
+                    w->sessions->prev = s;
+                }
+                w->sessions = s;
+                s->listed = 1;
+            }
+            int open = 1;
+            if (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                open = session_read(s);
+            }
+            open = open && session_send(s);
+            size_t len;
+            ctx_output(s->ctx, &len);
+            if (!open || (s->quit && len == s->sent)) {
+                session_close(w, s);
+            } else {
+                session_watch(w, s);
+            }
+        }
+        double t = now();
+        if (t - scanned >= 1.0) {
+            shrink_idle(w, t);
+            scanned = t;
+        }
+    }
+    return NULL;
+}
+
+// 1 if a server listens on addr
+static int served(const struct sockaddr_un *addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    int up = connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == 0
+             || errno != ECONNREFUSED;
+    close(fd);
+    return up;
+}
+
+static void unlink_and_die(int sig) {
+    unlink(sock_path);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// the socket goes with the server, however it's ended
+static void unlink_at_exit(void) {
+    struct sigaction sa = {0};
+    sa.sa_handler = unlink_and_die;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+}
+
+// as many connections as the hard limit lets it have
+static void raise_nofile(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+// ___ public functions ________________________________________________________
+
+int serve_run(const char *path, size_t nthreads) {
+    struct sockaddr_un addr = {0};
+    struct stat st;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return 1;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        if (served(&addr)) {
+            fprintf(stderr, "%s: already served\n", path);
+            return 1;
+        }
+        unlink(path); // a stale one
+    }
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(path);
+        return 1;
+    }
+    strcpy(sock_path, path);
+    unlink_at_exit();
+    if (listen(lfd, SOMAXCONN) < 0) {
+        perror(path);
+        unlink(path);
+        return 1;
+    }
+    raise_nofile();
+    if (nthreads == 0u) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpus > 0 ? (size_t)ncpus : 1u;
+    }
+    serve_worker_t *workers = calloc(nthreads, sizeof(*workers));
+    if (workers == NULL) {
+        perror("Failed to allocate workers");
+        unlink(path);
+        return 1;
+    }
+    size_t t;
+    for (t = 0u; t < nthreads; t++) {
+        workers[t].epfd = epoll_create1(0);
+        if (workers[t].epfd < 0
+            || pthread_create(&workers[t].thread, NULL, worker, &workers[t]))
+        {
+            perror("Failed to start worker");
+            unlink(path);
+            return 1;
+        }
+    }
+    for (t = 0u;; t = (t + 1u) % nthreads) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                perror("accept");
+                sleep(1); // out of fds, say. the sessions still run
+            }
+            continue;
+        }
+        session_t *s = calloc(1u, sizeof(*s));
+        rpn_ctx_t *ctx = s ? ctx_create() : NULL;
+        if (ctx == NULL) {
+            free(s);
+            close(fd);
+            continue;
+        }
+        ctx_no_files(ctx); // the clients get no files of the server's user
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        s->fd = fd;
+        s->ctx = ctx;
+        s->last = now();
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        if (epoll_ctl(workers[t].epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            ctx_destroy(ctx);
+            free(s);
+            close(fd);
+        }
+    }
+    return 0;
+}
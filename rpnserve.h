@@ -0,0 +1,22 @@
+#ifndef RPNSERVE_H
+#define RPNSERVE_H
+#include <stddef.h>     // size_t
+
+// rpnserve.h
+// ./rpn --serve /tmp/rpn.sock: one process for many clients on a unix
+// socket. each connection is a session with its own stacks, an rpn_ctx_t.
+// a line in gets the stack back as batch mode prints it, "1 2 \n". q, or
+// closing the connection, ends the session. messages aren't sent, like
+// batch mode. sessions don't see ~/.rpnrc's words, each has its own.
+// "save file", "load file" and <file fail, ctx_no_files(), so a client
+// gets no file of the server's user onto its stack and replaces none.
+// the sessions are spread over nthreads workers, each waits on its own
+// with epoll. a session idle for SERVE_IDLE seconds is ctx_shrink()ed.
+// rpn_load is a client that measures the latency, see rpn_load.c
+
+// runs until it's killed, SIGINT SIGTERM or SIGHUP unlink the socket.
+// 1 if the socket can't be set up, or another server listens on path.
+// nthreads 0 for one per core
+int serve_run(const char *path, size_t nthreads);
+
+#endif // RPNSERVE_H
@@ -3,10 +3,23 @@
 #include <errno.h>
 #include <stdio.h>      // print errors
 #include "rpnstack.h"
+#include "rpnpstack.h"  // pstack_destroy()
 
 // ___ helper functions ________________________________________________________
 
+static RPN_LOCAL jmp_buf *catch_env = NULL;
+static RPN_LOCAL const char **catch_msgp = NULL;
+
+void stack_catch(jmp_buf *env, const char **messagep) {
+    catch_env = env;
+    catch_msgp = messagep;
+}
+
 void stack_error(const char *message) {
+    if (catch_env) {
+        *catch_msgp = message;
+        longjmp(*catch_env, 1);
+    }
     if (errno) {
         perror(message);
     } else {
@@ -16,37 +29,177 @@ void stack_error(const char *message) {
 }
 
 
+static RPN_LOCAL stack_stats_t stats;
+
+// copy out the ring in stack order, bottom first. dest holds index elems
+void stack_unwrap(void *dest, stack_t *stk) {
+    size_t lower = stk->nelems - stk->head; // from head to the end of data
+    if (lower > stk->index) {
+        lower = stk->index;
+    }
+    memcpy(dest, stk->data + stk->head * stk->elemsz, lower * stk->elemsz);
+    memcpy(dest + lower * stk->elemsz, stk->data,
+           (stk->index - lower) * stk->elemsz);
+}
+
+void stack_copy_out(void *dest, size_t dataindex, size_t n, stack_t *stk) {
+    if (dataindex < stk->spilled) { // the spilled ones, then the ring
+        size_t m = stk->spilled - dataindex < n ? stk->spilled - dataindex : n;
+        FILE *fp = stk->spill;
+        if (fseek(fp, (long)(dataindex * stk->elemsz), SEEK_SET)
+            || fread(dest, stk->elemsz, m, fp) != m) {
+            stack_error("Failed to read spilled stack");
+        }
+        dest += m * stk->elemsz;
+        dataindex += m;
+        n -= m;
+    }
+    dataindex -= stk->spilled;
+    size_t lower = stk->nelems - stack_slot(dataindex, stk); // to the end
+    if (lower > n) {
+        lower = n;
+    }
+    memcpy(dest, stk->data + stack_slot(dataindex, stk) * stk->elemsz,
+           lower * stk->elemsz);
+    memcpy(dest + lower * stk->elemsz, stk->data, (n - lower) * stk->elemsz);
+}
+
+// what the ring would shrink to, nelems if it shouldn't
+static size_t shrunk_nelems(stack_t *stk) {
+    size_t new_nelems =
+        (size_t)(stk->policy->shrinkfactor * (stk->nelems + 1u));
+    if (new_nelems < stk->reserved) {
+        new_nelems = stk->reserved;
+    }
+    return stk->owned && new_nelems < stk->nelems ? new_nelems : stk->nelems;
+}
+
+// pops call stack_shrink_halfful() at shrinkwhen: when the ring should
+// shrink, or when they go below clean
+static void arm(stack_t *stk) {
+    size_t when = 0u;
+    if (stk->nelems > stk->reserved && shrunk_nelems(stk) < stk->nelems) {
+        when = (size_t)(stk->nelems * stk->policy->shrinklimit);
+    }
+    if (stk->clean > stk->spilled + when + 1u) {
+        when = stk->clean - stk->spilled - 1u;
+    }
+    stk->shrinkwhen = when;
+}
+
+// the one place that allocates stack data. an arena stack moves to the heap.
+// realloc keeps the ring in place if it fits, otherwise it is unwrapped
+void stack_resize(size_t new_nelems, stack_t *stk, const char *message) {
+    void *data;
+    size_t end = stk->head + stk->index;
+    if (stk->owned && end <= stk->nelems && end <= new_nelems) {
+        data = realloc(stk->data, stk->elemsz * new_nelems);
+        stats.reallocs++;
+    } else {
+        data = malloc(stk->elemsz * new_nelems);
+        stats.mallocs++;
+        if (data != NULL) {
+            stack_unwrap(data, stk);
+            if (stk->owned) {
+                free(stk->data);
+                stats.frees++;
+            }
+            stk->owned = 1;
+            stk->head = 0u;
+        }
+    }
+    if (data == NULL && new_nelems > 0u) {
+        stack_error(message);
+    }
+    stk->data = data;
+    stk->nelems = new_nelems;
+    arm(stk);
+}
+
+// write the bottom chunk to the spill file, or drop it. frees chunk slots
+void stack_spill_bottom(stack_t *stk) {
+    size_t n = stk->chunk;
+    if (stk->spill) {
+        FILE *fp = stk->spill;
+        size_t lower = stk->nelems - stk->head;
+        if (lower > n) {
+            lower = n;
+        }
+        if (fseek(fp, (long)(stk->spilled * stk->elemsz), SEEK_SET)
+            || fwrite(stk->data + stk->head * stk->elemsz,
+                      stk->elemsz, lower, fp) != lower
+            || fwrite(stk->data, stk->elemsz, n - lower, fp) != n - lower) {
+            stack_error("Failed to spill stack");
+        }
+        stk->spilled += n;
+    } else {
+        stk->dropped += n;
+        stk->clean = 0u; // the rest moved down
+    }
+    stk->head = stack_slot(n, stk);
+    stk->index -= n;
+    arm(stk);
+}
+
 // before pushing. full if stk->index == stk->nelems
 void stack_grow_full(stack_t *stk) {
     if (stk->index < stk->nelems) { return; } // ok, we're done
-    size_t new_nelems = 2u * (stk->nelems + 1u);
-    stk->data =
-        realloc(stk->data, stk->elemsz * new_nelems);
-    if (stk->data == NULL) {
-        stack_error("Failed to grow stack");
-    } else {
-        stk->nelems = new_nelems;
-    stk->shrinkwhen = (size_t)(stk->nelems * stack_shrinklimit);
+    if (stk->limit && stk->index >= stk->limit) {
+        stack_spill_bottom(stk);
+        return;
+    }
+    size_t new_nelems =
+        (size_t)(stk->policy->growfactor * (stk->nelems + 1u));
+    if (new_nelems <= stk->nelems) {
+        new_nelems = stk->nelems + 1u;
+    }
+    if (stk->limit && new_nelems > stk->limit) {
+        new_nelems = stk->limit;
+    }
+    stack_resize(new_nelems, stk, "Failed to grow stack");
+}
+
+// before popping or topping with nothing in data. page in the top chunk
+void stack_underflow(stack_t *stk) {
+    if (stk->index > 0u) { return; }
+    if (stk->spilled == 0u) {
+        stack_error("Tried to pop an empty stack");
     }
+    size_t n = stk->chunk;
+    if (stk->nelems < n) {
+        stack_resize(n, stk, "Failed to page in stack");
+    }
+    FILE *fp = stk->spill;
+    stk->spilled -= n;
+    if (fseek(fp, (long)(stk->spilled * stk->elemsz), SEEK_SET)
+        || fread(stk->data, stk->elemsz, n, fp) != n) {
+        stack_error("Failed to page in stack");
+    }
+    stk->head = 0u;
+    stk->index = n;
+    arm(stk);
 }
 
 // after popping
 void stack_shrink_halfful(stack_t *stk) {
     if (stk->index > stk->shrinkwhen) {return; } // ok, we're done
-    size_t new_nelems = (stk->nelems + 1u) / 2u;
-    stk->data =
-        realloc(stk->data, stk->elemsz * new_nelems);
-    if (stk->data == NULL) {
-        stack_error("Failed to shrink stack");
+    if (stk->spilled + stk->index < stk->clean) {
+        stk->clean = stk->spilled + stk->index;
+    }
+    size_t new_nelems = shrunk_nelems(stk);
+    if (new_nelems < stk->nelems && stk->nelems > stk->reserved
+        && stk->index <= (size_t)(stk->nelems * stk->policy->shrinklimit)) {
+        stack_resize(new_nelems, stk, "Failed to shrink stack");
+    } else {
+        arm(stk); // nothing to gain, or it was for clean
     }
-    stk->nelems = new_nelems;
-    stk->shrinkwhen = (size_t)(stk->nelems * stack_shrinklimit);
 }
 
 // ___ public functions ________________________________________________________
 
 stack_t *stack_create(size_t sz) {
     stack_t *tmp = malloc(sizeof(*tmp));
+    stats.mallocs++;
     if (tmp == NULL) {
         stack_error("Failed to create a stack");
     }
@@ -54,13 +207,156 @@ stack_t *stack_create(size_t sz) {
     tmp->elemsz = sz;
     tmp->nelems = 0u;
     tmp->index = 0u;
+    tmp->head = 0u;
     tmp->shrinkwhen = 0u;
+    tmp->reserved = 0u;
+    tmp->owned = 1;
+    tmp->policy = &stack_default_policy;
+    tmp->limit = 0u;
+    tmp->chunk = 0u;
+    tmp->spilled = 0u;
+    tmp->dropped = 0u;
+    tmp->spill = NULL;
+    tmp->versions = NULL;
+    tmp->clean = 0u;
     return tmp;
 }
 
 void stack_destroy(stack_t *stk) {
-    free(stk->data);
+    if (stk->versions) {
+        pstack_destroy(stk->versions);
+    }
+    if (stk->spill) {
+        fclose(stk->spill);
+    }
+    if (stk->owned) {
+        free(stk->data);
+        stats.frees++;
+    }
     free(stk);
+    stats.frees++;
+}
+
+
+stack_arena_t *stack_arena_create(size_t size) {
+    stack_arena_t *arena = malloc(sizeof(*arena));
+    stats.mallocs++;
+    if (arena == NULL) {
+        stack_error("Failed to create an arena");
+    }
+    arena->data = malloc(size);
+    stats.mallocs++;
+    if (arena->data == NULL) {
+        stack_error("Failed to create an arena");
+    }
+    arena->size = size;
+    arena->used = 0u;
+    return arena;
+}
+
+// destroy the stacks in it first
+void stack_arena_destroy(stack_arena_t *arena) {
+    free(arena->data);
+    free(arena);
+    stats.frees += 2u;
+}
+
+// the stack keeps its nelems reserved, it won't give them back to the arena
+stack_t *stack_create_in(stack_arena_t *arena, size_t sz, size_t nelems) {
+    size_t align = 16u;
+    size_t start = (arena->used + align - 1u) / align * align;
+    if (start + sz * nelems > arena->size) {
+        stack_error("Arena too small for stack");
+    }
+    stack_t *stk = stack_create(sz);
+    stk->data = (char *)arena->data + start;
+    stk->owned = 0;
+    stk->nelems = nelems;
+    stk->reserved = nelems;
+    arena->used = start + sz * nelems;
+    return stk;
+}
+
+
+void stack_set_policy(const stack_policy_t *policy, stack_t *stk) {
+    stk->policy = policy;
+    arm(stk);
+}
+
+// chunk is clamped to limit. the spill file is deleted when it's closed
+void stack_limit(size_t limit, size_t chunk, int spill, stack_t *stk) {
+    if (chunk == 0u || chunk > limit) {
+        chunk = limit;
+    }
+    if (spill && stk->spill == NULL && limit) {
+        stk->spill = tmpfile();
+        if (stk->spill == NULL) {
+            stack_error("Failed to create spill file");
+        }
+    }
+    if (!spill && stk->spill && stk->spilled == 0u) {
+        fclose(stk->spill);
+        stk->spill = NULL;
+    }
+    stk->limit = limit;
+    stk->chunk = chunk;
+    while (limit && stk->index > limit) {
+        stack_spill_bottom(stk);
+    }
+    if (limit && stk->nelems > limit) {
+        stack_resize(limit, stk, "Failed to limit stack");
+    }
+}
+
+// grow to atleast nelems now, and don't shrink below it later
+void stack_reserve(size_t nelems, stack_t *stk) {
+    stk->reserved = nelems;
+    if (stk->nelems < nelems) {
+        stack_resize(nelems, stk, "Failed to reserve stack");
+    } else {
+        stack_set_policy(stk->policy, stk);
+    }
+}
+
+// give back what isn't used, including the reservation
+void stack_shrink_to_fit(stack_t *stk) {
+    stk->reserved = 0u;
+    if (stk->owned && stk->nelems > stk->index) {
+        stack_resize(stk->index, stk, "Failed to shrink stack");
+    }
+}
+
+void stack_adopt(void *data, size_t nelems, size_t count, stack_t *stk) {
+    if (stk->owned) {
+        free(stk->data);
+        stats.frees++;
+    }
+    stk->data = data;
+    stk->owned = 0;
+    stk->nelems = nelems;
+    stk->index = count;
+    stk->head = 0u;
+    stk->reserved = 0u;
+    stk->spilled = 0u; // the spill file is written over from the start
+    stk->dropped = 0u;
+    stk->clean = 0u;
+    arm(stk);
+}
+
+void stack_mark_clean(stack_t *stk) {
+    stk->clean = stack_size(stk);
+    arm(stk);
+}
+
+void stack_touch(size_t dataindex, stack_t *stk) {
+    if (dataindex < stk->clean) {
+        stk->clean = dataindex;
+        arm(stk);
+    }
+}
+
+stack_stats_t stack_stats(void) {
+    return stats;
 }
 
 size_t stack_elemsize(stack_t *stk) { // for completeness
@@ -69,27 +365,27 @@ size_t stack_elemsize(stack_t *stk) { // for completeness
 
 // how many are there == which index will the next one be pushed to?
 size_t stack_size(stack_t *stk) {
-    return stk->index;
+    return stk->spilled + stk->index;
 }
 
 // independent of stack_size()
 int stack_empty(stack_t *stk) {
-    return stk->index == 0u;
+    return stk->index == 0u && stk->spilled == 0u;
 }
 
 
 // index is where the next item will be pushed to. increment index after use
 void stack_push(void *itemp, stack_t *stk) {
     stack_grow_full(stk);
-    memcpy(stk->data + stk->index++ * stk->elemsz, itemp, stk->elemsz);
+    memcpy(stk->data + stack_slot(stk->index++, stk) * stk->elemsz,
+           itemp, stk->elemsz);
 }
 
 
 void stack_pop(void *itemp, stack_t *stk) {
-    if (stack_empty (stk)) {
-        stack_error("Tried to pop an empty stack");
-    }                     // decrement index before use
-    memcpy(itemp, stk->data + --stk->index * stk->elemsz, stk->elemsz);
+    stack_underflow(stk); // decrement index before use
+    memcpy(itemp, stk->data + stack_slot(--stk->index, stk) * stk->elemsz,
+           stk->elemsz);
     stack_shrink_halfful(stk);
 }
 
@@ -98,7 +394,9 @@ void stack_top(void *itemp, stack_t *stk) {
     if (stack_empty (stk)) {
         stack_error("Tried to top an empty stack");
     }
-    memcpy(itemp, stk->data + (stk->index - 1u) * stk->elemsz, stk->elemsz);
+    stack_underflow(stk);
+    memcpy(itemp, stk->data + stack_slot(stk->index - 1u, stk) * stk->elemsz,
+           stk->elemsz);
 }
 
 
@@ -107,30 +405,40 @@ void stack_peek(void *itemp, size_t dataindex, stack_t *stk) {
     if (stack_empty (stk)) {
         stack_error("Tried to peek an empty stack");
     }
-    if (dataindex >= stk->index) {
+    if (dataindex >= stack_size(stk)) {
         stack_error("Tried to peek over top of stack");
     }
-    memcpy(itemp, stk->data + dataindex * stk->elemsz, stk->elemsz);
+    if (dataindex < stk->spilled) { // slow, for display
+        FILE *fp = stk->spill;
+        if (fseek(fp, (long)(dataindex * stk->elemsz), SEEK_SET)
+            || fread(itemp, stk->elemsz, 1u, fp) != 1u) {
+            stack_error("Failed to peek spilled stack");
+        }
+        return;
+    }
+    dataindex -= stk->spilled;
+    memcpy(itemp, stk->data + stack_slot(dataindex, stk) * stk->elemsz,
+           stk->elemsz);
 }
 
 
 // there are atleast 2 elements when called (by rold, rolu)
+// the data is a ring, so rolling moves one element and the head.
+// bottom first, every element moved
 void stack_roll(int direction, stack_t *stk) {
-    void *tmp = malloc(stk->elemsz);
-    if (tmp == NULL) {
-        stack_error("Failed to roll stack");
-    }
-    size_t blocksize = (stk->index - 1u) * stk->elemsz;
+    stack_touch(0u, stk);
+    size_t last = stk->nelems - 1u;
     if (direction == 1) {                   // down ROLD
-        memcpy(tmp, stk->data + blocksize, stk->elemsz);
-        memmove(stk->data + stk->elemsz, stk->data, blocksize);
-        memcpy(stk->data, tmp, stk->elemsz);
+        size_t below = stk->head ? stk->head - 1u : last; // below the bottom
+        memmove(stk->data + below * stk->elemsz,
+                stk->data + stack_slot(stk->index - 1u, stk) * stk->elemsz,
+                stk->elemsz);
+        stk->head = below;
     } else if (direction == -1) {           // up   ROLU
-        memcpy(tmp, stk->data, stk->elemsz);
-        memmove(stk->data, stk->data + stk->elemsz, blocksize);
-        memcpy(stk->data + blocksize, tmp, stk->elemsz);
+        size_t above = stack_slot(stk->index, stk); // above the top
+        memmove(stk->data + above * stk->elemsz,
+                stk->data + stk->head * stk->elemsz,
+                stk->elemsz);
+        stk->head = stk->head == last ? 0u : stk->head + 1u;
      } // else fail silently
-    free(tmp);
 }
-
-
@@ -1,32 +1,99 @@
 #ifndef RPNSTACK_H
 #define RPNSTACK_H
 #include <stdlib.h> // for size_t
+#include <setjmp.h> // jmp_buf
 
 // rpnstack.h
 // a LIFO (Last In First Out) data structure
 
+// for the state each thread of ./rpn --independent has its own of, rpnpar.h
+#define RPN_LOCAL __thread
+
+// when and how much a stack resizes. shrinklimit is for hysteresis sake
+typedef struct {
+    double growfactor;      // nelems *= growfactor when full
+    double shrinkfactor;    // nelems *= shrinkfactor when
+    double shrinklimit;     // index falls to nelems * shrinklimit
+} stack_policy_t;
+
+static const stack_policy_t stack_default_policy = {
+    2.0,    // growfactor
+    0.5,    // shrinkfactor
+    0.41,   // shrinklimit, shrink when 41% full
+};
+
 // index is where the next push will be to, also how many elems are used
 // allocated size of stk->data is stk->elemsz * stk->nelems
+// the data is a ring: the bottom element is at head, stack_slot() wraps
 // update shrinkwhen member when resizing. check it in the halffull function
+// never shrinks below reserved. data not owned comes from a stack_arena_t
+// a limited stack keeps at most limit elements in memory, index counts those.
+// on a push past it the bottom chunk goes to a temp file, or is dropped.
+// spilled elements are paged back in when popping reaches them.
+// clean counts the elements from the bottom that haven't changed since
+// stack_mark_clean(), rpnsave.c writes the rest. pops reaching below it
+// take the shrinkwhen slow path, so keeping it costs the pushes nothing
 typedef struct {
     size_t elemsz;
     size_t nelems;
     size_t index;
+    size_t head;
     size_t shrinkwhen;
+    size_t reserved;
+    int owned;
+    const stack_policy_t *policy;
     void *data;
+    size_t limit;       // 0u: unlimited
+    size_t chunk;
+    size_t spilled;     // elements in the spill file, below the ones in data
+    size_t dropped;     // counted, not stored
+    void *spill;        // FILE *, NULL when dropping
+    struct pstack *versions; // rpnpstack.h, NULL when not kept
+    size_t clean;       // 0u: not kept
 } stack_t;
 
-// for hysteresis sake
-static const double stack_shrinklimit = 0.41; // shrink when 41% full
-// static const double stack_shrinkfactor = 0.5 ;
-// static const double stack_growfactor   = 2.0 ;
+// one block backing several stacks, so a session doesn't touch malloc.
+// a stack that outgrows its part of the arena moves to the heap
+typedef struct {
+    size_t size;
+    size_t used;
+    void *data;
+} stack_arena_t;
+
+// counts every malloc, realloc and free the stacks do
+typedef struct {
+    size_t mallocs;
+    size_t reallocs;
+    size_t frees;
+} stack_stats_t;
 
 // stack_create(sizeof(<element type>));
 stack_t *stack_create(size_t sz);
 void stack_destroy(stack_t *stk);
 
+stack_arena_t *stack_arena_create(size_t size);
+void stack_arena_destroy(stack_arena_t *arena);
+// stack_create_in(arena, sizeof(<element type>), <elements to reserve>);
+stack_t *stack_create_in(stack_arena_t *arena, size_t sz, size_t nelems);
+
+void stack_set_policy(const stack_policy_t *policy, stack_t *stk);
+// keep limit elements in memory, move chunk of them out at a time.
+// not for stacks that are rolled. spill 0: drop the chunks instead
+void stack_limit(size_t limit, size_t chunk, int spill, stack_t *stk);
+void stack_reserve(size_t nelems, stack_t *stk);
+void stack_shrink_to_fit(stack_t *stk);
+stack_stats_t stack_stats(void);
+// count elements at data are the stack now, nelems fit. it doesn't own
+// them, like an arena's. what it held, spilled or not, is gone
+void stack_adopt(void *data, size_t nelems, size_t count, stack_t *stk);
+
+// the elements up to the top are as they were saved. stack_touch(): the
+// ones from dataindex up may have changed, for writes that aren't pushes
+void stack_mark_clean(stack_t *stk);
+void stack_touch(size_t dataindex, stack_t *stk);
+
 size_t stack_elemsize(stack_t *stk); // probably no use
-size_t stack_size(stack_t *stk);
+size_t stack_size(stack_t *stk); // includes spilled, not dropped
 int stack_empty(stack_t *stk);
 
 void stack_push(void *itemp, stack_t *stk);
@@ -34,6 +101,68 @@ void  stack_pop(void *itemp, stack_t *stk);
 void  stack_top(void *itemp, stack_t *stk);
 void stack_peek(void *itemp, size_t dataindex, stack_t *stk);
 void stack_roll(int direction, stack_t *stk);
+// copies the elements bottom first into dest, which holds stack_size()
+void stack_unwrap(void *dest, stack_t *stk);
+// n elements from dataindex up into dest, the spilled ones too
+void stack_copy_out(void *dest, size_t dataindex, size_t n, stack_t *stk);
+
+// where in data element dataindex is. 0u is bottom, index - 1u is top
+static inline size_t stack_slot(size_t dataindex, stack_t *stk) {
+    size_t slot = stk->head + dataindex;
+    return slot < stk->nelems ? slot : slot - stk->nelems;
+}
+
+// slow paths, called by the inlined typed functions below
+// stack_error() prints message and exits, or if this thread set a catch,
+// sets *messagep and longjmp()s to env. stack_catch(NULL, NULL) to exit
+void stack_error(const char *message);
+void stack_catch(jmp_buf *env, const char **messagep);
+void stack_resize(size_t new_nelems, stack_t *stk, const char *message);
+void stack_grow_full(stack_t *stk);
+void stack_shrink_halfful(stack_t *stk);
+void stack_underflow(stack_t *stk);
+
+
+// ___ typed stacks ____________________________________________________________
+// the void * functions above memcpy elemsz bytes through an out-of-line call.
+// STACK_TYPED(num, RPN_T) generates num_push(), num_pop(), num_top() and
+// num_peek() for a stack_t made by stack_create(sizeof(RPN_T)).
+// they are inlined, so a push is a compare and a store
+#define STACK_TYPED(prefix, type)                                             \
+                                                                              \
+static inline void prefix##_push(type item, stack_t *stk) {                   \
+    if (stk->index == stk->nelems) {                                          \
+        stack_grow_full(stk);                                                 \
+    }                                                                         \
+    ((type *)stk->data)[stack_slot(stk->index++, stk)] = item;                \
+}                                                                             \
+                                                                              \
+static inline type prefix##_pop(stack_t *stk) {                               \
+    if (stk->index == 0u) {                                                   \
+        stack_underflow(stk);                                                 \
+    }                                                                         \
+    type item = ((type *)stk->data)[stack_slot(--stk->index, stk)];           \
+    if (stk->index <= stk->shrinkwhen) {                                      \
+        stack_shrink_halfful(stk);                                            \
+    }                                                                         \
+    return item;                                                              \
+}                                                                             \
+                                                                              \
+static inline type prefix##_top(stack_t *stk) {                               \
+    if (stk->index == 0u) {                                                   \
+        stack_underflow(stk);                                                 \
+    }                                                                         \
+    return ((type *)stk->data)[stack_slot(stk->index - 1u, stk)];             \
+}                                                                             \
+                                                                              \
+static inline type prefix##_peek(size_t dataindex, stack_t *stk) {            \
+    type item;                                                                \
+    if (dataindex < stk->spilled || dataindex - stk->spilled >= stk->index) { \
+        stack_peek(&item, dataindex, stk);                                    \
+        return item;                                                          \
+    }                                                                         \
+    return ((type *)stk->data)[stack_slot(dataindex - stk->spilled, stk)];    \
+}
 
 #endif // RPNSTACK_H
 
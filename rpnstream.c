@@ -0,0 +1,169 @@
+#include <stdio.h>      // perror()
+#include <stdlib.h>     // malloc()
+#include <string.h>     // memchr(), memmove()
+#include <errno.h>
+#include <unistd.h>     // read()
+#include <fenv.h>       // feclearexcept()
+#include "rpnstack.h"
+#include "rpnfunctions.h"
+#include "rpnprog.h"
+#include "rpnsave.h"
+#include "rpnstream.h"
+
+// rpnstream.c
+// batch mode over a file or stdin
+
+/* ___ comments ________________________________________________________________
+
+one buffer, reused. read() fills it, the whole lines in it run, and the
+unfinished line at the end moves to the front before the next read().
+lines short enough go through prog_cached(), generated input repeats a lot.
+a line "save file" or "load file" is the session's, like an argument's,
+and the autosave file is synced after each line.
+
+a line longer than the buffer runs a piece at a time: the tokens up to the
+last blank run, the token cut by the end of the buffer waits for the rest.
+the stack is dumped when the newline finally comes.
+a single token longer than the buffer grows it.
+the long lines have their math errors checked too, but not FP_PRECISE
+*/
+
+#define STREAM_BUFSIZ   (1u << 20)  // 1 MiB
+#define STREAM_CACHED   256u        // longer lines aren't cached
+
+// ___ helper functions ________________________________________________________
+
+static int is_blank(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+// a long line's first piece clears the fp flags, its last tests them
+static void line_begin(int piecewise) {
+    if (!piecewise && (fp_check == FP_LINE || fp_check == FP_PRECISE)) {
+        feclearexcept(FE_ALL_EXCEPT);
+    }
+}
+
+// a whole line, or the end of a long one. line ends in '\0'
+static int run_line(char *line,
+                    size_t len,
+                    size_t lineno,
+                    int piecewise,
+                    int *hist_flagp,
+                    token_t *last_msgp,
+                    stack_t *stks[])
+{
+    if (!piecewise && len <= STREAM_CACHED) {
+        return prog_run_line(prog_cached(line), lineno,
+                             hist_flagp, last_msgp, stks);
+    }
+    line_begin(piecewise);
+    int quit = handle_tokens(hist_flagp, last_msgp, line, stks);
+    if (fp_check == FP_LINE || fp_check == FP_PRECISE) {
+        token_t err = math_error();
+        if (err != JUNK) {
+            prog_fp_report(lineno, err, JUNK);
+        }
+    }
+    return quit;
+}
+
+// run_line(), then the stack, unless it's a save or load
+static int run_dump(save_state_t *session,
+                    char *line,
+                    size_t len,
+                    size_t lineno,
+                    int piecewise,
+                    int *hist_flagp,
+                    token_t *last_msgp,
+                    stack_t *stks[])
+{
+    int quit = 0;
+    if (piecewise || !save_line(session, line, hist_flagp, last_msgp, stks)) {
+        quit = run_line(line, len, lineno, piecewise, hist_flagp, last_msgp,
+                        stks);
+    }
+    if (!quit) { // a save or load line too, a line out for each line in
+        dump_stack(stks[I_STK]);
+    }
+    if (!save_sync(session, *hist_flagp, stks)) {
+        perror(session->path);
+    }
+    return quit;
+}
+
+// ___ public functions ________________________________________________________
+
+int stream_run(int fd,
+               save_state_t *session,
+               int *hist_flagp,
+               token_t *last_msgp,
+               stack_t *stks[])
+{
+    size_t size = STREAM_BUFSIZ;
+    char *buf = malloc(size + 1u); // room for a '\0' after a full buffer
+    if (buf == NULL) {
+        perror("Failed to allocate input buffer");
+        exit(EXIT_FAILURE);
+    }
+    size_t len = 0u, start, cut, lineno = 1u;
+    int piecewise = 0; // running a line longer than the buffer
+    int quit = 0, eof = 0;
+    char *nl;
+    while (!quit && !eof) {
+        ssize_t n = read(fd, buf + len, size - len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            perror("Failed to read input");
+            break;
+        }
+        eof = (n == 0);
+        len += (size_t)n;
+        start = 0u;
+        while (!quit && (nl = memchr(buf + start, '\n', len - start))) {
+            *nl = '\0';
+            quit = run_dump(session, buf + start, nl - buf - start, lineno++,
+                            piecewise, hist_flagp, last_msgp, stks);
+            piecewise = 0;
+            start = nl - buf + 1;
+        }
+        if (quit) {
+            break;
+        }
+        if (eof) { // last line without a newline
+            if (start < len || piecewise) {
+                buf[len] = '\0';
+                quit = run_dump(session, buf + start, len - start, lineno,
+                                piecewise, hist_flagp, last_msgp, stks);
+            }
+            break;
+        }
+        if (start == 0u && len == size) { // no newline in a full buffer
+            cut = len;
+            while (cut > 0u && !is_blank(buf[cut - 1u])) {
+                cut--;
+            }
+            if (cut == 0u) { // one token fills it
+                size *= 2u;
+                char *tmp = realloc(buf, size + 1u);
+                if (tmp == NULL) {
+                    perror("Failed to grow input buffer");
+                    exit(EXIT_FAILURE);
+                }
+                buf = tmp;
+                continue;
+            }
+            buf[cut - 1u] = '\0';
+            line_begin(piecewise);
+            quit = handle_tokens(hist_flagp, last_msgp, buf, stks);
+            piecewise = 1;
+            start = cut;
+        }
+        memmove(buf, buf + start, len - start);
+        len -= start;
+    }
+    free(buf);
+    return quit;
+}
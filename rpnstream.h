@@ -0,0 +1,19 @@
+#ifndef RPNSTREAM_H
+#define RPNSTREAM_H
+#include "rpnstack.h"
+#include "rpnfunctions.h"
+#include "rpnsave.h"
+
+// rpnstream.h
+// batch mode over a file or stdin. each line is a program, like an argument,
+// and the stack is dumped after it. no limit on the length of lines.
+// "save file" and "load file" lines are session's, rpnsave.h
+
+// reads fd to the end. returns 1 on q
+int stream_run(int fd,
+               save_state_t *session,
+               int *hist_flagp,
+               token_t *last_msgp,
+               stack_t *stks[]);
+
+#endif // RPNSTREAM_H
@@ -0,0 +1,454 @@
+#include <stdio.h>      // fopen(), snprintf()
+#include <stdlib.h>     // malloc(), free()
+#include <string.h>     // memcpy(), strerror()
+#include <errno.h>
+#include <stdint.h>     // uint64_t
+#include <stddef.h>     // max_align_t
+#include <math.h>       // NAN, RPN_POW
+#include <fenv.h>       // feraiseexcept()
+#include "rpnstack.h"
+#include "rpnpstack.h"
+#include "rpnfunctions.h"
+#include "rpnnum.h"
+#include "rpnvec.h"
+#include "rpnbig.h"     // big_native()
+#include "rpnout.h"     // out_err()
+
+// rpnvec.c
+// vectors as stack elements
+
+/* ___ comments ________________________________________________________________
+
+the handle is in the low bits of a quiet nan's mantissa: an index into
+boxes[] and a magic number above it, under the quiet bit. little endian, the
+low bytes of every RPN_T are the low mantissa bits. float has 22 payload
+bits, 16 of them for the index. arithmetic never makes a nan with the magic,
+0 / 0 has payload 0. "nan(0x...)" can, but the index must be a live box.
+
+the kernels are plain loops over restrict pointers, one per operator and
+per broadcast case, so the compiler vectorizes them for float and double.
+long double is x87 and stays scalar. ^ v e l call libm per element.
+two vectors of different lengths give the shorter length and FE_INVALID.
+
+mark and sweep. the roots are every element of I_STK, its snapshots and
+H_NUMS, spilled ones too. snapshot leaves are visited once per version
+that holds them, collecting is rare
+*/
+
+#if RPN_MANT_DIG > 24
+# define VEC_INDEX_BITS 32
+# define VEC_MAGIC      0x7EC5u // 16 bits, 32 to 47
+# define VEC_MAGIC_MASK 0xFFFFu
+#else
+# define VEC_INDEX_BITS 16
+# define VEC_MAGIC      0x2Bu   // 6 bits, 16 to 21, float
+# define VEC_MAGIC_MASK 0x3Fu
+#endif
+
+#define VEC_COLLECT_MIN (64u << 20) // bytes made before collecting
+
+// a vector or a big, with what vec_collect() needs
+typedef struct vec_box {
+    size_t bytes;
+    int kind;
+    int marked;
+    max_align_t data[];
+} box_t;
+
+static RPN_LOCAL box_t **boxes = NULL;
+static RPN_LOCAL size_t nboxes = 0u;      // used slots, some may be NULL
+static RPN_LOCAL size_t capboxes = 0u;
+static RPN_LOCAL size_t freeslot = 0u;    // no NULL slots below it
+static RPN_LOCAL size_t made = 0u;        // bytes since the last collection
+static RPN_LOCAL size_t live = 0u;        // bytes after it
+static RPN_LOCAL size_t gen = 0u;         // boxes made and freed
+static RPN_LOCAL int no_files = 0;        // <file fails, vec_swap()ped
+
+// ___ helper functions ________________________________________________________
+
+// the low 8 bytes, or all 4 of a float
+static uint64_t low_bits(RPN_T num) {
+    uint64_t low = 0u;
+    memcpy(&low, &num, sizeof(num) < 8u ? sizeof(num) : 8u);
+    return low;
+}
+
+static RPN_T handle_of(size_t index) {
+    RPN_T num = NAN;
+    uint64_t low = low_bits(num) | (uint64_t)VEC_MAGIC << VEC_INDEX_BITS
+                   | index;
+    memcpy(&num, &low, sizeof(num) < 8u ? sizeof(num) : 8u);
+    return num;
+}
+
+static box_t *box_of(RPN_T num) {
+    if (num == num) {
+        return NULL;
+    }
+    uint64_t low = low_bits(num);
+    if ((low >> VEC_INDEX_BITS & VEC_MAGIC_MASK) != VEC_MAGIC) {
+        return NULL;
+    }
+    size_t index = low & (((uint64_t)1u << VEC_INDEX_BITS) - 1u);
+    return index < nboxes ? boxes[index] : NULL;
+}
+
+static void vec_error(const char *message) {
+    stack_error(message);
+}
+
+static void swap_size(size_t *a, size_t *b) {
+    size_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+// ___ kernels _________________________________________________________________
+
+// out = x op y for vectors x and y, or with one side a scalar xs, ys
+#define VEC_KERNEL2(name, expr)                                               \
+static void name(RPN_T *restrict out, const RPN_T *restrict x,               \
+                 const RPN_T *restrict y, RPN_T xs, RPN_T ys, size_t n)      \
+{                                                                            \
+    size_t i;                                                                \
+    if (x && y) {                                                            \
+        for (i = 0u; i < n; i++) {                                           \
+            RPN_T a = x[i], b = y[i];                                        \
+            out[i] = (expr);                                                 \
+        }                                                                    \
+    } else if (x) {                                                          \
+        RPN_T b = ys;                                                        \
+        for (i = 0u; i < n; i++) {                                           \
+            RPN_T a = x[i];                                                  \
+            out[i] = (expr);                                                 \
+        }                                                                    \
+    } else {                                                                 \
+        RPN_T a = xs;                                                        \
+        for (i = 0u; i < n; i++) {                                           \
+            RPN_T b = y[i];                                                  \
+            out[i] = (expr);                                                 \
+        }                                                                    \
+    }                                                                        \
+}
+
+#define VEC_KERNEL1(name, expr)                                               \
+static void name(RPN_T *restrict out, const RPN_T *restrict x, size_t n) {   \
+    size_t i;                                                                \
+    for (i = 0u; i < n; i++) {                                               \
+        RPN_T a = x[i];                                                      \
+        out[i] = (expr);                                                     \
+    }                                                                        \
+}
+
+VEC_KERNEL2(kernel_mul, a * b)
+VEC_KERNEL2(kernel_add, a + b)
+VEC_KERNEL2(kernel_sub, a - b)
+VEC_KERNEL2(kernel_divi, a / b)
+VEC_KERNEL2(kernel_powe, RPN_POW(a, b))
+VEC_KERNEL2(kernel_root, RPN_POW(a, RPN_ONE / b))
+
+VEC_KERNEL1(kernel_expe, RPN_EXP(a))
+VEC_KERNEL1(kernel_logn, RPN_LOG(a))
+VEC_KERNEL1(kernel_neg, -a)
+VEC_KERNEL1(kernel_inve, RPN_ONE / a)
+
+// ___ public functions ________________________________________________________
+
+void *box_get(RPN_T num, int kind) {
+    box_t *box = box_of(num);
+    return box && box->kind == kind ? box->data : NULL;
+}
+
+RPN_T box_new(size_t bytes, int kind, void **datap) {
+    while (freeslot < nboxes && boxes[freeslot]) {
+        freeslot++;
+    }
+    if (freeslot == nboxes) {
+        if (nboxes >> VEC_INDEX_BITS) {
+            vec_error("Too many vectors");
+        }
+        if (nboxes == capboxes) {
+            capboxes = capboxes ? 2u * capboxes : 64u;
+            box_t **tmp = realloc(boxes, capboxes * sizeof(*boxes));
+            if (tmp == NULL) {
+                vec_error("Failed to make a vector");
+            }
+            boxes = tmp;
+        }
+        boxes[nboxes++] = NULL;
+    }
+    box_t *box = malloc(sizeof(*box) + bytes);
+    if (box == NULL) {
+        vec_error("Failed to make a vector");
+    }
+    box->bytes = sizeof(*box) + bytes;
+    box->kind = kind;
+    box->marked = 0;
+    boxes[freeslot] = box;
+    made += box->bytes;
+    gen++;
+    *datap = box->data;
+    return handle_of(freeslot++);
+}
+
+RPN_T vec_new(size_t len, rpn_vec_t **vecp) {
+    RPN_T num = box_new(sizeof(rpn_vec_t) + len * sizeof(RPN_T), BOX_VEC,
+                        (void **)vecp);
+    (*vecp)->len = len;
+    return num;
+}
+
+token_t vec_load(const char *path, RPN_T *nump) {
+    char name[BUFSIZ];
+    size_t len = 0u;
+    while (path[len] && path[len] != ' ' && path[len] != '\t'
+           && path[len] != '\n' && path[len] != '\r' && len + 1u < BUFSIZ) {
+        name[len] = path[len];
+        len++;
+    }
+    name[len] = '\0';
+    if (no_files) { // a served session's, the files aren't the client's
+        char msg[BUFSIZ + 64u];
+        snprintf(msg, sizeof(msg), "%s: no files here\n", name);
+        out_err(msg);
+        p_printmsg(SESF);
+        return JUNK;
+    }
+    FILE *fp = fopen(name, "r");
+    if (fp == NULL) { // like perror()
+        char msg[BUFSIZ + 64u];
+        snprintf(msg, sizeof(msg), "%s: %s\n", name, strerror(errno));
+        out_err(msg);
+        return JUNK;
+    }
+    size_t cap = 1024u, n = 0u;
+    RPN_T *nums = malloc(cap * sizeof(*nums));
+    char line[BUFSIZ];
+    while (nums && fgets(line, sizeof(line), fp)) {
+        const char *str = line, *end;
+        for (;;) {
+            while (*str == ' ' || *str == '\t' || *str == ','
+                   || *str == '\n' || *str == '\r') {
+                str++;
+            }
+            if (*str == '\0') {
+                break;
+            }
+            RPN_T num = num_parse(str, &end);
+            if (end == str) { // not a number, skip the word
+                while (*str && *str != ' ' && *str != ',' && *str != '\n') {
+                    str++;
+                }
+                continue;
+            }
+            if (n == cap) {
+                cap *= 2u;
+                RPN_T *tmp = realloc(nums, cap * sizeof(*nums));
+                if (tmp == NULL) {
+                    free(nums);
+                }
+                nums = tmp;
+                if (nums == NULL) {
+                    break;
+                }
+            }
+            nums[n++] = num;
+            str = end;
+        }
+    }
+    fclose(fp);
+    if (nums == NULL) {
+        vec_error("Failed to load a vector");
+    }
+    rpn_vec_t *vec;
+    *nump = vec_new(n, &vec);
+    memcpy(vec->data, nums, n * sizeof(*nums));
+    free(nums);
+    return NUM;
+}
+
+RPN_T vec_binary(token_t cmd, RPN_T x, RPN_T y) {
+    rpn_vec_t *xv = vec_get(x), *yv = vec_get(y), *out;
+    size_t len = xv ? xv->len : yv->len;
+    x = xv ? x : big_native(x); // a big scalar is rounded
+    y = yv ? y : big_native(y);
+    if (xv && yv && xv->len != yv->len) {
+        feraiseexcept(FE_INVALID);
+        len = xv->len < yv->len ? xv->len : yv->len;
+    }
+    RPN_T result = vec_new(len, &out);
+    const RPN_T *xd = xv ? xv->data : NULL;
+    const RPN_T *yd = yv ? yv->data : NULL;
+    switch (cmd) {
+    case MUL:  kernel_mul (out->data, xd, yd, x, y, len); break;
+    case ADD:  kernel_add (out->data, xd, yd, x, y, len); break;
+    case SUB:  kernel_sub (out->data, xd, yd, x, y, len); break;
+    case DIVI: kernel_divi(out->data, xd, yd, x, y, len); break;
+    case POWE: kernel_powe(out->data, xd, yd, x, y, len); break;
+    case ROOT: kernel_root(out->data, xd, yd, x, y, len); break;
+    default:   vec_error("Not a vector operator");
+    }
+    return result;
+}
+
+// GENE makes 0 to x - 1 from a scalar, the others map a vector
+RPN_T vec_unary(token_t cmd, RPN_T x) {
+    rpn_vec_t *xv = vec_get(x), *out;
+    if (cmd == GENE) {
+        if (xv || !(x >= RPN_ZERO) || x > (RPN_T)((size_t)-1 >> 8)) {
+            feraiseexcept(FE_INVALID);
+            return NAN;
+        }
+        size_t i, len = (size_t)x;
+        RPN_T result = vec_new(len, &out);
+        for (i = 0u; i < len; i++) {
+            out->data[i] = (RPN_T)i;
+        }
+        return result;
+    }
+    RPN_T result = vec_new(xv->len, &out);
+    switch (cmd) {
+    case EXPE: kernel_expe(out->data, xv->data, xv->len); break;
+    case LOGN: kernel_logn(out->data, xv->data, xv->len); break;
+    case NEG:  kernel_neg (out->data, xv->data, xv->len); break;
+    case INVE: kernel_inve(out->data, xv->data, xv->len); break;
+    default:   vec_error("Not a vector operator");
+    }
+    return result;
+}
+
+
+static void mark(void *itemp, void *ctx) {
+    (void)ctx;
+    box_t *box = box_of(*(RPN_T *)itemp);
+    if (box) {
+        box->marked = 1;
+    }
+}
+
+void vec_collect(stack_t *stks[]) {
+    if (made < VEC_COLLECT_MIN || made < live) {
+        return;
+    }
+    size_t z;
+    RPN_T num;
+    for (z = 0u; z < stack_size(stks[I_STK]); z++) {
+        num = num_peek(z, stks[I_STK]);
+        mark(&num, NULL);
+    }
+    for (z = 0u; z < stack_size(stks[H_NUMS]); z++) {
+        num = num_peek(z, stks[H_NUMS]);
+        mark(&num, NULL);
+    }
+    pstack_foreach(mark, NULL, stks[I_STK]);
+    live = 0u;
+    for (z = 0u; z < nboxes; z++) {
+        if (boxes[z] && !boxes[z]->marked) {
+            free(boxes[z]);
+            boxes[z] = NULL;
+            gen++;
+            if (z < freeslot) {
+                freeslot = z;
+            }
+        } else if (boxes[z]) {
+            boxes[z]->marked = 0;
+            live += boxes[z]->bytes;
+        }
+    }
+    while (nboxes && boxes[nboxes - 1u] == NULL) {
+        nboxes--;
+    }
+    if (freeslot > nboxes) {
+        freeslot = nboxes;
+    }
+    made = 0u;
+}
+
+void vec_swap(vec_state_t *state) {
+    box_t **was = boxes;
+    boxes = state->boxes;
+    state->boxes = was;
+    swap_size(&nboxes, &state->nboxes);
+    swap_size(&capboxes, &state->capboxes);
+    swap_size(&freeslot, &state->freeslot);
+    swap_size(&made, &state->made);
+    swap_size(&live, &state->live);
+    swap_size(&gen, &state->gen);
+    int was_no_files = no_files;
+    no_files = state->no_files;
+    state->no_files = was_no_files;
+}
+
+void vec_clear(void) {
+    size_t z;
+    for (z = 0u; z < nboxes; z++) {
+        free(boxes[z]);
+    }
+    free(boxes);
+    boxes = NULL;
+    nboxes = capboxes = freeslot = made = live = 0u;
+    gen++;
+}
+
+int vec_write(FILE *fp) {
+    if (fwrite(&nboxes, sizeof(nboxes), 1u, fp) != 1u) {
+        return 0;
+    }
+    size_t z;
+    for (z = 0u; z < nboxes; z++) {
+        box_t none = {sizeof(box_t), -1, 0};
+        box_t *box = boxes[z] ? boxes[z] : &none;
+        size_t len = box->bytes - sizeof(*box);
+        if (fwrite(box, sizeof(*box), 1u, fp) != 1u
+            || fwrite(box->data, 1u, len, fp) != len) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int vec_read(FILE *fp) {
+    vec_clear();
+    size_t n, z;
+    if (fread(&n, sizeof(n), 1u, fp) != 1u
+        || n > (size_t)1u << VEC_INDEX_BITS) { // there can't be that many
+        return 0;
+    }
+    if (n) {
+        boxes = calloc(n, sizeof(*boxes));
+        if (boxes == NULL) {
+            return 0;
+        }
+    }
+    capboxes = nboxes = n;
+    for (z = 0u; z < n; z++) {
+        box_t head;
+        if (fread(&head, sizeof(head), 1u, fp) != 1u
+            || head.bytes < sizeof(head)) {
+            return 0;
+        }
+        if (head.kind < 0) { // a free slot
+            continue;
+        }
+        box_t *box = malloc(head.bytes);
+        if (box == NULL) {
+            return 0;
+        }
+        *box = head;
+        box->marked = 0;
+        boxes[z] = box;
+        live += box->bytes;
+        size_t len = box->bytes - sizeof(*box);
+        if (fread(box->data, 1u, len, fp) != len) {
+            return 0;
+        }
+    }
+    while (freeslot < nboxes && boxes[freeslot]) {
+        freeslot++;
+    }
+    return 1;
+}
+
+size_t vec_gen(void) {
+    return gen;
+}
@@ -0,0 +1,74 @@
+#ifndef RPNVEC_H
+#define RPNVEC_H
+#include <stdio.h>  // FILE
+#include <stddef.h> // size_t
+#include "rpnstack.h"
+#include "rpnfunctions.h"
+
+// rpnvec.h
+// vectors as stack elements. a vector is an RPN_T nan with a handle in its
+// payload, so I_STK, the history and the snapshots carry it like a number.
+// vectors don't change once made, a copy shares one. the operators work
+// elementwise, and a scalar against a vector is applied to every element
+
+// what a handle can refer to. rpnbig.c keeps its numbers here too
+enum {BOX_VEC, BOX_BIG};
+// NULL if num isn't a handle to kind
+void *box_get(RPN_T num, int kind);
+// bytes for the caller to fill in through *datap, they don't change after
+RPN_T box_new(size_t bytes, int kind, void **datap);
+
+typedef struct {
+    size_t len;
+    RPN_T data[];
+} rpn_vec_t;
+
+// NULL if num isn't a vector
+static inline rpn_vec_t *vec_get(RPN_T num) {
+    return box_get(num, BOX_VEC);
+}
+static inline int vec_is(RPN_T num) {
+    return num != num && vec_get(num) != NULL; // only a nan can be one
+}
+
+// a new vector of len elements, to be filled in through *vecp
+RPN_T vec_new(size_t len, rpn_vec_t **vecp);
+// numbers from a file, separated by blanks, newlines or commas.
+// path ends at a blank. JUNK if it can't be read
+token_t vec_load(const char *path, RPN_T *nump);
+
+// cmd is one of the binary or unary tokens, or NEG, INVE, GENE
+RPN_T vec_binary(token_t cmd, RPN_T x, RPN_T y);
+RPN_T vec_unary(token_t cmd, RPN_T x);
+
+// frees the vectors and bigs nothing in stks refers to, I_STK with its snapshots
+// and H_NUMS, once enough were made since the last time. call it between
+// lines, a compiled line holds vectors that aren't on a stack yet
+void vec_collect(stack_t *stks[]);
+
+// the boxes, for rpnsave.c: how many slots, then each one's kind, size
+// and bytes, 0 bytes for a free one. vec_read() replaces this thread's
+// with them, at the same handles, so the numbers on the stacks are theirs.
+// 0 if they can't be written or read. vec_gen() changes with every box
+// made or freed
+int vec_write(FILE *fp);
+int vec_read(FILE *fp);
+size_t vec_gen(void);
+
+// the boxes of one calculator. a thread has one, vec_swap() trades it for
+// *state, so a rpn_ctx_t brings its own while it runs. zeros are empty
+typedef struct {
+    struct vec_box **boxes;
+    size_t nboxes;
+    size_t capboxes;
+    size_t freeslot;
+    size_t made;
+    size_t live;
+    size_t gen;
+    int no_files;           // <file loads fail, see ctx_no_files()
+} vec_state_t;
+void vec_swap(vec_state_t *state);
+// frees every box of this thread's, whatever refers to it
+void vec_clear(void);
+
+#endif // RPNVEC_H
@@ -0,0 +1,303 @@
+#include <stdio.h>      // fopen(), getline()
+#include <stdlib.h>     // malloc(), free()
+#include <string.h>     // memcpy(), strlen(), strncmp()
+#include "rpnstack.h"
+#include "rpnpstack.h"
+#include "rpnfunctions.h"
+#include "rpnprog.h"
+#include "rpnbig.h"     // big_digits()
+#include "rpnword.h"
+
+// rpnword.c
+// user words
+
+/* ___ comments ________________________________________________________________
+
+the words are kept in the order they were defined. the last nlive of them
+are in the table, the ones after were undone and wait for a redo. a new
+definition drops those, like a new cmd drops the snapshots to redo.
+undo and redo of DEFN only ever take the last definition away or put the
+next one back, so a word leaving the table is always first in its bucket.
+
+a word keeps its body as text too. a line compiled with a definition in it
+owns the word word_parse() made, and each run of the line defines a copy,
+compiled again. a <file or a big number would be freed by vec_collect()
+while the word still had it, so those aren't allowed in a body. with p50
+a body can have cmds and words but no numbers, they'd be bigs. a word
+defined before p50 keeps its RPN_T numbers, the operators read them back
+*/
+
+#define WORD_BUCKETS 256u  // power of 2
+
+static RPN_LOCAL rpn_word_t **buckets = NULL; // WORD_BUCKETS of them
+static RPN_LOCAL rpn_word_t **defs = NULL;
+static RPN_LOCAL size_t ndefs = 0u, nlive = 0u, defs_cap = 0u;
+static RPN_LOCAL rpn_word_t *pending = NULL;
+static RPN_LOCAL size_t gen = 0u;
+static RPN_LOCAL int frozen = 0;
+
+// ___ helper functions ________________________________________________________
+
+// FNV-1a, like the lines in rpnprog.c
+static size_t hash_name(const char *name, size_t len) {
+    size_t hash = 14695981039346656037u;
+    while (len--) {
+        hash ^= (unsigned char)*name++;
+        hash *= 1099511628211u;
+    }
+    return hash;
+}
+
+static int is_name(const rpn_word_t *word, const char *name, size_t len) {
+    return !strncmp(word->name, name, len) && word->name[len] == '\0';
+}
+
+// name and body in one block, the body isn't compiled
+static rpn_word_t *word_new(const char *name, size_t len,
+                            const char *body, size_t bodylen)
+{
+    rpn_word_t *word = malloc(sizeof(*word) + len + bodylen + 2u);
+    if (word == NULL) {
+        stack_error("Failed to define word");
+    }
+    memcpy(word->name, name, len);
+    word->name[len] = '\0';
+    word->body = word->name + len + 1u;
+    memcpy(word->body, body, bodylen);
+    word->body[bodylen] = '\0';
+    word->hash = hash_name(name, len);
+    word->next = NULL;
+    word->prog = NULL;
+    return word;
+}
+
+static void table_insert(rpn_word_t *word) {
+    if (buckets == NULL) {
+        buckets = calloc(WORD_BUCKETS, sizeof(*buckets));
+        if (buckets == NULL) {
+            stack_error("Failed to define word");
+        }
+    }
+    rpn_word_t **bucket = &buckets[word->hash & (WORD_BUCKETS - 1u)];
+    word->next = *bucket;
+    *bucket = word;
+    gen++;
+}
+
+static void table_remove(rpn_word_t *word) {
+    rpn_word_t **bucket = &buckets[word->hash & (WORD_BUCKETS - 1u)];
+    *bucket = word->next;
+    word->next = NULL;
+    gen++;
+}
+
+// ___ public functions ________________________________________________________
+
+rpn_word_t *word_parse(const char *str,
+                       const char **endp,
+                       rpn_word_t **scope,
+                       size_t nscope)
+{
+    const char *end = str, *name, *tok;
+    RPN_T num;
+    name = lex(str, &end);
+    if (name == NULL || (*name == ';' && end - name == 1)) { // : ;
+        *endp = end;
+        return NULL;
+    }
+    int bad = (*name == '<' || *name == ':');
+    if (!bad && tokenize(name, &num) == NUM) { // 2 isn't a name
+        bad = 1;
+    }
+    const char *body = end;
+    for (tok = lex(end, &end); tok; tok = lex(end, &end)) {
+        if (*tok == ';' && end - tok == 1) {
+            break;
+        }
+        bad |= (*tok == '<' || *tok == ':');
+        if (!bad && big_digits() && tokenize(tok, &num) == NUM) {
+            bad = 1; // a big, see the comments
+        }
+    }
+    if (tok == NULL) { // no ;, the rest of the line was the body
+        *endp = body + strlen(body);
+        return NULL;
+    }
+    *endp = end;
+    if (bad) {
+        return NULL;
+    }
+    rpn_word_t *word = word_new(name, body - name, body, tok - body);
+    word->prog = prog_compile_scoped(word->body, scope, nscope);
+    return word;
+}
+
+void word_free(rpn_word_t *word) {
+    if (word) {
+        prog_destroy(word->prog);
+        free(word);
+    }
+}
+
+rpn_word_t *word_find(const char *name,
+                      size_t len,
+                      rpn_word_t **scope,
+                      size_t nscope)
+{
+    while (nscope--) {
+        if (is_name(scope[nscope], name, len)) {
+            return scope[nscope];
+        }
+    }
+    if (nlive == 0u) { // most of the time, no hashing then
+        return NULL;
+    }
+    size_t hash = hash_name(name, len);
+    rpn_word_t *word;
+    for (word = buckets[hash & (WORD_BUCKETS - 1u)]; word; word = word->next) {
+        if (word->hash == hash && is_name(word, name, len)) {
+            return word;
+        }
+    }
+    return NULL;
+}
+
+void word_pending(rpn_word_t *word) {
+    pending = word;
+}
+
+void word_define(void) {
+    if (pending == NULL || frozen) {
+        pending = NULL;
+        return;
+    }
+    size_t len = strlen(pending->name);
+    rpn_word_t *word = word_new(pending->name, len, pending->body,
+                                strlen(pending->body));
+    word->prog = prog_compile(word->body);
+    pending = NULL;
+    while (ndefs > nlive) { // no redo after a definition
+        word_free(defs[--ndefs]);
+    }
+    if (ndefs == defs_cap) {
+        defs_cap = defs_cap ? 2u * defs_cap : 16u;
+        defs = realloc(defs, defs_cap * sizeof(*defs));
+        if (defs == NULL) {
+            stack_error("Failed to define word");
+        }
+    }
+    defs[ndefs++] = word;
+    nlive++;
+    table_insert(word);
+}
+
+void word_undo(void) {
+    if (nlive && !frozen) {
+        table_remove(defs[--nlive]);
+    }
+}
+
+void word_redo(void) {
+    if (nlive < ndefs && !frozen) {
+        table_insert(defs[nlive++]);
+    }
+}
+
+void word_share(word_state_t *state) {
+    frozen = 1;
+    *state = (word_state_t){buckets, defs, ndefs, nlive, defs_cap, gen, 1};
+}
+
+void word_swap(word_state_t *state) {
+    word_state_t was = {buckets, defs, ndefs, nlive, defs_cap, gen, frozen};
+    buckets = state->buckets;
+    defs = state->defs;
+    ndefs = state->ndefs;
+    nlive = state->nlive;
+    defs_cap = state->defs_cap;
+    gen = state->gen;
+    frozen = state->frozen;
+    *state = was;
+}
+
+void word_clear(void) {
+    while (ndefs) {
+        word_free(defs[--ndefs]);
+    }
+    free(defs);
+    free(buckets);
+    defs = NULL;
+    buckets = NULL;
+    nlive = defs_cap = 0u;
+    gen++;
+}
+
+int word_write(FILE *fp) {
+    size_t i;
+    for (i = 0u; i < nlive; i++) {
+        if (fprintf(fp, ": %s%s;\n", defs[i]->name, defs[i]->body) < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int word_read(FILE *fp, size_t len) {
+    word_clear();
+    char *line = NULL;
+    size_t size = 0u;
+    ssize_t n;
+    int ok = 1;
+    while (len && (n = getline(&line, &size, fp)) > 0) {
+        len -= (size_t)n < len ? (size_t)n : len;
+        const char *end;
+        rpn_word_t *word = *line == ':' ? word_parse(line + 1, &end, NULL, 0u)
+                                        : NULL;
+        if (word == NULL) {
+            ok = 0;
+            break;
+        }
+        word_pending(word); // as DEFN, without the history
+        word_define();
+        word_free(word);
+    }
+    free(line);
+    return ok && len == 0u;
+}
+
+size_t word_gen(void) {
+    return gen;
+}
+
+int word_rc(const char *path,
+            int *hist_flagp,
+            token_t *last_msgp,
+            stack_t *stks[])
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    void (*printmsg_was)(token_t msgcode) = p_printmsg;
+    void (*fresh_was)(token_t msgcode, token_t *last_msgp) = p_printmsg_fresh;
+    p_printmsg = donot_printmsg;
+    p_printmsg_fresh = donot_printmsg_fresh;
+    char *line = NULL;
+    size_t size = 0u;
+    while (getline(&line, &size, file) > 0) {
+        handle_tokens(hist_flagp, last_msgp, line, stks);
+    }
+    free(line);
+    fclose(file);
+    p_printmsg = printmsg_was;
+    p_printmsg_fresh = fresh_was;
+    // what it defined can't be undone
+    while (!stack_empty(stks[H_CMDS])) {
+        cmd_pop(stks[H_CMDS]);
+    }
+    while (!stack_empty(stks[H_NUMS])) {
+        num_pop(stks[H_NUMS]);
+    }
+    pstack_forget(stks[I_STK]);
+    return 1;
+}
@@ -0,0 +1,89 @@
+#ifndef RPNWORD_H
+#define RPNWORD_H
+#include <stdio.h>      // FILE
+#include <stddef.h>     // size_t
+#include "rpnstack.h"
+#include "rpnfunctions.h"
+#include "rpnprog.h"
+
+// rpnword.h
+// user words, ": sq c * ;" then "3 sq". a word is its body compiled once,
+// like a line, and a line that uses it gets the body's insns where the
+// name was, so calling it costs what typing the body would.
+// the name is looked up whole in a hash table before tokenize() looks at
+// its first char, so "sq" isn't s any more. a word uses the words defined
+// before it, : sq sq sq * ; is a fourth power.
+// defining is a cmd in the history, _ forgets the word, y defines it again.
+// ~/.rpnrc is read at the start, definitions like those, one a line
+
+typedef struct rpn_word {
+    struct rpn_word *next;  // in its bucket
+    size_t hash;
+    rpn_prog_t *prog;       // the body
+    char *body;             // its text, after the name
+    char name[];
+} rpn_word_t;
+
+// str is past the :, *endp is set past the ;. words that aren't defined
+// yet are looked up in scope first, the definitions before this one in the
+// line. NULL if it's not name ... ; or there's a <file in it, or a number
+// while p is on
+rpn_word_t *word_parse(const char *str,
+                       const char **endp,
+                       rpn_word_t **scope,
+                       size_t nscope);
+void word_free(rpn_word_t *word);
+
+// the word named by the len chars at name, the last one of scope or the
+// table. NULL if there is none
+rpn_word_t *word_find(const char *name,
+                      size_t len,
+                      rpn_word_t **scope,
+                      size_t nscope);
+
+// DEFN in do_cmd(): defines a copy of the word word_pending() was given.
+// the undo and redo of DEFN
+void word_pending(rpn_word_t *word);
+void word_define(void);
+void word_undo(void);
+void word_redo(void);
+
+// the words of one calculator. a thread has its own table, word_swap()
+// trades it for *state, so a rpn_ctx_t brings its own while it runs.
+// zeros are no words
+typedef struct {
+    rpn_word_t **buckets;
+    rpn_word_t **defs;
+    size_t ndefs;
+    size_t nlive;
+    size_t defs_cap;
+    size_t gen;
+    int frozen;
+} word_state_t;
+void word_swap(word_state_t *state);
+// frees this thread's words
+void word_clear(void);
+
+// for --independent, the lines run on threads: from now on a definition is
+// only seen by the rest of its line, the table stays as it is. *state is
+// the table for the threads to word_swap() in, theirs to read, not to clear
+void word_share(word_state_t *state);
+
+// the words, for rpnsave.c: each one in the table as a ": name body ;"
+// line, oldest first. word_read() replaces this thread's words with the
+// len bytes of those at fp. 0 if one can't be written or read
+int word_write(FILE *fp);
+int word_read(FILE *fp, size_t len);
+
+// changes when a word is defined or undone. compiled lines older than
+// that may have an old body in them
+size_t word_gen(void);
+
+// runs the lines of the file without msgs, then forgets the history.
+// 0 if it can't be opened
+int word_rc(const char *path,
+            int *hist_flagp,
+            token_t *last_msgp,
+            stack_t *stks[]);
+
+#endif // RPNWORD_H